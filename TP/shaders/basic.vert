@@ -1,8 +1,13 @@
 #version 450
 
+// gl_BaseInstanceARB is needed to offset instanced draws into the instance indices
+#extension GL_ARB_shader_draw_parameters : require
+
 #include "utils.glsl"
 
-layout(location = 0) in vec3 in_pos;
+// Packed vertices store the bitangent sign in in_pos.w, and octahedral encoded
+// normals and tangents in the xy components
+layout(location = 0) in vec4 in_pos;
 layout(location = 1) in vec3 in_normal;
 layout(location = 2) in vec2 in_uv;
 layout(location = 3) in vec4 in_tangent_bitangent_sign;
@@ -24,15 +29,38 @@ layout(binding = 2) buffer InstanceTransform {
     ModelTransform instances[];
 };
 
+// Instances drawn, compacted by culling or all of them in order
+layout(binding = 12) readonly buffer InstanceIndices {
+    uint indices[];
+};
+
+// One entry per command of a multi draw, single draws bind their own entry
+layout(binding = 11) readonly buffer MeshDequantizations {
+    MeshDequantization dequantizations[];
+};
+
 // uniform mat4 model;
 
+// Matches depth.vert for the equal depth test after the prepass
+invariant gl_Position;
+
 void main() {
-    const mat4 model_ = instances[gl_InstanceID].transform;
-    const vec4 position = model_ * vec4(in_pos, 1.0);
+    const ModelTransform instance = instances[indices[gl_BaseInstanceARB + gl_InstanceID]];
+    const MeshDequantization dequant = dequantizations[gl_DrawIDARB];
+    const mat4 model_ = instance.transform;
+    const vec3 local_pos = in_pos.xyz * dequant.scale.xyz + dequant.offset.xyz;
+    const vec4 position = model_ * vec4(local_pos, 1.0);
+
+    vec3 normal = in_normal;
+    vec4 tangent_bitangent_sign = in_tangent_bitangent_sign;
+    if(dequant.scale.w > 0.5) {
+        normal = oct_decode(in_normal.xy);
+        tangent_bitangent_sign = vec4(oct_decode(in_tangent_bitangent_sign.xy), in_pos.w - 0.5);
+    }
 	
-    out_normal = normalize(mat3(model_) * in_normal);
-    out_tangent = normalize(mat3(model_) * in_tangent_bitangent_sign.xyz);
-    out_bitangent = cross(out_tangent, out_normal) * (in_tangent_bitangent_sign.w > 0.0 ? 1.0 : -1.0);
+    out_normal = normalize(mat3(model_) * normal);
+    out_tangent = normalize(mat3(model_) * tangent_bitangent_sign.xyz);
+    out_bitangent = cross(out_tangent, out_normal) * (tangent_bitangent_sign.w > 0.0 ? 1.0 : -1.0);
 
     out_uv = in_uv;
     out_color = in_color;
@@ -0,0 +1,40 @@
+#version 450
+
+// gl_BaseInstanceARB is needed to offset instanced draws into the instance indices
+#extension GL_ARB_shader_draw_parameters : require
+
+#include "utils.glsl"
+
+// vertex shader of the depth prepass, its positions must match basic.vert exactly
+
+layout(location = 0) in vec4 in_pos;
+
+layout(binding = 0) uniform Data {
+    FrameData frame;
+};
+
+layout(binding = 2) buffer InstanceTransform {
+    ModelTransform instances[];
+};
+
+// See basic.vert
+layout(binding = 12) readonly buffer InstanceIndices {
+    uint indices[];
+};
+
+// One entry per command of a multi draw, single draws bind their own entry
+layout(binding = 11) readonly buffer MeshDequantizations {
+    MeshDequantization dequantizations[];
+};
+
+invariant gl_Position;
+
+void main() {
+    const ModelTransform instance = instances[indices[gl_BaseInstanceARB + gl_InstanceID]];
+    const MeshDequantization dequant = dequantizations[gl_DrawIDARB];
+    const mat4 model_ = instance.transform;
+    const vec3 local_pos = in_pos.xyz * dequant.scale.xyz + dequant.offset.xyz;
+    const vec4 position = model_ * vec4(local_pos, 1.0);
+
+    gl_Position = frame.camera.view_proj * position;
+}
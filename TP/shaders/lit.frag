@@ -26,8 +26,47 @@ layout(binding = 1) buffer PointLights {
     PointLight point_lights[];
 };
 
+// Light lists of the clusters, see cluster_lights.comp
+layout(binding = 8) readonly buffer ClusterLightCounts {
+    uint cluster_light_counts[];
+};
+
+layout(binding = 9) readonly buffer ClusterLightIndices {
+    uint cluster_light_indices[];
+};
+
 const vec3 ambient = vec3(0.0);
 
+vec3 point_light_contribution(uint index, vec3 normal) {
+    PointLight light = point_lights[index];
+    const vec3 to_light = (light.position - in_position);
+    const float dist = length(to_light);
+    const vec3 light_vec = to_light / dist;
+
+    const float NoL = dot(light_vec, normal);
+    const float att = attenuation(dist, light.radius);
+    if(NoL <= 0.0 || att <= 0.0f) {
+        return vec3(0.0);
+    }
+
+    return light.color * (NoL * att);
+}
+
+uint cluster_index() {
+    const uvec3 grid = frame.cluster_grid;
+    const vec4 clip = frame.camera.view_proj * vec4(in_position, 1.0);
+    const vec2 uv = clamp((clip.xy / clip.w) * 0.5 + 0.5, 0.0, 1.0);
+    const uvec2 tile = min(uvec2(uv * vec2(grid.xy)), grid.xy - 1);
+    const float slice = log(clip.w / frame.cluster_near) * frame.cluster_depth_scale;
+    const uint z = min(uint(max(slice, 0.0)), grid.z - 1);
+    return tile.x + grid.x * (tile.y + grid.y * z);
+}
+
+// Blue to green to red
+vec3 heat_map(float x) {
+    return clamp(vec3(2.0 * x - 1.0, 1.0 - abs(2.0 * x - 1.0), 1.0 - 2.0 * x), 0.0, 1.0);
+}
+
 void main() {
 #ifdef NORMAL_MAPPED
     const vec3 normal_map = unpack_normal_map(texture(in_normal_texture, in_uv).xy);
@@ -40,19 +79,18 @@ void main() {
 
     vec3 acc = frame.sun_color * max(0.0, dot(frame.sun_dir, normal)) + ambient;
 
-    for(uint i = 0; i != frame.point_light_count; ++i) {
-        PointLight light = point_lights[i];
-        const vec3 to_light = (light.position - in_position);
-        const float dist = length(to_light);
-        const vec3 light_vec = to_light / dist;
-
-        const float NoL = dot(light_vec, normal);
-        const float att = attenuation(dist, light.radius);
-        if(NoL <= 0.0 || att <= 0.0f) {
-            continue;
+    uint cluster_light_count = 0;
+    if(frame.cluster_grid.x != 0) {
+        const uint cluster = cluster_index();
+        const uint first = cluster * frame.max_cluster_lights;
+        cluster_light_count = cluster_light_counts[cluster];
+        for(uint i = 0; i != cluster_light_count; ++i) {
+            acc += point_light_contribution(cluster_light_indices[first + i], normal);
+        }
+    } else {
+        for(uint i = 0; i != frame.point_light_count; ++i) {
+            acc += point_light_contribution(i, normal);
         }
-
-        acc += light.color * (NoL * att);
     }
 
     out_color = vec4(in_color * acc, 1.0);
@@ -61,6 +99,11 @@ void main() {
     out_color *= texture(in_texture, in_uv);
 #endif
 
+    // Red from 32 lights per cluster
+    if(frame.show_light_clusters != 0) {
+        out_color = vec4(heat_map(float(cluster_light_count) / 32.0), 1.0);
+    }
+
 #ifdef DEBUG_NORMAL
     out_color = vec4(normal * 0.5 + 0.5, 1.0);
 #endif
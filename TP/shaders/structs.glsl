@@ -1,5 +1,11 @@
 struct CameraData {
     mat4 view_proj;
+
+    vec3 position;
+    float padding_1;
+
+    // Inward facing planes (xyz: normal, w: distance), no far plane
+    vec4 frustum_planes[5];
 };
 
 struct FrameData {
@@ -10,6 +16,15 @@ struct FrameData {
 
     vec3 sun_color;
     float padding_1;
+
+    // Clustered lighting grid, all zero when lights are not clustered. View
+    // depth d falls in slice floor(log(d / cluster_near) * cluster_depth_scale).
+    uvec3 cluster_grid;
+    uint max_cluster_lights;
+    float cluster_near;
+    float cluster_depth_scale;
+    uint show_light_clusters;
+    float padding_2;
 };
 
 struct PointLight {
@@ -22,3 +37,42 @@ struct PointLight {
 struct ModelTransform {
 	mat4 transform;
 };
+
+// Per mesh, object space position = in_pos.xyz * scale.xyz + offset.xyz
+struct MeshDequantization {
+    // scale.w is 1 for packed vertices, 0 otherwise
+    vec4 scale;
+    vec4 offset;
+};
+
+struct CullingInstance {
+    // Object space bounding sphere (xyz: center, w: radius)
+    vec4 bounding_sphere;
+
+    // Commands of the LODs of the instance mesh start at draw_index
+    uint draw_index;
+    uint lod_count;
+    uint padding_1;
+    uint padding_2;
+
+    // Object space simplification error of each LOD
+    vec4 lod_errors;
+};
+
+struct CullingStats {
+    uint visible_count;
+    uint triangle_count;
+    uint occluded_count;
+    uint padding_1;
+
+    uint lod_instance_counts[4];
+};
+
+// Matches the layout expected by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    uint count;
+    uint instance_count;
+    uint first_index;
+    int base_vertex;
+    uint base_instance;
+};
@@ -0,0 +1,459 @@
+#include "BVH.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace OM3D
+{
+
+    static constexpr u32 bin_count = 16;
+    static constexpr u32 max_leaf_size = 4;
+
+    // Cost of visiting a node, relative to testing one box
+    static constexpr float traversal_cost = 1.0f;
+    static constexpr u32 all_planes =
+        (1 << std::tuple_size_v<FrustumPlanes>) - 1;
+
+    enum class PlaneSide
+    {
+        Outside,
+        Intersecting,
+        Inside,
+    };
+
+    static PlaneSide classify(const AABB &box, const glm::vec4 &plane)
+    {
+        const glm::vec3 normal = glm::vec3(plane);
+
+        // Corners furthest along and against the plane normal
+        const glm::bvec3 sign = glm::greaterThanEqual(normal, glm::vec3(0.0f));
+        const glm::vec3 positive = glm::mix(box.min, box.max, sign);
+        const glm::vec3 negative = glm::mix(box.max, box.min, sign);
+
+        if (glm::dot(normal, positive) + plane.w < 0.0f)
+        {
+            return PlaneSide::Outside;
+        }
+        if (glm::dot(normal, negative) + plane.w < 0.0f)
+        {
+            return PlaneSide::Intersecting;
+        }
+        return PlaneSide::Inside;
+    }
+
+    // Distance at which the ray enters the box, or infinity if it misses it
+    static float intersect(const AABB &box, const glm::vec3 &origin,
+                           const glm::vec3 &inv_dir, float max_distance)
+    {
+        const glm::vec3 t0 = (box.min - origin) * inv_dir;
+        const glm::vec3 t1 = (box.max - origin) * inv_dir;
+        const glm::vec3 t_min = glm::min(t0, t1);
+        const glm::vec3 t_max = glm::max(t0, t1);
+
+        const float enter =
+            std::max(std::max(t_min.x, t_min.y), std::max(t_min.z, 0.0f));
+        const float exit = std::min(std::min(t_max.x, t_max.y),
+                                    std::min(t_max.z, max_distance));
+        return enter <= exit ? enter : std::numeric_limits<float>::infinity();
+    }
+
+    void BVH::build(Span<const AABB> boxes)
+    {
+        const u32 count = u32(boxes.size());
+
+        _boxes.assign(boxes.begin(), boxes.end());
+        _indices.resize(count);
+        std::iota(_indices.begin(), _indices.end(), 0);
+
+        _nodes.clear();
+        if (!count)
+        {
+            return;
+        }
+        _nodes.reserve(2 * count);
+
+        std::vector<glm::vec3> centers(count);
+        for (u32 i = 0; i != count; ++i)
+        {
+            centers[i] = _boxes[i].center();
+        }
+
+        const auto range_bounds = [&](u32 first, u32 size) {
+            AABB bounds;
+            for (u32 i = first; i != first + size; ++i)
+            {
+                bounds.extend(_boxes[_indices[i]]);
+            }
+            return bounds;
+        };
+
+        _nodes.push_back(Node{ range_bounds(0, count), 0, count, 0 });
+
+        std::vector<u32> stack = { 0 };
+        while (!stack.empty())
+        {
+            const u32 node_index = stack.back();
+            stack.pop_back();
+
+            const u32 first = _nodes[node_index].first;
+            const u32 size = _nodes[node_index].count;
+            if (size <= 1)
+            {
+                continue;
+            }
+
+            AABB center_bounds;
+            for (u32 i = first; i != first + size; ++i)
+            {
+                center_bounds.extend(centers[_indices[i]]);
+            }
+
+            // Find the cheapest split over the bins of every axis
+            struct Bin
+            {
+                AABB bounds;
+                u32 count = 0;
+            };
+
+            float best_cost = std::numeric_limits<float>::infinity();
+            u32 best_axis = 0;
+            u32 best_split = 0;
+            for (u32 axis = 0; axis != 3; ++axis)
+            {
+                const float axis_min = center_bounds.min[axis];
+                const float axis_extent = center_bounds.max[axis] - axis_min;
+                if (axis_extent <= 0.0f)
+                {
+                    continue;
+                }
+
+                const float scale = float(bin_count) / axis_extent;
+                Bin bins[bin_count] = {};
+                for (u32 i = first; i != first + size; ++i)
+                {
+                    const u32 index = _indices[i];
+                    const u32 bin = std::min(
+                        u32((centers[index][axis] - axis_min) * scale),
+                        bin_count - 1);
+                    bins[bin].bounds.extend(_boxes[index]);
+                    ++bins[bin].count;
+                }
+
+                // Cost of everything right of each split, swept backwards
+                float right_costs[bin_count] = {};
+                {
+                    AABB bounds;
+                    u32 right_count = 0;
+                    for (u32 i = bin_count - 1; i != 0; --i)
+                    {
+                        bounds.extend(bins[i].bounds);
+                        right_count += bins[i].count;
+                        right_costs[i - 1] =
+                            bounds.surface_area() * float(right_count);
+                    }
+                }
+
+                AABB bounds;
+                u32 left_count = 0;
+                for (u32 split = 0; split != bin_count - 1; ++split)
+                {
+                    bounds.extend(bins[split].bounds);
+                    left_count += bins[split].count;
+
+                    const float cost = bounds.surface_area()
+                            * float(left_count)
+                        + right_costs[split];
+                    if (cost < best_cost)
+                    {
+                        best_cost = cost;
+                        best_axis = axis;
+                        best_split = split;
+                    }
+                }
+            }
+
+            const float area = _nodes[node_index].bounds.surface_area();
+            if (size <= max_leaf_size
+                && area * traversal_cost + best_cost >= area * float(size))
+            {
+                continue;
+            }
+
+            u32 middle = first + size / 2;
+            if (best_cost < std::numeric_limits<float>::infinity())
+            {
+                const float axis_min = center_bounds.min[best_axis];
+                const float scale =
+                    float(bin_count)
+                    / (center_bounds.max[best_axis] - axis_min);
+                const auto it = std::partition(
+                    _indices.begin() + first, _indices.begin() + first + size,
+                    [&](u32 index) {
+                        const u32 bin = std::min(
+                            u32((centers[index][best_axis] - axis_min)
+                                * scale),
+                            bin_count - 1);
+                        return bin <= best_split;
+                    });
+                middle = u32(it - _indices.begin());
+            }
+
+            // All centers in one bin, fall back to a median split
+            if (middle == first || middle == first + size)
+            {
+                middle = first + size / 2;
+            }
+
+            const u32 left = u32(_nodes.size());
+            _nodes[node_index].left = left;
+            _nodes.push_back(Node{ range_bounds(first, middle - first), first,
+                                   middle - first, 0 });
+            _nodes.push_back(Node{ range_bounds(middle, first + size - middle),
+                                   middle, first + size - middle, 0 });
+
+            stack.push_back(left);
+            stack.push_back(left + 1);
+        }
+    }
+
+    void BVH::refit(Span<const AABB> boxes)
+    {
+        ALWAYS_ASSERT(boxes.size() == _boxes.size(),
+                      "BVH refit with a different box count");
+        std::copy(boxes.begin(), boxes.end(), _boxes.begin());
+
+        // Children are always stored after their parent
+        for (size_t i = _nodes.size(); i != 0; --i)
+        {
+            Node &node = _nodes[i - 1];
+            node.bounds = AABB{};
+            if (node.is_leaf())
+            {
+                for (u32 k = node.first; k != node.first + node.count; ++k)
+                {
+                    node.bounds.extend(_boxes[_indices[k]]);
+                }
+            }
+            else
+            {
+                node.bounds.extend(_nodes[node.left].bounds);
+                node.bounds.extend(_nodes[node.left + 1].bounds);
+            }
+        }
+    }
+
+    size_t BVH::size() const
+    {
+        return _boxes.size();
+    }
+
+    size_t BVH::node_count() const
+    {
+        return _nodes.size();
+    }
+
+    AABB BVH::bounds() const
+    {
+        return _nodes.empty() ? AABB{} : _nodes[0].bounds;
+    }
+
+    void BVH::append_range(const Node &node, std::vector<u32> &result) const
+    {
+        result.insert(result.end(), _indices.begin() + node.first,
+                      _indices.begin() + node.first + node.count);
+    }
+
+    void BVH::cull(const FrustumPlanes &planes,
+                   std::vector<u32> &visible) const
+    {
+        if (_nodes.empty())
+        {
+            return;
+        }
+
+        // Planes a node is fully inside of are not tested for its children
+        struct Entry
+        {
+            u32 node;
+            u32 plane_mask;
+        };
+
+        std::vector<Entry> stack = { Entry{ 0, all_planes } };
+        while (!stack.empty())
+        {
+            const Entry entry = stack.back();
+            stack.pop_back();
+
+            const Node &node = _nodes[entry.node];
+
+            u32 mask = entry.plane_mask;
+            bool outside = false;
+            for (u32 p = 0; p != planes.size() && !outside; ++p)
+            {
+                if (mask & (1 << p))
+                {
+                    const PlaneSide side = classify(node.bounds, planes[p]);
+                    outside = side == PlaneSide::Outside;
+                    if (side == PlaneSide::Inside)
+                    {
+                        mask &= ~(1 << p);
+                    }
+                }
+            }
+
+            if (outside)
+            {
+                continue;
+            }
+
+            if (!mask)
+            {
+                append_range(node, visible);
+            }
+            else if (!node.is_leaf())
+            {
+                stack.push_back(Entry{ node.left, mask });
+                stack.push_back(Entry{ node.left + 1, mask });
+            }
+            else
+            {
+                for (u32 i = node.first; i != node.first + node.count; ++i)
+                {
+                    const u32 index = _indices[i];
+                    bool inside = true;
+                    for (u32 p = 0; p != planes.size() && inside; ++p)
+                    {
+                        inside = !(mask & (1 << p))
+                              || classify(_boxes[index], planes[p])
+                                     != PlaneSide::Outside;
+                    }
+                    if (inside)
+                    {
+                        visible.push_back(index);
+                    }
+                }
+            }
+        }
+    }
+
+    void BVH::query(const AABB &box, std::vector<u32> &result) const
+    {
+        if (_nodes.empty())
+        {
+            return;
+        }
+
+        std::vector<u32> stack = { 0 };
+        while (!stack.empty())
+        {
+            const Node &node = _nodes[stack.back()];
+            stack.pop_back();
+
+            if (!node.bounds.overlaps(box))
+            {
+                continue;
+            }
+
+            if (!node.is_leaf())
+            {
+                stack.push_back(node.left);
+                stack.push_back(node.left + 1);
+            }
+            else
+            {
+                for (u32 i = node.first; i != node.first + node.count; ++i)
+                {
+                    if (_boxes[_indices[i]].overlaps(box))
+                    {
+                        result.push_back(_indices[i]);
+                    }
+                }
+            }
+        }
+    }
+
+    Result<RayHit> BVH::raycast(const Ray &ray) const
+    {
+        RayHit closest;
+        closest.distance = ray.max_distance;
+        bool hit = false;
+
+        if (_nodes.empty())
+        {
+            return { false, closest };
+        }
+
+        const glm::vec3 inv_dir = 1.0f / ray.direction;
+
+        struct Entry
+        {
+            u32 node;
+            float distance;
+        };
+
+        std::vector<Entry> stack;
+        {
+            const float distance = intersect(_nodes[0].bounds, ray.origin,
+                                             inv_dir, closest.distance);
+            if (distance < std::numeric_limits<float>::infinity())
+            {
+                stack.push_back(Entry{ 0, distance });
+            }
+        }
+
+        while (!stack.empty())
+        {
+            const Entry entry = stack.back();
+            stack.pop_back();
+
+            // A closer hit was found since this node was pushed
+            if (entry.distance > closest.distance)
+            {
+                continue;
+            }
+
+            const Node &node = _nodes[entry.node];
+            if (node.is_leaf())
+            {
+                for (u32 i = node.first; i != node.first + node.count; ++i)
+                {
+                    const u32 index = _indices[i];
+                    const float distance = intersect(_boxes[index], ray.origin,
+                                                     inv_dir, closest.distance);
+                    if (distance < std::numeric_limits<float>::infinity()
+                        && distance <= closest.distance)
+                    {
+                        closest = RayHit{ index, distance };
+                        hit = true;
+                    }
+                }
+                continue;
+            }
+
+            Entry children[] = {
+                Entry{ node.left,
+                       intersect(_nodes[node.left].bounds, ray.origin,
+                                 inv_dir, closest.distance) },
+                Entry{ node.left + 1,
+                       intersect(_nodes[node.left + 1].bounds, ray.origin,
+                                 inv_dir, closest.distance) },
+            };
+
+            // Push the closest child last so it is visited first
+            if (children[0].distance < children[1].distance)
+            {
+                std::swap(children[0], children[1]);
+            }
+            for (const Entry &child : children)
+            {
+                if (child.distance < std::numeric_limits<float>::infinity())
+                {
+                    stack.push_back(child);
+                }
+            }
+        }
+
+        return { hit, closest };
+    }
+
+} // namespace OM3D
@@ -0,0 +1,78 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <Bounds.h>
+#include <Camera.h>
+
+#include <vector>
+
+namespace OM3D
+{
+
+    struct Ray
+    {
+        glm::vec3 origin;
+        glm::vec3 direction;
+        float max_distance = std::numeric_limits<float>::infinity();
+    };
+
+    struct RayHit
+    {
+        u32 index = 0;
+        float distance = 0.0f;
+    };
+
+    // Bounding volume hierarchy over a set of boxes, built top-down with a
+    // binned surface area heuristic. Queries return indices in the span
+    // given to build().
+    class BVH
+    {
+    public:
+        BVH() = default;
+
+        void build(Span<const AABB> boxes);
+
+        // Updates the node bounds after the boxes moved, without changing
+        // the tree topology. The box count must not change.
+        void refit(Span<const AABB> boxes);
+
+        size_t size() const;
+        size_t node_count() const;
+        AABB bounds() const;
+
+        // Appends the indices of the boxes intersecting the frustum, subtrees
+        // fully inside it are accepted without testing their boxes
+        void cull(const FrustumPlanes &planes, std::vector<u32> &visible) const;
+
+        // Appends the indices of the boxes overlapping box
+        void query(const AABB &box, std::vector<u32> &result) const;
+
+        // Closest box hit by the ray
+        Result<RayHit> raycast(const Ray &ray) const;
+
+    private:
+        // Leaves have no children, internal nodes have their two children at
+        // left and left + 1. Every node covers a contiguous index range.
+        struct Node
+        {
+            AABB bounds;
+            u32 first = 0;
+            u32 count = 0;
+            u32 left = 0;
+
+            bool is_leaf() const
+            {
+                return !left;
+            }
+        };
+
+        void append_range(const Node &node, std::vector<u32> &result) const;
+
+        std::vector<Node> _nodes;
+        std::vector<u32> _indices;
+        std::vector<AABB> _boxes;
+    };
+
+} // namespace OM3D
+
+#endif // BVH_H
@@ -0,0 +1,220 @@
+#include "Bounds.h"
+
+#include <ThreadPool.h>
+
+#include <glm/gtx/norm.hpp>
+
+#include <cmath>
+#include <iterator>
+
+namespace OM3D
+{
+
+    static constexpr size_t parallel_threshold = 64 * 1024;
+    static constexpr size_t chunk_size = 16 * 1024;
+
+    // Directions sampled to find extremal points, as in EPOS-26
+    static const glm::vec3 directions[] = {
+        { 1.0f, 0.0f, 0.0f },  { 0.0f, 1.0f, 0.0f },  { 0.0f, 0.0f, 1.0f },
+        { 1.0f, 1.0f, 1.0f },  { 1.0f, 1.0f, -1.0f }, { 1.0f, -1.0f, 1.0f },
+        { 1.0f, -1.0f, -1.0f }, { 1.0f, 1.0f, 0.0f }, { 1.0f, -1.0f, 0.0f },
+        { 1.0f, 0.0f, 1.0f },  { 1.0f, 0.0f, -1.0f }, { 0.0f, 1.0f, 1.0f },
+        { 0.0f, 1.0f, -1.0f },
+    };
+
+    static constexpr size_t direction_count = std::size(directions);
+
+    struct Extremes
+    {
+        AABB aabb;
+        float min_dist[direction_count];
+        float max_dist[direction_count];
+        glm::vec3 min_point[direction_count];
+        glm::vec3 max_point[direction_count];
+
+        Extremes()
+        {
+            for (size_t i = 0; i != direction_count; ++i)
+            {
+                min_dist[i] = std::numeric_limits<float>::max();
+                max_dist[i] = -std::numeric_limits<float>::max();
+            }
+        }
+
+        void add(const glm::vec3 &point)
+        {
+            aabb.extend(point);
+            for (size_t i = 0; i != direction_count; ++i)
+            {
+                const float dist = glm::dot(point, directions[i]);
+                if (dist < min_dist[i])
+                {
+                    min_dist[i] = dist;
+                    min_point[i] = point;
+                }
+                if (dist > max_dist[i])
+                {
+                    max_dist[i] = dist;
+                    max_point[i] = point;
+                }
+            }
+        }
+
+        void merge(const Extremes &other)
+        {
+            aabb.extend(other.aabb);
+            for (size_t i = 0; i != direction_count; ++i)
+            {
+                if (other.min_dist[i] < min_dist[i])
+                {
+                    min_dist[i] = other.min_dist[i];
+                    min_point[i] = other.min_point[i];
+                }
+                if (other.max_dist[i] > max_dist[i])
+                {
+                    max_dist[i] = other.max_dist[i];
+                    max_point[i] = other.max_point[i];
+                }
+            }
+        }
+    };
+
+    // Calls func(begin, end) over chunks of [0; count), in parallel for large
+    // counts, and merges the results
+    template <typename T, typename F>
+    static T reduce_chunks(size_t count, F &&func)
+    {
+        if (count < parallel_threshold)
+        {
+            return func(size_t(0), count);
+        }
+
+        std::vector<T> results((count + chunk_size - 1) / chunk_size);
+        ThreadPool::global().parallel_for(results.size(), [&](size_t i) {
+            results[i] =
+                func(i * chunk_size, std::min((i + 1) * chunk_size, count));
+        });
+
+        T result = results[0];
+        for (size_t i = 1; i != results.size(); ++i)
+        {
+            result.merge(results[i]);
+        }
+        return result;
+    }
+
+    struct MaxDistance
+    {
+        float dist2 = 0.0f;
+
+        void merge(const MaxDistance &other)
+        {
+            dist2 = std::max(dist2, other.dist2);
+        }
+    };
+
+    template <typename F>
+    static float max_distance(size_t count, const glm::vec3 &center,
+                              F &&position)
+    {
+        const MaxDistance max_dist =
+            reduce_chunks<MaxDistance>(count, [&](size_t begin, size_t end) {
+                MaxDistance result;
+                for (size_t i = begin; i != end; ++i)
+                {
+                    result.dist2 = std::max(
+                        result.dist2, glm::distance2(position(i), center));
+                }
+                return result;
+            });
+        return std::sqrt(max_dist.dist2);
+    }
+
+    template <typename F>
+    static MeshBounds compute_bounds(size_t count, F &&position)
+    {
+        MeshBounds bounds;
+        if (!count)
+        {
+            return bounds;
+        }
+
+        const Extremes extremes =
+            reduce_chunks<Extremes>(count, [&](size_t begin, size_t end) {
+                Extremes result;
+                for (size_t i = begin; i != end; ++i)
+                {
+                    result.add(position(i));
+                }
+                return result;
+            });
+        bounds.aabb = extremes.aabb;
+
+        // Ritter's sphere, seeded with the most distant pair of extremal
+        // points
+        BoundingSphere sphere;
+        {
+            size_t best = 0;
+            float best_dist2 = -1.0f;
+            for (size_t i = 0; i != direction_count; ++i)
+            {
+                const float dist2 = glm::distance2(extremes.min_point[i],
+                                                   extremes.max_point[i]);
+                if (dist2 > best_dist2)
+                {
+                    best_dist2 = dist2;
+                    best = i;
+                }
+            }
+
+            sphere.center =
+                (extremes.min_point[best] + extremes.max_point[best]) * 0.5f;
+            sphere.radius = std::sqrt(best_dist2) * 0.5f;
+        }
+
+        // Grow the sphere just enough to contain each point outside of it
+        for (size_t i = 0; i != count; ++i)
+        {
+            const glm::vec3 point = position(i);
+            const float dist2 = glm::distance2(point, sphere.center);
+            if (dist2 > sphere.radius * sphere.radius)
+            {
+                const float dist = std::sqrt(dist2);
+                const float radius = (sphere.radius + dist) * 0.5f;
+                sphere.center += (point - sphere.center)
+                               * ((radius - sphere.radius) / dist);
+                sphere.radius = radius;
+            }
+        }
+
+        // Recompute the radius exactly to absorb rounding errors, and keep
+        // the box centered sphere when it is tighter (e.g. for boxy meshes)
+        sphere.radius = max_distance(count, sphere.center, position);
+
+        const glm::vec3 box_center = bounds.aabb.center();
+        const float box_radius = max_distance(count, box_center, position);
+        if (box_radius < sphere.radius)
+        {
+            sphere = BoundingSphere{ box_center, box_radius };
+        }
+
+        bounds.sphere = sphere;
+        return bounds;
+    }
+
+    MeshBounds compute_bounds(Span<const Vertex> vertices)
+    {
+        return compute_bounds(vertices.size(), [&](size_t i) {
+            return vertices[i].position;
+        });
+    }
+
+    MeshBounds compute_bounds(Span<const Vertex> vertices,
+                              Span<const u32> indices)
+    {
+        return compute_bounds(indices.size(), [&](size_t i) {
+            return vertices[indices[i]].position;
+        });
+    }
+
+} // namespace OM3D
@@ -0,0 +1,111 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <Vertex.h>
+#include <glm/common.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <utils.h>
+
+#include <limits>
+
+namespace OM3D
+{
+
+    // Axis aligned bounding box, empty boxes have min > max
+    struct AABB
+    {
+        glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+        static AABB from_sphere(const glm::vec3 &center, float radius)
+        {
+            return AABB{ center - radius, center + radius };
+        }
+
+        void extend(const glm::vec3 &point)
+        {
+            min = glm::min(min, point);
+            max = glm::max(max, point);
+        }
+
+        void extend(const AABB &other)
+        {
+            min = glm::min(min, other.min);
+            max = glm::max(max, other.max);
+        }
+
+        bool is_empty() const
+        {
+            return min.x > max.x || min.y > max.y || min.z > max.z;
+        }
+
+        bool overlaps(const AABB &other) const
+        {
+            return min.x <= other.max.x && max.x >= other.min.x
+                && min.y <= other.max.y && max.y >= other.min.y
+                && min.z <= other.max.z && max.z >= other.min.z;
+        }
+
+        glm::vec3 center() const
+        {
+            return (min + max) * 0.5f;
+        }
+
+        glm::vec3 extent() const
+        {
+            return max - min;
+        }
+
+        float surface_area() const
+        {
+            if (is_empty())
+            {
+                return 0.0f;
+            }
+            const glm::vec3 e = extent();
+            return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+        }
+
+        // Box enclosing this box once transformed
+        AABB transformed(const glm::mat4 &transform) const
+        {
+            if (is_empty())
+            {
+                return *this;
+            }
+
+            const glm::vec3 c =
+                glm::vec3(transform * glm::vec4(center(), 1.0f));
+            const glm::vec3 e = extent() * 0.5f;
+            const glm::vec3 new_e =
+                glm::abs(glm::vec3(transform[0])) * e.x
+                + glm::abs(glm::vec3(transform[1])) * e.y
+                + glm::abs(glm::vec3(transform[2])) * e.z;
+            return AABB{ c - new_e, c + new_e };
+        }
+    };
+
+    struct BoundingSphere
+    {
+        glm::vec3 center = glm::vec3(0.0f);
+        float radius = 0.0f;
+    };
+
+    struct MeshBounds
+    {
+        AABB aabb;
+        BoundingSphere sphere;
+    };
+
+    // Tight box and bounding sphere containing every vertex. Large meshes are
+    // processed on the global thread pool.
+    MeshBounds compute_bounds(Span<const Vertex> vertices);
+
+    // Bounds of the vertices referenced by indices, e.g. a meshlet
+    MeshBounds compute_bounds(Span<const Vertex> vertices,
+                              Span<const u32> indices);
+
+} // namespace OM3D
+
+#endif // BOUNDS_H
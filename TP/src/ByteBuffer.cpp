@@ -47,6 +47,19 @@ namespace OM3D
         return _size;
     }
 
+    void ByteBuffer::copy_to(ByteBuffer &dst, size_t dst_offset) const
+    {
+        DEBUG_ASSERT(dst_offset + _size <= dst._size);
+        glCopyNamedBufferSubData(_handle.get(), dst._handle.get(), 0,
+                                 dst_offset, _size);
+    }
+
+    void ByteBuffer::read(size_t offset, size_t size, void *data) const
+    {
+        DEBUG_ASSERT(offset + size <= _size);
+        glGetNamedBufferSubData(_handle.get(), offset, size, data);
+    }
+
     BufferMapping<byte> ByteBuffer::map_bytes(AccessType access)
     {
         return BufferMapping<byte>(map_internal(access), byte_size(), handle());
@@ -55,6 +68,7 @@ namespace OM3D
     void *ByteBuffer::map_internal(AccessType access)
     {
         DEBUG_ASSERT(_handle.is_valid() && _size);
+        PROFILE_ZONE("ByteBuffer::map");
         return glMapNamedBuffer(_handle.get(), access_type_to_gl(access));
     }
 
@@ -22,6 +22,11 @@ namespace OM3D
 
         size_t byte_size() const;
 
+        void copy_to(ByteBuffer &dst, size_t dst_offset = 0) const;
+
+        // Reads back size bytes from offset, waits for the GPU
+        void read(size_t offset, size_t size, void *data) const;
+
         BufferMapping<byte>
         map_bytes(AccessType access = AccessType::ReadWrite);
 
@@ -0,0 +1,184 @@
+#include "CPUProfiler.h"
+
+#include <chrono>
+#include <fstream>
+
+namespace OM3D
+{
+
+    static const auto profiler_start_time = std::chrono::steady_clock::now();
+
+    double CPUZone::duration_ms() const
+    {
+        return double(end - begin) / 1.0e6;
+    }
+
+    void CPUProfiler::ThreadBuffer::push(const CPUZone &zone)
+    {
+        // Only allocated once the thread records something, readers do not
+        // touch it before count is set
+        if (!slots)
+        {
+            slots = std::make_unique<Slot[]>(thread_capacity);
+        }
+
+        const u64 index = count.load(std::memory_order_relaxed);
+        Slot &slot = slots[index % thread_capacity];
+        slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        slot.name.store(zone.name, std::memory_order_relaxed);
+        slot.depth.store(zone.depth, std::memory_order_relaxed);
+        slot.begin.store(zone.begin, std::memory_order_relaxed);
+        slot.end.store(zone.end, std::memory_order_relaxed);
+
+        slot.sequence.store(2 * index + 2, std::memory_order_release);
+        count.store(index + 1, std::memory_order_release);
+    }
+
+    CPUProfiler &CPUProfiler::global()
+    {
+        static CPUProfiler profiler;
+        return profiler;
+    }
+
+    u64 CPUProfiler::time()
+    {
+        return u64(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now() - profiler_start_time)
+                       .count());
+    }
+
+    void CPUProfiler::set_enabled(bool enabled)
+    {
+        _enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    bool CPUProfiler::is_enabled() const
+    {
+        return _enabled.load(std::memory_order_relaxed);
+    }
+
+    void CPUProfiler::set_thread_name(std::string name)
+    {
+        ThreadBuffer &buffer = thread_buffer();
+        std::unique_lock lock(_lock);
+        buffer.name = std::move(name);
+    }
+
+    std::vector<CPUThreadZones> CPUProfiler::snapshot() const
+    {
+        std::unique_lock lock(_lock);
+
+        std::vector<CPUThreadZones> threads;
+        for (const auto &buffer : _threads)
+        {
+            CPUThreadZones &thread = threads.emplace_back();
+            thread.thread_index = buffer->index;
+            thread.name = buffer->name;
+
+            const u64 end = buffer->count.load(std::memory_order_acquire);
+            const u64 begin = end > thread_capacity ? end - thread_capacity : 0;
+            thread.zones.reserve(end - begin);
+            for (u64 i = begin; i != end; ++i)
+            {
+                const ThreadBuffer::Slot &slot =
+                    buffer->slots[i % thread_capacity];
+                const u64 sequence =
+                    slot.sequence.load(std::memory_order_acquire);
+
+                CPUZone zone;
+                zone.name = slot.name.load(std::memory_order_relaxed);
+                zone.depth = slot.depth.load(std::memory_order_relaxed);
+                zone.begin = slot.begin.load(std::memory_order_relaxed);
+                zone.end = slot.end.load(std::memory_order_relaxed);
+
+                // Skip zones replaced while copying, or being replaced
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (sequence != 2 * i + 2
+                    || slot.sequence.load(std::memory_order_relaxed)
+                        != sequence)
+                {
+                    continue;
+                }
+                thread.zones.push_back(zone);
+            }
+        }
+        return threads;
+    }
+
+    Result<void> CPUProfiler::write_chrome_trace(
+        const std::string &file_name) const
+    {
+        const std::vector<CPUThreadZones> threads = snapshot();
+
+        std::ofstream out(file_name);
+        if (!out)
+        {
+            return { false };
+        }
+
+        out << "{\"traceEvents\":[";
+        const char *separator = "\n";
+        for (const CPUThreadZones &thread : threads)
+        {
+            out << separator
+                << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":"
+                << thread.thread_index << ",\"args\":{\"name\":\""
+                << thread.name << "\"}}";
+            separator = ",\n";
+
+            // Timestamps are in microseconds
+            for (const CPUZone &zone : thread.zones)
+            {
+                out << separator << "{\"name\":\"" << zone.name
+                    << "\",\"ph\":\"X\",\"pid\":0,\"tid\":"
+                    << thread.thread_index
+                    << ",\"ts\":" << double(zone.begin) / 1.0e3
+                    << ",\"dur\":" << double(zone.end - zone.begin) / 1.0e3
+                    << "}";
+            }
+        }
+        out << "\n]}\n";
+
+        return { bool(out) };
+    }
+
+    CPUProfiler::ThreadBuffer &CPUProfiler::thread_buffer()
+    {
+        // Buffers are never freed, so zones of finished threads stay around
+        thread_local ThreadBuffer *buffer = nullptr;
+        if (!buffer)
+        {
+            std::unique_lock lock(_lock);
+            auto &thread = _threads.emplace_back(
+                std::make_unique<ThreadBuffer>());
+            thread->index = u32(_threads.size() - 1);
+            thread->name = "Thread " + std::to_string(thread->index);
+            buffer = thread.get();
+        }
+        return *buffer;
+    }
+
+    u64 begin_profile_zone()
+    {
+        CPUProfiler &profiler = CPUProfiler::global();
+        if (!profiler.is_enabled())
+        {
+            return no_profile_zone;
+        }
+
+        ++profiler.thread_buffer().depth;
+        return CPUProfiler::time();
+    }
+
+    void end_profile_zone(const char *name, u64 begin)
+    {
+        const u64 end = CPUProfiler::time();
+        CPUProfiler::ThreadBuffer &buffer =
+            CPUProfiler::global().thread_buffer();
+        --buffer.depth;
+        buffer.push(CPUZone{ name, buffer.depth, begin, end });
+    }
+
+} // namespace OM3D
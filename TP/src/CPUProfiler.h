@@ -0,0 +1,104 @@
+#ifndef CPUPROFILER_H
+#define CPUPROFILER_H
+
+#include <utils.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace OM3D
+{
+
+    // Zone of a thread, in nanoseconds since the program started
+    struct CPUZone
+    {
+        const char *name = nullptr;
+        u32 depth = 0;
+        u64 begin = 0;
+        u64 end = 0;
+
+        double duration_ms() const;
+    };
+
+    struct CPUThreadZones
+    {
+        u32 thread_index = 0;
+        std::string name;
+
+        // In end order
+        std::vector<CPUZone> zones;
+    };
+
+    // Records the zones of PROFILE_ZONE. Every thread writes to its own ring
+    // of thread_capacity zones without locking, and readers copy them while
+    // they are being written, dropping the ones that got overwritten. The
+    // oldest zones of a thread are lost once its ring is full.
+    class CPUProfiler : NonMovable
+    {
+    public:
+        static constexpr size_t thread_capacity = 64 * 1024;
+
+        // Profiler shared by the whole application
+        static CPUProfiler &global();
+
+        // Nanoseconds since the program started
+        static u64 time();
+
+        void set_enabled(bool enabled);
+        bool is_enabled() const;
+
+        // Names the calling thread in traces
+        void set_thread_name(std::string name);
+
+        // Zones still in the ring of every thread
+        std::vector<CPUThreadZones> snapshot() const;
+
+        // Chrome trace event format, also read by Perfetto
+        Result<void> write_chrome_trace(const std::string &file_name) const;
+
+    private:
+        friend u64 begin_profile_zone();
+        friend void end_profile_zone(const char *name, u64 begin);
+
+        struct ThreadBuffer
+        {
+            u32 index = 0;
+            std::string name;
+
+            // Only used by the owning thread
+            u32 depth = 0;
+
+            // Seqlock per slot: sequence is odd while the slot is written,
+            // and 2 * (zone index + 1) once zone index is stored
+            struct Slot
+            {
+                std::atomic<u64> sequence = 0;
+                std::atomic<const char *> name = nullptr;
+                std::atomic<u32> depth = 0;
+                std::atomic<u64> begin = 0;
+                std::atomic<u64> end = 0;
+            };
+
+            std::unique_ptr<Slot[]> slots;
+            std::atomic<u64> count = 0;
+
+            void push(const CPUZone &zone);
+        };
+
+        CPUProfiler() = default;
+
+        ThreadBuffer &thread_buffer();
+
+        std::atomic<bool> _enabled = false;
+
+        // Only taken when a thread records its first zone, and by readers
+        mutable std::mutex _lock;
+        std::vector<std::unique_ptr<ThreadBuffer>> _threads;
+    };
+
+} // namespace OM3D
+
+#endif // CPUPROFILER_H
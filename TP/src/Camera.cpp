@@ -125,4 +125,30 @@ namespace OM3D
         return frustum;
     }
 
+    FrustumPlanes Camera::build_frustum_planes() const
+    {
+        const Frustum frustum = build_frustum();
+        const glm::vec3 normals[] = { frustum._near_normal, frustum._top_normal,
+                                      frustum._bottom_normal,
+                                      frustum._right_normal,
+                                      frustum._left_normal };
+
+        // All planes go through the camera position
+        const glm::vec3 pos = position();
+        FrustumPlanes planes;
+        for (size_t i = 0; i != planes.size(); ++i)
+        {
+            planes[i] = glm::vec4(normals[i], -glm::dot(normals[i], pos));
+        }
+        return planes;
+    }
+
+    glm::vec3 Camera::ray_direction(const glm::vec2 &ndc) const
+    {
+        const float tan_half_fov = std::tan(_fov_y * 0.5f);
+        return glm::normalize(forward()
+                              + right() * (ndc.x * tan_half_fov * _aspect_ratio)
+                              + up() * (ndc.y * tan_half_fov));
+    }
+
 } // namespace OM3D
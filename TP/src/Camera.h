@@ -18,6 +18,10 @@ namespace OM3D
 
     };
 
+    // Frustum planes as (normal, distance), a point p is inside when
+    // dot(normal, p) + distance >= 0 for every plane
+    using FrustumPlanes = std::array<glm::vec4, 5>;
+
     class Camera
     {
     public:
@@ -36,6 +40,11 @@ namespace OM3D
         const glm::mat4 &view_proj_matrix() const;
 
         Frustum build_frustum() const;
+        FrustumPlanes build_frustum_planes() const;
+
+        // Direction of the ray going through a point in normalized device
+        // coordinates ([-1; 1] with y up)
+        glm::vec3 ray_direction(const glm::vec2 &ndc) const;
 
     private:
         void update();
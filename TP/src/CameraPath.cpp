@@ -0,0 +1,160 @@
+#include "CameraPath.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+namespace OM3D
+{
+
+    static glm::vec3 catmull_rom(const glm::vec3 &p0, const glm::vec3 &p1,
+                                 const glm::vec3 &p2, const glm::vec3 &p3,
+                                 float t)
+    {
+        const float t2 = t * t;
+        const float t3 = t2 * t;
+        return 0.5f
+            * (2.0f * p1 + (p2 - p0) * t
+               + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2
+               + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+    }
+
+    Result<CameraPath> CameraPath::from_file(const std::string &file_name)
+    {
+        std::ifstream in(file_name);
+        if (!in)
+        {
+            return { false, {} };
+        }
+
+        CameraPath path;
+        std::string line;
+        while (std::getline(in, line))
+        {
+            if (line.empty() || line[0] == '#')
+            {
+                continue;
+            }
+
+            std::istringstream stream(line);
+            CameraKey key;
+            stream >> key.position.x >> key.position.y >> key.position.z
+                >> key.target.x >> key.target.y >> key.target.z;
+            if (!stream)
+            {
+                return { false, {} };
+            }
+            path.add_key(key);
+        }
+
+        if (path.is_empty())
+        {
+            return { false, {} };
+        }
+        return { true, std::move(path) };
+    }
+
+    CameraPath CameraPath::orbit(const AABB &bounds, u32 key_count)
+    {
+        const glm::vec3 center = bounds.is_empty()
+            ? glm::vec3(0.0f)
+            : (bounds.min + bounds.max) * 0.5f;
+        const float radius = bounds.is_empty()
+            ? 4.0f
+            : std::max(glm::length(bounds.max - bounds.min) * 0.5f, 1.0f);
+
+        CameraPath path;
+        for (u32 i = 0; i != key_count; ++i)
+        {
+            const float angle = to_rad(360.0f) * float(i) / float(key_count);
+            const glm::vec3 offset(std::cos(angle), 0.5f, std::sin(angle));
+            path.add_key({ center + offset * radius, center });
+        }
+        path.set_closed(true);
+        return path;
+    }
+
+    Result<void> CameraPath::write(const std::string &file_name) const
+    {
+        std::ofstream out(file_name);
+        if (!out)
+        {
+            return { false };
+        }
+
+        out << "# position target\n";
+        for (const CameraKey &key : _keys)
+        {
+            out << key.position.x << " " << key.position.y << " "
+                << key.position.z << " " << key.target.x << " "
+                << key.target.y << " " << key.target.z << "\n";
+        }
+        return { bool(out) };
+    }
+
+    void CameraPath::add_key(const CameraKey &key)
+    {
+        _keys.push_back(key);
+    }
+
+    void CameraPath::set_closed(bool closed)
+    {
+        _closed = closed;
+    }
+
+    size_t CameraPath::key_count() const
+    {
+        return _keys.size();
+    }
+
+    bool CameraPath::is_empty() const
+    {
+        return _keys.empty();
+    }
+
+    CameraKey CameraPath::evaluate(float t) const
+    {
+        DEBUG_ASSERT(!_keys.empty());
+
+        const size_t count = _keys.size();
+        const size_t segments = _closed ? count : count - 1;
+        if (!segments)
+        {
+            return _keys[0];
+        }
+
+        const float position = std::clamp(t, 0.0f, 1.0f) * float(segments);
+        const size_t segment = std::min(size_t(position), segments - 1);
+        const float local = position - float(segment);
+
+        // Open paths repeat their end keys
+        auto key = [&](size_t index, i64 offset) -> const CameraKey & {
+            const i64 i = i64(index) + offset;
+            if (_closed)
+            {
+                return _keys[size_t((i + i64(count)) % i64(count))];
+            }
+            return _keys[size_t(std::clamp(i, i64(0), i64(count - 1)))];
+        };
+
+        const CameraKey &k0 = key(segment, -1);
+        const CameraKey &k1 = key(segment, 0);
+        const CameraKey &k2 = key(segment, 1);
+        const CameraKey &k3 = key(segment, 2);
+        return { catmull_rom(k0.position, k1.position, k2.position,
+                             k3.position, local),
+                 catmull_rom(k0.target, k1.target, k2.target, k3.target,
+                             local) };
+    }
+
+    glm::mat4 CameraPath::view_matrix(float t) const
+    {
+        const CameraKey key = evaluate(t);
+        return glm::lookAt(key.position, key.target,
+                           glm::vec3(0.0f, 1.0f, 0.0f));
+    }
+
+} // namespace OM3D
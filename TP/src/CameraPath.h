@@ -0,0 +1,53 @@
+#ifndef CAMERAPATH_H
+#define CAMERAPATH_H
+
+#include <Bounds.h>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+#include <string>
+#include <vector>
+
+namespace OM3D
+{
+
+    struct CameraKey
+    {
+        glm::vec3 position = {};
+        glm::vec3 target = {};
+    };
+
+    // Catmull-Rom spline through camera keys, going back to the first one at
+    // the end when closed. Stored as text, one "px py pz tx ty tz" key per
+    // line.
+    class CameraPath
+    {
+    public:
+        CameraPath() = default;
+
+        static Result<CameraPath> from_file(const std::string &file_name);
+
+        // Circle around the bounds, looking at their center
+        static CameraPath orbit(const AABB &bounds, u32 key_count = 8);
+
+        Result<void> write(const std::string &file_name) const;
+
+        void add_key(const CameraKey &key);
+        void set_closed(bool closed);
+
+        size_t key_count() const;
+        bool is_empty() const;
+
+        // t goes from 0 to 1 over the whole path
+        CameraKey evaluate(float t) const;
+        glm::mat4 view_matrix(float t) const;
+
+    private:
+        std::vector<CameraKey> _keys;
+        bool _closed = false;
+    };
+
+} // namespace OM3D
+
+#endif // CAMERAPATH_H
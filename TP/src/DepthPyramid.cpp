@@ -0,0 +1,81 @@
+#include "DepthPyramid.h"
+
+#include <glad/glad.h>
+
+namespace OM3D
+{
+
+    static glm::uvec2 level_size(const glm::uvec2 &size, u32 level)
+    {
+        return glm::max(glm::uvec2(size.x >> level, size.y >> level),
+                        glm::uvec2(1));
+    }
+
+    DepthPyramid::DepthPyramid()
+        : _program(Program::from_file_async("depth_pyramid.comp"))
+    {}
+
+    DepthPyramid::DepthPyramid(const glm::uvec2 &depth_size)
+        : DepthPyramid()
+    {
+        _depth_size = depth_size;
+        const glm::uvec2 size = level_size(depth_size, 1);
+        _texture = std::make_unique<Texture>(size, ImageFormat::R32_FLOAT,
+                                             Texture::mip_levels(size));
+    }
+
+    bool DepthPyramid::is_ready() const
+    {
+        return _program->is_ready();
+    }
+
+    void DepthPyramid::wait() const
+    {
+        _program->wait();
+    }
+
+    void DepthPyramid::build(const Texture &depth) const
+    {
+        DEBUG_ASSERT(depth.size() == _depth_size);
+
+        _program->bind();
+        for (u32 level = 0; level != _texture->mip_count(); ++level)
+        {
+            // Level 0 reduces the depth buffer, the others the level below
+            if (level)
+            {
+                _texture->bind(0);
+                _program->set_uniform(HASH("src_level"), level - 1);
+            }
+            else
+            {
+                depth.bind(0);
+                _program->set_uniform(HASH("src_level"), 0u);
+            }
+            _texture->bind_as_image(1, AccessType::WriteOnly, level);
+
+            const glm::uvec2 size = level_size(_depth_size, level + 1);
+            glDispatchCompute(align_up_to(size.x, 8) / 8,
+                              align_up_to(size.y, 8) / 8, 1);
+
+            glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT
+                            | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        }
+    }
+
+    void DepthPyramid::bind(u32 index) const
+    {
+        _texture->bind(index);
+    }
+
+    const glm::uvec2 &DepthPyramid::depth_size() const
+    {
+        return _depth_size;
+    }
+
+    u32 DepthPyramid::mip_count() const
+    {
+        return _texture ? _texture->mip_count() : 0;
+    }
+
+} // namespace OM3D
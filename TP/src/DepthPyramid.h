@@ -0,0 +1,50 @@
+#ifndef DEPTHPYRAMID_H
+#define DEPTHPYRAMID_H
+
+#include <Program.h>
+#include <Texture.h>
+
+#include <memory>
+
+namespace OM3D
+{
+
+    // Hierarchical depth buffer (Hi-Z). Every texel holds the farthest depth
+    // (the minimum, with reverse-Z) of the texels it covers in the level
+    // below. Level 0 is half the resolution of the depth buffer, and the full
+    // resolution pixel p is covered by texel min(p >> (level + 1), size - 1)
+    // of every level, odd sizes included.
+    class DepthPyramid : NonCopyable
+    {
+    public:
+        // Both request the program, built in the background. The default
+        // one has no texture and can not be built.
+        DepthPyramid();
+        DepthPyramid(const glm::uvec2 &depth_size);
+
+        DepthPyramid(DepthPyramid &&) = default;
+        DepthPyramid &operator=(DepthPyramid &&) = default;
+
+        // False until the program is built, the pyramid must not be built
+        // before
+        bool is_ready() const;
+        void wait() const;
+
+        // depth must have the size given at construction
+        void build(const Texture &depth) const;
+
+        void bind(u32 index) const;
+
+        // Size of the depth buffer it is built from
+        const glm::uvec2 &depth_size() const;
+        u32 mip_count() const;
+
+    private:
+        std::unique_ptr<Texture> _texture;
+        std::shared_ptr<Program> _program;
+        glm::uvec2 _depth_size = {};
+    };
+
+} // namespace OM3D
+
+#endif // DEPTHPYRAMID_H
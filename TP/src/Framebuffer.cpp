@@ -3,6 +3,8 @@
 #include <glad/glad.h>
 #include <glm/vec4.hpp>
 
+#include <vector>
+
 namespace OM3D
 {
 
@@ -30,15 +32,24 @@ namespace OM3D
             _size = depth->size();
         }
 
+        std::vector<GLenum> draw_buffers;
         for (size_t i = 0; i != count; ++i)
         {
             DEBUG_ASSERT(colors[i]);
-            glNamedFramebufferTexture(_handle.get(),
-                                      GLenum(GL_COLOR_ATTACHMENT0 + i),
+            draw_buffers.push_back(GLenum(GL_COLOR_ATTACHMENT0 + i));
+            glNamedFramebufferTexture(_handle.get(), draw_buffers.back(),
                                       colors[i]->_handle.get(), 0);
             _size = colors[i]->size();
         }
 
+        // Only the first attachment is drawn to by default
+        if (count > 1)
+        {
+            glNamedFramebufferDrawBuffers(_handle.get(),
+                                          GLsizei(draw_buffers.size()),
+                                          draw_buffers.data());
+        }
+
         ALWAYS_ASSERT(
             glCheckNamedFramebufferStatus(_handle.get(), GL_FRAMEBUFFER)
                 == GL_FRAMEBUFFER_COMPLETE,
@@ -0,0 +1,275 @@
+#include "FrustumCuller.h"
+
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#    define OM3D_CULLING_X86
+#    include <immintrin.h>
+#    ifdef _MSC_VER
+#        include <intrin.h>
+#    endif
+#endif
+
+#if defined(OM3D_CULLING_X86) && (defined(__GNUC__) || defined(__clang__))
+#    define AVX_TARGET __attribute__((target("avx")))
+#else
+#    define AVX_TARGET
+#endif
+
+namespace OM3D
+{
+
+    static constexpr size_t simd_width = 8;
+
+    static bool cpu_has_avx()
+    {
+#if defined(OM3D_CULLING_X86) && defined(_MSC_VER)
+        int info[4] = {};
+        __cpuid(info, 1);
+        const bool os_saves_ymm = (info[2] & (1 << 27)) != 0;
+        const bool avx = (info[2] & (1 << 28)) != 0;
+        return os_saves_ymm && avx && (_xgetbv(0) & 0x6) == 0x6;
+#elif defined(OM3D_CULLING_X86)
+        return __builtin_cpu_supports("avx");
+#else
+        return false;
+#endif
+    }
+
+    void FrustumCuller::resize(size_t count)
+    {
+        _size = count;
+
+        const size_t padded =
+            (count + simd_width - 1) / simd_width * simd_width;
+        _x.resize(padded);
+        _y.resize(padded);
+        _z.resize(padded);
+        _radius.resize(padded);
+
+        for (size_t i = count; i != padded; ++i)
+        {
+            set_sphere(i, glm::vec3(0.0f),
+                       -std::numeric_limits<float>::infinity());
+        }
+    }
+
+    void FrustumCuller::set_sphere(size_t index, const glm::vec3 &center,
+                                   float radius)
+    {
+        DEBUG_ASSERT(index < _radius.size());
+        _x[index] = center.x;
+        _y[index] = center.y;
+        _z[index] = center.z;
+        _radius[index] = radius;
+    }
+
+    size_t FrustumCuller::size() const
+    {
+        return _size;
+    }
+
+    void FrustumCuller::cull(const FrustumPlanes &planes,
+                             std::vector<u32> &visible) const
+    {
+        cull(planes, visible, best_path());
+    }
+
+    void FrustumCuller::cull(const FrustumPlanes &planes,
+                             std::vector<u32> &visible,
+                             CullingPath path) const
+    {
+        ALWAYS_ASSERT(is_supported(path), "Culling path not supported");
+
+        // SIMD paths write a full lane group before compacting
+        visible.resize(_radius.size() + simd_width);
+
+        size_t count = 0;
+        switch (path)
+        {
+            case CullingPath::Scalar:
+                count = cull_scalar(planes, visible.data());
+                break;
+
+            case CullingPath::SSE:
+                count = cull_sse(planes, visible.data());
+                break;
+
+            case CullingPath::AVX:
+                count = cull_avx(planes, visible.data());
+                break;
+        }
+
+        visible.resize(count);
+    }
+
+    bool FrustumCuller::is_supported(CullingPath path)
+    {
+        switch (path)
+        {
+            case CullingPath::Scalar:
+                return true;
+
+            case CullingPath::SSE:
+#ifdef OM3D_CULLING_X86
+                return true;
+#else
+                return false;
+#endif
+
+            case CullingPath::AVX:
+            {
+                static const bool supported = cpu_has_avx();
+                return supported;
+            }
+        }
+
+        return false;
+    }
+
+    CullingPath FrustumCuller::best_path()
+    {
+        if (is_supported(CullingPath::AVX))
+        {
+            return CullingPath::AVX;
+        }
+        if (is_supported(CullingPath::SSE))
+        {
+            return CullingPath::SSE;
+        }
+        return CullingPath::Scalar;
+    }
+
+    size_t FrustumCuller::cull_scalar(const FrustumPlanes &planes,
+                                      u32 *visible) const
+    {
+        size_t count = 0;
+        for (size_t i = 0; i != _size; ++i)
+        {
+            bool inside = true;
+            for (const glm::vec4 &plane : planes)
+            {
+                const float dist = plane.x * _x[i] + plane.y * _y[i]
+                    + plane.z * _z[i] + plane.w;
+                inside &= dist >= -_radius[i];
+            }
+
+            // Branchless compaction
+            visible[count] = u32(i);
+            count += inside;
+        }
+        return count;
+    }
+
+#ifdef OM3D_CULLING_X86
+
+    static u32 lowest_set_bit(u32 mask)
+    {
+#    ifdef _MSC_VER
+        unsigned long index = 0;
+        _BitScanForward(&index, mask);
+        return u32(index);
+#    else
+        return u32(__builtin_ctz(mask));
+#    endif
+    }
+
+    size_t FrustumCuller::cull_sse(const FrustumPlanes &planes,
+                                   u32 *visible) const
+    {
+        __m128 plane_x[5], plane_y[5], plane_z[5], plane_w[5];
+        for (size_t p = 0; p != 5; ++p)
+        {
+            plane_x[p] = _mm_set1_ps(planes[p].x);
+            plane_y[p] = _mm_set1_ps(planes[p].y);
+            plane_z[p] = _mm_set1_ps(planes[p].z);
+            plane_w[p] = _mm_set1_ps(planes[p].w);
+        }
+
+        size_t count = 0;
+        for (size_t i = 0; i < _size; i += 4)
+        {
+            const __m128 x = _mm_loadu_ps(_x.data() + i);
+            const __m128 y = _mm_loadu_ps(_y.data() + i);
+            const __m128 z = _mm_loadu_ps(_z.data() + i);
+            const __m128 neg_radius =
+                _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(_radius.data() + i));
+
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (size_t p = 0; p != 5; ++p)
+            {
+                __m128 dist = _mm_add_ps(_mm_mul_ps(x, plane_x[p]), plane_w[p]);
+                dist = _mm_add_ps(dist, _mm_mul_ps(y, plane_y[p]));
+                dist = _mm_add_ps(dist, _mm_mul_ps(z, plane_z[p]));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, neg_radius));
+            }
+
+            u32 mask = u32(_mm_movemask_ps(inside));
+            while (mask)
+            {
+                visible[count++] = u32(i) + lowest_set_bit(mask);
+                mask &= mask - 1;
+            }
+        }
+        return count;
+    }
+
+    AVX_TARGET size_t FrustumCuller::cull_avx(const FrustumPlanes &planes,
+                                              u32 *visible) const
+    {
+        __m256 plane_x[5], plane_y[5], plane_z[5], plane_w[5];
+        for (size_t p = 0; p != 5; ++p)
+        {
+            plane_x[p] = _mm256_set1_ps(planes[p].x);
+            plane_y[p] = _mm256_set1_ps(planes[p].y);
+            plane_z[p] = _mm256_set1_ps(planes[p].z);
+            plane_w[p] = _mm256_set1_ps(planes[p].w);
+        }
+
+        size_t count = 0;
+        for (size_t i = 0; i < _size; i += 8)
+        {
+            const __m256 x = _mm256_loadu_ps(_x.data() + i);
+            const __m256 y = _mm256_loadu_ps(_y.data() + i);
+            const __m256 z = _mm256_loadu_ps(_z.data() + i);
+            const __m256 neg_radius = _mm256_sub_ps(
+                _mm256_setzero_ps(), _mm256_loadu_ps(_radius.data() + i));
+
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (size_t p = 0; p != 5; ++p)
+            {
+                __m256 dist =
+                    _mm256_add_ps(_mm256_mul_ps(x, plane_x[p]), plane_w[p]);
+                dist = _mm256_add_ps(dist, _mm256_mul_ps(y, plane_y[p]));
+                dist = _mm256_add_ps(dist, _mm256_mul_ps(z, plane_z[p]));
+                inside = _mm256_and_ps(
+                    inside, _mm256_cmp_ps(dist, neg_radius, _CMP_GE_OQ));
+            }
+
+            u32 mask = u32(_mm256_movemask_ps(inside));
+            while (mask)
+            {
+                visible[count++] = u32(i) + lowest_set_bit(mask);
+                mask &= mask - 1;
+            }
+        }
+        return count;
+    }
+
+#else
+
+    size_t FrustumCuller::cull_sse(const FrustumPlanes &planes,
+                                   u32 *visible) const
+    {
+        return cull_scalar(planes, visible);
+    }
+
+    size_t FrustumCuller::cull_avx(const FrustumPlanes &planes,
+                                   u32 *visible) const
+    {
+        return cull_scalar(planes, visible);
+    }
+
+#endif
+
+} // namespace OM3D
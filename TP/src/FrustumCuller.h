@@ -0,0 +1,57 @@
+#ifndef FRUSTUMCULLER_H
+#define FRUSTUMCULLER_H
+
+#include <Camera.h>
+
+#include <glm/vec3.hpp>
+#include <vector>
+
+namespace OM3D
+{
+
+    enum class CullingPath
+    {
+        Scalar,
+        SSE,
+        AVX,
+    };
+
+    // Bounding spheres stored as a structure of arrays, so they can be tested
+    // against the frustum several at a time
+    class FrustumCuller
+    {
+    public:
+        FrustumCuller() = default;
+
+        void resize(size_t count);
+        void set_sphere(size_t index, const glm::vec3 &center, float radius);
+
+        size_t size() const;
+
+        // Replaces the content of visible with the indices of the spheres
+        // intersecting the frustum, in increasing order
+        void cull(const FrustumPlanes &planes, std::vector<u32> &visible) const;
+        void cull(const FrustumPlanes &planes, std::vector<u32> &visible,
+                  CullingPath path) const;
+
+        static bool is_supported(CullingPath path);
+        static CullingPath best_path();
+
+    private:
+        size_t cull_scalar(const FrustumPlanes &planes, u32 *visible) const;
+        size_t cull_sse(const FrustumPlanes &planes, u32 *visible) const;
+        size_t cull_avx(const FrustumPlanes &planes, u32 *visible) const;
+
+        // Padded to a multiple of the widest SIMD path, padding spheres
+        // are never visible
+        std::vector<float> _x;
+        std::vector<float> _y;
+        std::vector<float> _z;
+        std::vector<float> _radius;
+
+        size_t _size = 0;
+    };
+
+} // namespace OM3D
+
+#endif // FRUSTUMCULLER_H
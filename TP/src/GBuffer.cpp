@@ -0,0 +1,117 @@
+#include "GBuffer.h"
+
+#include <glad/glad.h>
+
+#include <iostream>
+
+namespace OM3D
+{
+
+    static constexpr ImageFormat albedo_format = ImageFormat::RGBA8_sRGB;
+    static constexpr ImageFormat normal_format = ImageFormat::RG16_SNORM;
+
+    GBuffer::GBuffer()
+        : _program(Program::from_file_async("deferred_lighting.comp"))
+    {}
+
+    bool GBuffer::is_ready() const
+    {
+        return _program->is_ready();
+    }
+
+    void GBuffer::wait() const
+    {
+        _program->wait();
+    }
+
+    void GBuffer::begin_frame(Texture &depth, Texture &lit,
+                              const Camera &camera)
+    {
+        DEBUG_ASSERT(depth.size() == lit.size());
+
+        if (_depth != &depth || _albedo->size() != depth.size())
+        {
+            _albedo = std::make_unique<Texture>(depth.size(), albedo_format);
+            _normal = std::make_unique<Texture>(depth.size(), normal_format);
+            _framebuffer = Framebuffer(
+                &depth, std::array{ _albedo.get(), _normal.get() });
+            _depth = &depth;
+        }
+        _lit = &lit;
+
+        const glm::mat4 &projection = camera.projection_matrix();
+        _program->set_uniform(HASH("view"), camera.view_matrix());
+        _program->set_uniform(HASH("inv_view_proj"),
+                              glm::inverse(camera.view_proj_matrix()));
+        _program->set_uniform(HASH("projection_scale"),
+                              glm::vec2(projection[0][0], projection[1][1]));
+        _program->set_uniform(HASH("z_near"), projection[3][2]);
+
+        GLint binding = 0;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &binding);
+        _target_framebuffer = u32(binding);
+    }
+
+    void GBuffer::bind() const
+    {
+        _framebuffer.bind(false);
+        // Encode albedo to sRGB on write
+        glEnable(GL_FRAMEBUFFER_SRGB);
+    }
+
+    void GBuffer::shade()
+    {
+        glDisable(GL_FRAMEBUFFER_SRGB);
+        glBindFramebuffer(GL_FRAMEBUFFER, _target_framebuffer);
+
+        // Counts are read when their buffer comes around again, the GPU is
+        // done with it by then
+        TypedBuffer<u32> &dropped_lights =
+            _dropped_lights[_frame_index++ % _dropped_lights.size()];
+        if (!dropped_lights.byte_size())
+        {
+            const u32 zero = 0;
+            dropped_lights = TypedBuffer<u32>(&zero, 1);
+        }
+        else
+        {
+            auto mapping = dropped_lights.map(AccessType::ReadWrite);
+            if (mapping[0] && !_dropped_light_count)
+            {
+                std::cerr << "Deferred light tiles are full, " << mapping[0]
+                          << " lights dropped (max " << max_tile_lights
+                          << " per tile)" << std::endl;
+            }
+            _dropped_light_count = mapping[0];
+            mapping[0] = 0;
+        }
+
+        _program->bind();
+        dropped_lights.bind(BufferUsage::Storage, 10);
+        _albedo->bind(0);
+        _normal->bind(1);
+        _depth->bind(2);
+        _lit->bind_as_image(0, AccessType::WriteOnly);
+
+        const glm::uvec2 size = _depth->size();
+        glDispatchCompute(align_up_to(size.x, 16) / 16,
+                          align_up_to(size.y, 16) / 16, 1);
+
+        glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT
+                        | GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+
+    u32 GBuffer::bytes_per_pixel() const
+    {
+        return u32(Texture::byte_size(glm::uvec2(1), albedo_format)
+                   + Texture::byte_size(glm::uvec2(1), normal_format)
+                   + Texture::byte_size(glm::uvec2(1),
+                                        ImageFormat::Depth32_FLOAT));
+    }
+
+    u32 GBuffer::dropped_light_count() const
+    {
+        return _dropped_light_count;
+    }
+
+} // namespace OM3D
@@ -0,0 +1,72 @@
+#ifndef GBUFFER_H
+#define GBUFFER_H
+
+#include <Camera.h>
+#include <Framebuffer.h>
+#include <Program.h>
+#include <RingBuffer.h>
+#include <TypedBuffer.h>
+
+#include <array>
+#include <memory>
+
+namespace OM3D
+{
+
+    // Geometry buffer of deferred shading: sRGB albedo, octahedral encoded
+    // normal, and the depth buffer of the main framebuffer. Lights are culled
+    // per 16x16 tile and shaded in a compute shader.
+    class GBuffer : NonCopyable
+    {
+    public:
+        // Lights past this count in a tile are ignored, and logged
+        static constexpr u32 max_tile_lights = 1024;
+
+        // Requests the lighting program, built in the background
+        GBuffer();
+
+        GBuffer(GBuffer &&) = default;
+        GBuffer &operator=(GBuffer &&) = default;
+
+        // False until the lighting program is built, no frame must be started
+        // before
+        bool is_ready() const;
+        void wait() const;
+
+        // Starts a frame drawing over depth and shading into lit, which must
+        // be the attachments of the bound framebuffer
+        void begin_frame(Texture &depth, Texture &lit, const Camera &camera);
+
+        // Binds the G-buffer without clearing it, the depth is already
+        // cleared and pixels left at the far plane are never shaded
+        void bind() const;
+
+        // Expects the frame data and lights to be bound. Rebinds the
+        // framebuffer that was bound when the frame started.
+        void shade();
+
+        // Bytes of the G-buffer attachments per pixel, depth included
+        u32 bytes_per_pixel() const;
+
+        // Lights dropped from full tiles, summed over all tiles. Read back a
+        // ring buffer cycle late.
+        u32 dropped_light_count() const;
+
+    private:
+        std::unique_ptr<Texture> _albedo;
+        std::unique_ptr<Texture> _normal;
+        Framebuffer _framebuffer;
+        std::shared_ptr<Program> _program;
+        std::array<TypedBuffer<u32>, RingBuffer::default_frames_in_flight>
+            _dropped_lights;
+        u64 _frame_index = 0;
+        u32 _dropped_light_count = 0;
+
+        Texture *_depth = nullptr;
+        Texture *_lit = nullptr;
+        u32 _target_framebuffer = 0;
+    };
+
+} // namespace OM3D
+
+#endif // GBUFFER_H
@@ -0,0 +1,186 @@
+#include "GPUProfiler.h"
+
+#include <glad/glad.h>
+
+#include <fstream>
+
+namespace OM3D
+{
+
+    double GPUZone::duration_ms() const
+    {
+        return double(end - begin) / 1.0e6;
+    }
+
+    GPUProfiler &GPUProfiler::global()
+    {
+        static GPUProfiler profiler;
+        return profiler;
+    }
+
+    void GPUProfiler::set_enabled(bool enabled)
+    {
+        _enabled = enabled;
+    }
+
+    bool GPUProfiler::is_enabled() const
+    {
+        return _enabled;
+    }
+
+    void GPUProfiler::begin_frame()
+    {
+        DEBUG_ASSERT(!_recording);
+
+        PendingFrame &frame = _pending[_frame_index % _pending.size()];
+        read_back(frame);
+
+        frame.index = _frame_index;
+        frame.used_queries = 0;
+        frame.zones.clear();
+
+        _recording = _enabled;
+        begin_scope("Frame");
+    }
+
+    void GPUProfiler::end_frame()
+    {
+        end_scope();
+        DEBUG_ASSERT(_open_zones.empty());
+
+        _recording = false;
+        ++_frame_index;
+    }
+
+    void GPUProfiler::begin_scope(const char *name)
+    {
+        if (!_recording)
+        {
+            return;
+        }
+
+        PendingFrame &frame = _pending[_frame_index % _pending.size()];
+
+        PendingZone zone;
+        zone.name = name;
+        zone.depth = u32(_open_zones.size());
+        zone.begin_query = next_query();
+        glQueryCounter(frame.queries[zone.begin_query], GL_TIMESTAMP);
+
+        _open_zones.push_back(u32(frame.zones.size()));
+        frame.zones.push_back(zone);
+    }
+
+    void GPUProfiler::end_scope()
+    {
+        if (!_recording)
+        {
+            return;
+        }
+
+        DEBUG_ASSERT(!_open_zones.empty());
+
+        PendingFrame &frame = _pending[_frame_index % _pending.size()];
+        PendingZone &zone = frame.zones[_open_zones.back()];
+        _open_zones.pop_back();
+
+        zone.end_query = next_query();
+        glQueryCounter(frame.queries[zone.end_query], GL_TIMESTAMP);
+    }
+
+    const std::deque<GPUFrame> &GPUProfiler::frames() const
+    {
+        return _frames;
+    }
+
+    u64 GPUProfiler::dropped_frame_count() const
+    {
+        return _dropped_frames;
+    }
+
+    u32 GPUProfiler::next_query()
+    {
+        PendingFrame &frame = _pending[_frame_index % _pending.size()];
+        if (frame.used_queries == frame.queries.size())
+        {
+            GLuint handle = 0;
+            glGenQueries(1, &handle);
+            frame.queries.push_back(handle);
+        }
+        return frame.used_queries++;
+    }
+
+    void GPUProfiler::read_back(PendingFrame &frame)
+    {
+        if (frame.zones.empty())
+        {
+            return;
+        }
+
+        // Timestamps complete in order, the last one is written at the end of
+        // the frame
+        GLuint available = 0;
+        glGetQueryObjectuiv(frame.queries[frame.used_queries - 1],
+                            GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+        {
+            ++_dropped_frames;
+            return;
+        }
+
+        auto timestamp = [&](u32 query) {
+            GLuint64 time = 0;
+            glGetQueryObjectui64v(frame.queries[query], GL_QUERY_RESULT, &time);
+            return u64(time);
+        };
+
+        GPUFrame result;
+        result.index = frame.index;
+        for (const PendingZone &zone : frame.zones)
+        {
+            GPUZone &out = result.zones.emplace_back();
+            out.name = zone.name;
+            out.depth = zone.depth;
+            out.begin = timestamp(zone.begin_query);
+            out.end = timestamp(zone.end_query);
+        }
+
+        if (_frames.size() == history_size)
+        {
+            _frames.pop_front();
+        }
+        _frames.push_back(std::move(result));
+    }
+
+    Result<void> GPUProfiler::write_chrome_trace(
+        const std::string &file_name) const
+    {
+        std::ofstream out(file_name);
+        if (!out)
+        {
+            return { false };
+        }
+
+        // Timestamps are in microseconds from the first frame
+        const u64 origin = _frames.empty() ? 0 : _frames.front().zones[0].begin;
+
+        out << "{\"traceEvents\":[";
+        const char *separator = "\n";
+        for (const GPUFrame &frame : _frames)
+        {
+            for (const GPUZone &zone : frame.zones)
+            {
+                out << separator << "{\"name\":\"" << zone.name
+                    << "\",\"ph\":\"X\",\"pid\":0,\"tid\":0"
+                    << ",\"ts\":" << double(zone.begin - origin) / 1.0e3
+                    << ",\"dur\":" << double(zone.end - zone.begin) / 1.0e3
+                    << ",\"args\":{\"frame\":" << frame.index << "}}";
+                separator = ",\n";
+            }
+        }
+        out << "\n]}\n";
+
+        return { bool(out) };
+    }
+
+} // namespace OM3D
@@ -0,0 +1,122 @@
+#ifndef GPUPROFILER_H
+#define GPUPROFILER_H
+
+#include <RingBuffer.h>
+#include <graphics.h>
+
+#include <array>
+#include <deque>
+#include <string>
+#include <vector>
+
+// Time the GPU work submitted until the end of the scope
+#define GPU_PROFILE_SCOPE(name)                                                \
+    ::OM3D::GPUProfileScope CREATE_UNIQUE_NAME_WITH_PREFIX(gpu_scope)(name)
+
+namespace OM3D
+{
+
+    // Nestable zone of a frame, in nanoseconds of the GPU clock
+    struct GPUZone
+    {
+        const char *name = nullptr;
+        u32 depth = 0;
+        u64 begin = 0;
+        u64 end = 0;
+
+        double duration_ms() const;
+    };
+
+    struct GPUFrame
+    {
+        u64 index = 0;
+
+        // In begin order, the first one covers the whole frame
+        std::vector<GPUZone> zones;
+    };
+
+    // Times scopes with GL_TIMESTAMP queries. Each frame in flight has its own
+    // queries, which are read back when the frame comes around again, so the
+    // CPU never waits for results. Frames still running on the GPU by then
+    // are dropped. Scopes outside of begin_frame/end_frame, or issued while
+    // disabled, cost a single branch.
+    class GPUProfiler : NonMovable
+    {
+    public:
+        static constexpr size_t history_size = 256;
+
+        // One more than the frames in flight: a frame is only read back once
+        // the ring buffer fence guarantees the GPU is done with it
+        static constexpr size_t pending_frame_count =
+            RingBuffer::default_frames_in_flight + 1;
+
+        // Profiler shared by the whole application. Its query objects are
+        // never deleted, they go away with the GL context.
+        static GPUProfiler &global();
+
+        void set_enabled(bool enabled);
+        bool is_enabled() const;
+
+        void begin_frame();
+        void end_frame();
+
+        // Names must outlive the profiler (string literals)
+        void begin_scope(const char *name);
+        void end_scope();
+
+        // Frames read back so far, oldest first
+        const std::deque<GPUFrame> &frames() const;
+        u64 dropped_frame_count() const;
+
+        // Chrome trace event format, also read by Perfetto
+        Result<void> write_chrome_trace(const std::string &file_name) const;
+
+    private:
+        GPUProfiler() = default;
+
+        struct PendingZone
+        {
+            const char *name = nullptr;
+            u32 depth = 0;
+            u32 begin_query = 0;
+            u32 end_query = 0;
+        };
+
+        struct PendingFrame
+        {
+            u64 index = 0;
+            std::vector<u32> queries;
+            u32 used_queries = 0;
+            std::vector<PendingZone> zones;
+        };
+
+        u32 next_query();
+        void read_back(PendingFrame &frame);
+
+        std::array<PendingFrame, pending_frame_count> _pending;
+        std::vector<u32> _open_zones;
+        std::deque<GPUFrame> _frames;
+
+        u64 _frame_index = 0;
+        u64 _dropped_frames = 0;
+        bool _enabled = false;
+        bool _recording = false;
+    };
+
+    class GPUProfileScope : NonMovable
+    {
+    public:
+        GPUProfileScope(const char *name)
+        {
+            GPUProfiler::global().begin_scope(name);
+        }
+
+        ~GPUProfileScope()
+        {
+            GPUProfiler::global().end_scope();
+        }
+    };
+
+} // namespace OM3D
+
+#endif // GPUPROFILER_H
@@ -0,0 +1,78 @@
+#include "GPUQuery.h"
+
+#include <glad/glad.h>
+
+namespace OM3D
+{
+
+    static GLenum query_target(QueryType type)
+    {
+        switch (type)
+        {
+        case QueryType::TimeElapsed:
+            return GL_TIME_ELAPSED;
+
+        case QueryType::SamplesPassed:
+            return GL_SAMPLES_PASSED;
+        }
+        FATAL("Unknown query type");
+    }
+
+    GPUQuery::GPUQuery(QueryType type, u32 frame_count)
+        : _pending(frame_count, 0)
+        , _type(type)
+    {
+        for (u32 i = 0; i != frame_count; ++i)
+        {
+            GLuint handle = 0;
+            glGenQueries(1, &handle);
+            _queries.emplace_back(handle);
+        }
+    }
+
+    GPUQuery::~GPUQuery()
+    {
+        for (const GLHandle &query : _queries)
+        {
+            if (query.is_valid())
+            {
+                const GLuint handle = query.get();
+                glDeleteQueries(1, &handle);
+            }
+        }
+    }
+
+    void GPUQuery::begin()
+    {
+        DEBUG_ASSERT(!_queries.empty());
+
+        const GLuint handle = _queries[_next].get();
+        if (_pending[_next])
+        {
+            GLuint available = 0;
+            glGetQueryObjectuiv(handle, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+            {
+                GLuint64 result = 0;
+                glGetQueryObjectui64v(handle, GL_QUERY_RESULT, &result);
+                _result = result;
+            }
+        }
+
+        // A query whose result was never read is simply reused
+        glBeginQuery(query_target(_type), handle);
+        _pending[_next] = 1;
+    }
+
+    void GPUQuery::end()
+    {
+        glEndQuery(query_target(_type));
+        _next = (_next + 1) % u32(_queries.size());
+    }
+
+    u64 GPUQuery::result() const
+    {
+        return _result;
+    }
+
+} // namespace OM3D
@@ -0,0 +1,48 @@
+#ifndef GPUQUERY_H
+#define GPUQUERY_H
+
+#include <RingBuffer.h>
+#include <graphics.h>
+
+#include <vector>
+
+namespace OM3D
+{
+
+    enum class QueryType
+    {
+        TimeElapsed,
+        SamplesPassed,
+    };
+
+    // Query whose result is read back a few frames late, so the CPU never
+    // waits for the GPU. Each begin/end pair uses the next of frame_count
+    // query objects, after reading the result of its previous use if ready.
+    class GPUQuery : NonCopyable
+    {
+    public:
+        GPUQuery() = default;
+        GPUQuery(QueryType type,
+                 u32 frame_count = RingBuffer::default_frames_in_flight);
+        ~GPUQuery();
+
+        GPUQuery(GPUQuery &&) = default;
+        GPUQuery &operator=(GPUQuery &&) = default;
+
+        void begin();
+        void end();
+
+        // Latest available result, in nanoseconds or samples
+        u64 result() const;
+
+    private:
+        std::vector<GLHandle> _queries;
+        std::vector<u8> _pending;
+        u32 _next = 0;
+        u64 _result = 0;
+        QueryType _type = QueryType::TimeElapsed;
+    };
+
+} // namespace OM3D
+
+#endif // GPUQUERY_H
@@ -0,0 +1,90 @@
+#include "HeadlessContext.h"
+
+#ifdef TP_HAS_EGL
+#    include <EGL/egl.h>
+#    include <EGL/eglext.h>
+#endif
+
+namespace OM3D
+{
+
+#ifdef TP_HAS_EGL
+    Result<std::unique_ptr<HeadlessContext>> HeadlessContext::create()
+    {
+        const auto get_platform_display =
+            reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+                eglGetProcAddress("eglGetPlatformDisplayEXT"));
+        if (!get_platform_display)
+        {
+            return { false, {} };
+        }
+
+        const EGLDisplay display = get_platform_display(
+            EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        EGLint major = 0;
+        EGLint minor = 0;
+        if (display == EGL_NO_DISPLAY
+            || !eglInitialize(display, &major, &minor))
+        {
+            return { false, {} };
+        }
+
+        auto context = std::unique_ptr<HeadlessContext>(new HeadlessContext());
+        context->_display = display;
+
+        const EGLint attribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION,
+            4,
+            EGL_CONTEXT_MINOR_VERSION,
+            5,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK,
+            EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE,
+        };
+        if (!eglBindAPI(EGL_OPENGL_API))
+        {
+            return { false, {} };
+        }
+        context->_context = eglCreateContext(display, EGL_NO_CONFIG_KHR,
+                                             EGL_NO_CONTEXT, attribs);
+        if (context->_context == EGL_NO_CONTEXT
+            || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                               context->_context))
+        {
+            return { false, {} };
+        }
+
+        return { true, std::move(context) };
+    }
+
+    HeadlessContext::~HeadlessContext()
+    {
+        if (_context)
+        {
+            eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                           EGL_NO_CONTEXT);
+            eglDestroyContext(_display, _context);
+        }
+        eglTerminate(_display);
+    }
+
+    void *HeadlessContext::get_proc_address(const char *name)
+    {
+        return reinterpret_cast<void *>(eglGetProcAddress(name));
+    }
+#else
+    Result<std::unique_ptr<HeadlessContext>> HeadlessContext::create()
+    {
+        return { false, {} };
+    }
+
+    HeadlessContext::~HeadlessContext()
+    {}
+
+    void *HeadlessContext::get_proc_address(const char *)
+    {
+        return nullptr;
+    }
+#endif
+
+} // namespace OM3D
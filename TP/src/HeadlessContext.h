@@ -0,0 +1,33 @@
+#ifndef HEADLESSCONTEXT_H
+#define HEADLESSCONTEXT_H
+
+#include <graphics.h>
+
+#include <memory>
+
+namespace OM3D
+{
+
+    // OpenGL 4.5 core context without any window or default framebuffer,
+    // made current on creation. Uses EGL surfaceless (Mesa) and is only
+    // available when built with EGL (TP_HAS_EGL).
+    class HeadlessContext : NonMovable
+    {
+    public:
+        static Result<std::unique_ptr<HeadlessContext>> create();
+
+        ~HeadlessContext();
+
+        // To pass to init_graphics
+        static void *get_proc_address(const char *name);
+
+    private:
+        HeadlessContext() = default;
+
+        void *_display = nullptr;
+        void *_context = nullptr;
+    };
+
+} // namespace OM3D
+
+#endif // HEADLESSCONTEXT_H
@@ -1,6 +1,5 @@
 #include "ImGuiRenderer.h"
 
-#include <TypedBuffer.h>
 #include <glad/glad.h>
 #include <glm/vec2.hpp>
 #include <imgui/imgui.h>
@@ -370,14 +369,21 @@ namespace OM3D
         glEnable(GL_SCISSOR_TEST);
         DEFER(glDisable(GL_SCISSOR_TEST));
 
-        TypedBuffer<ImDrawIdx> index_buffer(nullptr, draw_data->TotalIdxCount);
-        TypedBuffer<ImDrawVert> vertex_buffer(nullptr,
-                                              draw_data->TotalVtxCount);
+        _buffer.begin_frame();
 
-        {
-            auto indices = index_buffer.map(AccessType::WriteOnly);
-            auto vertices = vertex_buffer.map(AccessType::WriteOnly);
+        // Indices then vertices, in a single allocation: a second one could
+        // grow the buffer and leave the first in the previous storage
+        const u32 index_bytes =
+            align_up_to(u32(draw_data->TotalIdxCount * sizeof(ImDrawIdx)),
+                        u32(alignof(ImDrawVert)));
+        const auto data = _buffer.allocate<byte>(
+            index_bytes + draw_data->TotalVtxCount * sizeof(ImDrawVert),
+            alignof(ImDrawVert));
+        ImDrawIdx *indices = reinterpret_cast<ImDrawIdx *>(data.data);
+        ImDrawVert *vertices =
+            reinterpret_cast<ImDrawVert *>(data.data + index_bytes);
 
+        {
             size_t index_offset = 0;
             size_t vertex_offset = 0;
             for (int c = 0; c != draw_data->CmdListsCount; ++c)
@@ -392,11 +398,12 @@ namespace OM3D
             }
         }
 
-        index_buffer.bind(BufferUsage::Index);
-        vertex_buffer.bind(BufferUsage::Attribute);
+        _buffer.bind(BufferUsage::Index);
+        _buffer.bind(BufferUsage::Attribute);
 
-        byte *vertex_offset = nullptr;
-        byte *index_offset = nullptr;
+        byte *vertex_offset =
+            reinterpret_cast<byte *>(data.offset + index_bytes);
+        byte *index_offset = reinterpret_cast<byte *>(data.offset);
         for (int c = 0; c != draw_data->CmdListsCount; ++c)
         {
             const ImDrawList *cmd_list = draw_data->CmdLists[c];
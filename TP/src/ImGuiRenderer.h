@@ -2,6 +2,7 @@
 #define IMGUIRENDERER_H
 
 #include <Material.h>
+#include <RingBuffer.h>
 #include <chrono>
 
 struct ImDrawData;
@@ -26,6 +27,7 @@ namespace OM3D
 
         Material _material;
         std::unique_ptr<Texture> _font;
+        RingBuffer _buffer;
         std::chrono::time_point<std::chrono::high_resolution_clock> _last;
     };
 
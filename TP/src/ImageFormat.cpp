@@ -19,6 +19,10 @@ namespace OM3D
             return ImageFormatGL{ GL_RGB, GL_SRGB8, GL_UNSIGNED_BYTE };
         case ImageFormat::RGBA16_FLOAT:
             return ImageFormatGL{ GL_RGBA, GL_RGBA16F, GL_FLOAT };
+        case ImageFormat::RG16_SNORM:
+            return ImageFormatGL{ GL_RG, GL_RG16_SNORM, GL_SHORT };
+        case ImageFormat::R32_FLOAT:
+            return ImageFormatGL{ GL_RED, GL_R32F, GL_FLOAT };
         case ImageFormat::Depth32_FLOAT:
             return ImageFormatGL{ GL_DEPTH_COMPONENT, GL_DEPTH_COMPONENT32F,
                                   GL_FLOAT };
@@ -14,6 +14,8 @@ namespace OM3D
         RGB8_sRGB,
 
         RGBA16_FLOAT,
+        RG16_SNORM,
+        R32_FLOAT,
         Depth32_FLOAT
     };
 
@@ -0,0 +1,95 @@
+#include "LightClusters.h"
+
+#include <glad/glad.h>
+
+#include <cmath>
+#include <iostream>
+
+namespace OM3D
+{
+
+    LightClusters::LightClusters()
+        : _program(Program::from_file_async("cluster_lights.comp"))
+    {}
+
+    bool LightClusters::is_ready() const
+    {
+        return _program->is_ready();
+    }
+
+    void LightClusters::wait() const
+    {
+        _program->wait();
+    }
+
+    void LightClusters::setup(shader::FrameData &frame, const glm::uvec3 &grid,
+                              float near, float far)
+    {
+        _grid = glm::max(grid, glm::uvec3(1));
+        const size_t cluster_count = size_t(_grid.x) * _grid.y * _grid.z;
+        if (_light_counts.element_count() != cluster_count)
+        {
+            _light_counts = TypedBuffer<u32>(nullptr, cluster_count);
+            _light_indices =
+                TypedBuffer<u32>(nullptr, cluster_count * max_cluster_lights);
+        }
+
+        near = std::max(near, 1.0e-4f);
+        far = std::max(far, near * 2.0f);
+
+        frame.cluster_grid = _grid;
+        frame.max_cluster_lights = max_cluster_lights;
+        frame.cluster_near = near;
+        frame.cluster_depth_scale = float(_grid.z) / std::log(far / near);
+    }
+
+    void LightClusters::build(const Camera &camera)
+    {
+        const glm::mat4 &projection = camera.projection_matrix();
+        _program->set_uniform(HASH("view"), camera.view_matrix());
+        _program->set_uniform(HASH("projection_scale"),
+                              glm::vec2(projection[0][0], projection[1][1]));
+        // Counts are read when their buffer comes around again, the GPU is
+        // done with it by then
+        TypedBuffer<u32> &dropped_lights =
+            _dropped_lights[_frame_index++ % _dropped_lights.size()];
+        if (!dropped_lights.byte_size())
+        {
+            const u32 zero = 0;
+            dropped_lights = TypedBuffer<u32>(&zero, 1);
+        }
+        else
+        {
+            auto mapping = dropped_lights.map(AccessType::ReadWrite);
+            if (mapping[0] && !_dropped_light_count)
+            {
+                std::cerr << "Light clusters are full, " << mapping[0]
+                          << " lights dropped (max " << max_cluster_lights
+                          << " per cluster)" << std::endl;
+            }
+            _dropped_light_count = mapping[0];
+            mapping[0] = 0;
+        }
+
+        _program->bind();
+        bind(8, 9);
+        dropped_lights.bind(BufferUsage::Storage, 10);
+
+        const u32 cluster_count = _grid.x * _grid.y * _grid.z;
+        glDispatchCompute((cluster_count + 63) / 64, 1, 1);
+
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    void LightClusters::bind(u32 counts_index, u32 indices_index) const
+    {
+        _light_counts.bind(BufferUsage::Storage, counts_index);
+        _light_indices.bind(BufferUsage::Storage, indices_index);
+    }
+
+    u32 LightClusters::dropped_light_count() const
+    {
+        return _dropped_light_count;
+    }
+
+} // namespace OM3D
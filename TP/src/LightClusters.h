@@ -0,0 +1,65 @@
+#ifndef LIGHTCLUSTERS_H
+#define LIGHTCLUSTERS_H
+
+#include <Camera.h>
+#include <Program.h>
+#include <RingBuffer.h>
+#include <TypedBuffer.h>
+#include <shader_structs.h>
+
+#include <array>
+#include <memory>
+
+namespace OM3D
+{
+
+    // Lists of the point lights touching each cluster of a grid over the view
+    // frustum, built in a compute shader for clustered forward shading.
+    // Clusters are screen tiles, cut in slices whose depth grows
+    // exponentially from near to far. The first slice starts at the eye, and
+    // the last one extends to infinity.
+    class LightClusters : NonCopyable
+    {
+    public:
+        // Lights past this count in a cluster are ignored, and logged
+        static constexpr u32 max_cluster_lights = 256;
+
+        // Requests the program, built in the background
+        LightClusters();
+
+        LightClusters(LightClusters &&) = default;
+        LightClusters &operator=(LightClusters &&) = default;
+
+        // Fills the cluster fields of frame, to be uploaded before build
+        void setup(shader::FrameData &frame, const glm::uvec3 &grid,
+                   float near, float far);
+
+        // False until the program is built, the clusters must not be set up
+        // or built before
+        bool is_ready() const;
+        void wait() const;
+
+        // Expects the frame data set up above, and the lights, to be bound
+        void build(const Camera &camera);
+
+        // Binds the light counts and indices of the clusters
+        void bind(u32 counts_index, u32 indices_index) const;
+
+        // Lights dropped from full clusters, summed over all clusters. Read
+        // back a ring buffer cycle late.
+        u32 dropped_light_count() const;
+
+    private:
+        TypedBuffer<u32> _light_counts;
+        TypedBuffer<u32> _light_indices;
+        std::array<TypedBuffer<u32>, RingBuffer::default_frames_in_flight>
+            _dropped_lights;
+        u64 _frame_index = 0;
+        u32 _dropped_light_count = 0;
+        std::shared_ptr<Program> _program;
+        glm::uvec3 _grid = {};
+    };
+
+} // namespace OM3D
+
+#endif // LIGHTCLUSTERS_H
@@ -0,0 +1,131 @@
+#include "MappedFile.h"
+
+#ifdef OS_WIN
+#    include <windows.h>
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+namespace OM3D
+{
+
+    MappedFile::~MappedFile()
+    {
+#ifdef OS_WIN
+        if (_data)
+        {
+            UnmapViewOfFile(_data);
+        }
+        if (_mapping)
+        {
+            CloseHandle(_mapping);
+        }
+        if (_file)
+        {
+            CloseHandle(_file);
+        }
+#else
+        if (_data)
+        {
+            munmap(const_cast<byte *>(_data), _size);
+        }
+#endif
+    }
+
+    MappedFile::MappedFile(MappedFile &&other)
+    {
+        swap(other);
+    }
+
+    MappedFile &MappedFile::operator=(MappedFile &&other)
+    {
+        swap(other);
+        return *this;
+    }
+
+    void MappedFile::swap(MappedFile &other)
+    {
+        std::swap(_data, other._data);
+        std::swap(_size, other._size);
+#ifdef OS_WIN
+        std::swap(_file, other._file);
+        std::swap(_mapping, other._mapping);
+#endif
+    }
+
+    Result<MappedFile> MappedFile::open(const std::string &file_name)
+    {
+        MappedFile file;
+
+#ifdef OS_WIN
+        file._file = CreateFileA(file_name.c_str(), GENERIC_READ,
+                                 FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                 FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file._file == INVALID_HANDLE_VALUE)
+        {
+            file._file = nullptr;
+            return { false, {} };
+        }
+
+        LARGE_INTEGER size = {};
+        if (!GetFileSizeEx(file._file, &size) || !size.QuadPart)
+        {
+            return { false, {} };
+        }
+
+        file._mapping = CreateFileMappingA(file._file, nullptr, PAGE_READONLY,
+                                           0, 0, nullptr);
+        if (!file._mapping)
+        {
+            return { false, {} };
+        }
+
+        file._data = static_cast<const byte *>(
+            MapViewOfFile(file._mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!file._data)
+        {
+            return { false, {} };
+        }
+        file._size = size_t(size.QuadPart);
+#else
+        const int fd = ::open(file_name.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return { false, {} };
+        }
+        DEFER(::close(fd));
+
+        struct stat info = {};
+        if (fstat(fd, &info) || !info.st_size)
+        {
+            return { false, {} };
+        }
+
+        void *data =
+            mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            return { false, {} };
+        }
+
+        file._data = static_cast<const byte *>(data);
+        file._size = size_t(info.st_size);
+#endif
+
+        return { true, std::move(file) };
+    }
+
+    const byte *MappedFile::data() const
+    {
+        return _data;
+    }
+
+    size_t MappedFile::size() const
+    {
+        return _size;
+    }
+
+} // namespace OM3D
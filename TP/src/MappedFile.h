@@ -0,0 +1,38 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <utils.h>
+
+namespace OM3D
+{
+
+    // Read-only memory mapping of a whole file
+    class MappedFile : NonCopyable
+    {
+    public:
+        MappedFile() = default;
+        ~MappedFile();
+
+        MappedFile(MappedFile &&other);
+        MappedFile &operator=(MappedFile &&other);
+
+        static Result<MappedFile> open(const std::string &file_name);
+
+        const byte *data() const;
+        size_t size() const;
+
+    private:
+        void swap(MappedFile &other);
+
+        const byte *_data = nullptr;
+        size_t _size = 0;
+
+#ifdef OS_WIN
+        void *_file = nullptr;
+        void *_mapping = nullptr;
+#endif
+    };
+
+} // namespace OM3D
+
+#endif // MAPPEDFILE_H
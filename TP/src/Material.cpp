@@ -14,6 +14,11 @@ namespace OM3D
         _program = std::move(prog);
     }
 
+    void Material::set_gbuffer_program(std::shared_ptr<Program> prog)
+    {
+        _gbuffer_program = std::move(prog);
+    }
+
     void Material::set_blend_mode(BlendMode blend)
     {
         _blend_mode = blend;
@@ -40,6 +45,24 @@ namespace OM3D
     }
 
     void Material::bind() const
+    {
+        bind(_depth_test_mode);
+    }
+
+    void Material::bind(DepthTestMode depth_test_mode) const
+    {
+        bind_state(depth_test_mode);
+        _program->bind();
+    }
+
+    void Material::bind_gbuffer(DepthTestMode depth_test_mode) const
+    {
+        DEBUG_ASSERT(_gbuffer_program);
+        bind_state(depth_test_mode);
+        _gbuffer_program->bind();
+    }
+
+    void Material::bind_state(DepthTestMode depth_test_mode) const
     {
         switch (_blend_mode)
         {
@@ -57,7 +80,9 @@ namespace OM3D
             break;
         }
 
-        switch (_depth_test_mode)
+        glDepthMask(depth_test_mode == DepthTestMode::Equal ? GL_FALSE
+                                                            : GL_TRUE);
+        switch (depth_test_mode)
         {
         case DepthTestMode::None:
             glDisable(GL_DEPTH_TEST);
@@ -85,7 +110,39 @@ namespace OM3D
         {
             texture.second->bind(texture.first);
         }
-        _program->bind();
+    }
+
+    DepthTestMode Material::depth_test_mode() const
+    {
+        return _depth_test_mode;
+    }
+
+    bool Material::has_gbuffer_program() const
+    {
+        return bool(_gbuffer_program);
+    }
+
+    bool Material::is_ready() const
+    {
+        return (!_program || _program->is_ready())
+            && (!_gbuffer_program || _gbuffer_program->is_ready());
+    }
+
+    void Material::wait() const
+    {
+        if (_program)
+        {
+            _program->wait();
+        }
+        if (_gbuffer_program)
+        {
+            _gbuffer_program->wait();
+        }
+    }
+
+    bool Material::culls_back_faces() const
+    {
+        return _blend_mode == BlendMode::None;
     }
 
     std::shared_ptr<Material> Material::empty_material()
@@ -95,7 +152,10 @@ namespace OM3D
         if (!material)
         {
             material = std::make_shared<Material>();
-            material->_program = Program::from_files("lit.frag", "basic.vert");
+            material->_program =
+                Program::from_files_async("lit.frag", "basic.vert");
+            material->_gbuffer_program =
+                Program::from_files_async("gbuffer.frag", "basic.vert");
             weak_material = material;
         }
         return material;
@@ -104,17 +164,22 @@ namespace OM3D
     Material Material::textured_material()
     {
         Material material;
-        material._program =
-            Program::from_files("lit.frag", "basic.vert", { "TEXTURED" });
+        material._program = Program::from_files_async(
+            "lit.frag", "basic.vert", { "TEXTURED" });
+        material._gbuffer_program = Program::from_files_async(
+            "gbuffer.frag", "basic.vert", { "TEXTURED" });
         return material;
     }
 
     Material Material::textured_normal_mapped_material()
     {
         Material material;
-        material._program = Program::from_files(
-            "lit.frag", "basic.vert",
-            std::array<std::string, 2>{ "TEXTURED", "NORMAL_MAPPED" });
+        const std::array<std::string, 2> defines = { "TEXTURED",
+                                                     "NORMAL_MAPPED" };
+        material._program =
+            Program::from_files_async("lit.frag", "basic.vert", defines);
+        material._gbuffer_program =
+            Program::from_files_async("gbuffer.frag", "basic.vert", defines);
         return material;
     }
 
@@ -29,6 +29,8 @@ namespace OM3D
         Material();
 
         void set_program(std::shared_ptr<Program> prog);
+        // Program writing the G-buffer for deferred shading, optional
+        void set_gbuffer_program(std::shared_ptr<Program> prog);
         void set_blend_mode(BlendMode blend);
         void set_depth_test_mode(DepthTestMode depth);
         void set_texture(u32 slot, std::shared_ptr<Texture> tex);
@@ -41,12 +43,35 @@ namespace OM3D
 
         void bind() const;
 
+        // Binds with another depth test. Depth writes are disabled for Equal,
+        // which is meant for drawing over a depth prepass.
+        void bind(DepthTestMode depth_test_mode) const;
+
+        // Same as above, with the G-buffer program
+        void bind_gbuffer(DepthTestMode depth_test_mode) const;
+
+        DepthTestMode depth_test_mode() const;
+        bool has_gbuffer_program() const;
+
+        // False while its programs are built in the background, binding
+        // would wait for them
+        bool is_ready() const;
+        void wait() const;
+
+        // Back faces are culled unless the material is blended
+        bool culls_back_faces() const;
+
+        // Their programs are built asynchronously, see
+        // Program::from_files_async
         static std::shared_ptr<Material> empty_material();
         static Material textured_material();
         static Material textured_normal_mapped_material();
 
     private:
+        void bind_state(DepthTestMode depth_test_mode) const;
+
         std::shared_ptr<Program> _program;
+        std::shared_ptr<Program> _gbuffer_program;
         std::vector<std::pair<u32, std::shared_ptr<Texture>>> _textures;
 
         BlendMode _blend_mode = BlendMode::None;
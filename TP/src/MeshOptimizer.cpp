@@ -0,0 +1,405 @@
+#include "MeshOptimizer.h"
+
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <numeric>
+
+namespace OM3D
+{
+
+    static constexpr u32 no_vertex = u32(-1);
+
+    // FIFO cache, a vertex is cached if it was added less than size misses
+    // ago
+    class FifoCache
+    {
+    public:
+        FifoCache(size_t vertex_count, u32 size)
+            : _timestamps(vertex_count, 0)
+            , _time(size + 1)
+            , _size(size)
+        {}
+
+        bool contains(u32 vertex) const
+        {
+            return _time - _timestamps[vertex] <= _size;
+        }
+
+        // Returns the number of misses
+        u32 add(u32 vertex)
+        {
+            if (contains(vertex))
+            {
+                return 0;
+            }
+            _timestamps[vertex] = _time++;
+            return 1;
+        }
+
+        u32 add_triangle(const u32 *triangle)
+        {
+            return add(triangle[0]) + add(triangle[1]) + add(triangle[2]);
+        }
+
+        // Time elapsed since the vertex entered the cache
+        u32 age(u32 vertex) const
+        {
+            return _time - _timestamps[vertex];
+        }
+
+        void clear()
+        {
+            _time += _size + 1;
+        }
+
+    private:
+        std::vector<u32> _timestamps;
+        u32 _time = 0;
+        u32 _size = 0;
+    };
+
+    float VertexCacheStats::acmr() const
+    {
+        return triangle_count ? float(transformed_count) / float(triangle_count)
+                              : 0.0f;
+    }
+
+    float VertexCacheStats::atvr() const
+    {
+        return vertex_count ? float(transformed_count) / float(vertex_count)
+                            : 0.0f;
+    }
+
+    void VertexCacheStats::merge(const VertexCacheStats &other)
+    {
+        triangle_count += other.triangle_count;
+        vertex_count += other.vertex_count;
+        transformed_count += other.transformed_count;
+    }
+
+    VertexCacheStats analyze_vertex_cache(Span<const u32> indices,
+                                          size_t vertex_count, u32 cache_size)
+    {
+        VertexCacheStats stats;
+        stats.triangle_count = u32(indices.size() / 3);
+
+        FifoCache cache(vertex_count, cache_size);
+        std::vector<bool> referenced(vertex_count, false);
+        for (const u32 index : indices)
+        {
+            stats.transformed_count += cache.add(index);
+            if (!referenced[index])
+            {
+                referenced[index] = true;
+                ++stats.vertex_count;
+            }
+        }
+
+        return stats;
+    }
+
+    void optimize_vertex_cache(Span<u32> indices, size_t vertex_count,
+                               u32 cache_size)
+    {
+        // "Fast Triangle Reordering for Vertex Locality and Reduced
+        // Overdraw", Sander et al. 2007
+        const size_t triangle_count = indices.size() / 3;
+        if (!triangle_count)
+        {
+            return;
+        }
+
+        const std::vector<u32> source(indices.begin(), indices.end());
+
+        // Triangles around each vertex, and how many are not emitted yet
+        std::vector<u32> live(vertex_count, 0);
+        for (const u32 index : source)
+        {
+            ++live[index];
+        }
+
+        std::vector<u32> offsets(vertex_count + 1, 0);
+        std::partial_sum(live.begin(), live.end(), offsets.begin() + 1);
+
+        std::vector<u32> adjacency(source.size());
+        {
+            std::vector<u32> fill(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i != source.size(); ++i)
+            {
+                adjacency[fill[source[i]]++] = u32(i / 3);
+            }
+        }
+
+        FifoCache cache(vertex_count, cache_size);
+        std::vector<bool> emitted(triangle_count, false);
+        std::vector<u32> dead_end;
+        std::vector<u32> candidates;
+        size_t cursor = 0;
+        size_t out = 0;
+
+        u32 fanning = source[0];
+        while (fanning != no_vertex)
+        {
+            // Emit all the remaining triangles around the fanning vertex
+            candidates.clear();
+            for (u32 i = offsets[fanning]; i != offsets[fanning + 1]; ++i)
+            {
+                const u32 triangle = adjacency[i];
+                if (emitted[triangle])
+                {
+                    continue;
+                }
+                emitted[triangle] = true;
+
+                for (u32 k = 0; k != 3; ++k)
+                {
+                    const u32 vertex = source[3 * triangle + k];
+                    indices[out++] = vertex;
+                    dead_end.push_back(vertex);
+                    candidates.push_back(vertex);
+                    --live[vertex];
+                    cache.add(vertex);
+                }
+            }
+
+            // Prefer the oldest candidate that will still be in the cache
+            // once its remaining triangles are emitted
+            fanning = no_vertex;
+            u32 best_priority = 0;
+            for (const u32 vertex : candidates)
+            {
+                if (!live[vertex])
+                {
+                    continue;
+                }
+
+                u32 priority = 1;
+                if (cache.age(vertex) + 2 * live[vertex] <= cache_size)
+                {
+                    priority += cache.age(vertex);
+                }
+                if (priority > best_priority)
+                {
+                    best_priority = priority;
+                    fanning = vertex;
+                }
+            }
+
+            // Dead end, backtrack to a recently used vertex, or pick the next
+            // one in input order
+            while (fanning == no_vertex && !dead_end.empty())
+            {
+                const u32 vertex = dead_end.back();
+                dead_end.pop_back();
+                if (live[vertex])
+                {
+                    fanning = vertex;
+                }
+            }
+            while (fanning == no_vertex && cursor != vertex_count)
+            {
+                if (live[cursor])
+                {
+                    fanning = u32(cursor);
+                }
+                ++cursor;
+            }
+        }
+
+        DEBUG_ASSERT(out == indices.size());
+    }
+
+    void optimize_overdraw(Span<u32> indices, Span<const Vertex> vertices,
+                           float threshold, u32 cache_size)
+    {
+        const size_t triangle_count = indices.size() / 3;
+        if (!triangle_count)
+        {
+            return;
+        }
+
+        FifoCache cache(vertices.size(), cache_size);
+
+        // Hard boundaries where the cache is flushed (every vertex misses)
+        std::vector<u32> hard_boundaries = { 0 };
+        for (size_t i = 0; i != triangle_count; ++i)
+        {
+            if (cache.add_triangle(&indices[3 * i]) == 3 && i)
+            {
+                hard_boundaries.push_back(u32(i));
+            }
+        }
+        hard_boundaries.push_back(u32(triangle_count));
+
+        // Split hard clusters further as soon as the ACMR of the cluster so
+        // far is close enough to the one of the whole hard cluster
+        std::vector<u32> clusters;
+        for (size_t c = 0; c + 1 != hard_boundaries.size(); ++c)
+        {
+            const u32 begin = hard_boundaries[c];
+            const u32 end = hard_boundaries[c + 1];
+
+            cache.clear();
+            u32 misses = 0;
+            for (u32 i = begin; i != end; ++i)
+            {
+                misses += cache.add_triangle(&indices[3 * i]);
+            }
+            const float cluster_threshold =
+                threshold * float(misses) / float(end - begin);
+
+            cache.clear();
+            clusters.push_back(begin);
+            u32 cluster_begin = begin;
+            misses = 0;
+            for (u32 i = begin; i != end; ++i)
+            {
+                misses += cache.add_triangle(&indices[3 * i]);
+                if (i + 1 != end
+                    && float(misses) / float(i + 1 - cluster_begin)
+                        <= cluster_threshold)
+                {
+                    clusters.push_back(i + 1);
+                    cluster_begin = i + 1;
+                    misses = 0;
+                    cache.clear();
+                }
+            }
+        }
+        clusters.push_back(u32(triangle_count));
+
+        // Area weighted centroids and normals
+        struct Cluster
+        {
+            u32 begin = 0;
+            u32 end = 0;
+            glm::vec3 centroid = glm::vec3(0.0f);
+            glm::vec3 normal = glm::vec3(0.0f);
+            float area = 0.0f;
+            float sort_key = 0.0f;
+        };
+
+        std::vector<Cluster> sorted(clusters.size() - 1);
+        glm::vec3 mesh_centroid = glm::vec3(0.0f);
+        float mesh_area = 0.0f;
+        for (size_t c = 0; c != sorted.size(); ++c)
+        {
+            Cluster &cluster = sorted[c];
+            cluster.begin = clusters[c];
+            cluster.end = clusters[c + 1];
+
+            for (u32 i = cluster.begin; i != cluster.end; ++i)
+            {
+                const glm::vec3 &p0 = vertices[indices[3 * i + 0]].position;
+                const glm::vec3 &p1 = vertices[indices[3 * i + 1]].position;
+                const glm::vec3 &p2 = vertices[indices[3 * i + 2]].position;
+                const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+                const float area = glm::length(normal);
+
+                cluster.centroid += (p0 + p1 + p2) * (area / 3.0f);
+                cluster.normal += normal;
+                cluster.area += area;
+            }
+
+            mesh_centroid += cluster.centroid;
+            mesh_area += cluster.area;
+        }
+
+        if (!(mesh_area > 0.0f))
+        {
+            return;
+        }
+        mesh_centroid /= mesh_area;
+
+        // Clusters facing away from the center are drawn first, they are the
+        // most likely to occlude the others
+        for (Cluster &cluster : sorted)
+        {
+            if (cluster.area > 0.0f)
+            {
+                const float length = glm::length(cluster.normal);
+                const glm::vec3 normal =
+                    length > 0.0f ? cluster.normal / length : glm::vec3(0.0f);
+                cluster.sort_key = glm::dot(
+                    cluster.centroid / cluster.area - mesh_centroid, normal);
+            }
+        }
+
+        std::stable_sort(sorted.begin(), sorted.end(),
+                         [](const Cluster &a, const Cluster &b) {
+                             return a.sort_key > b.sort_key;
+                         });
+
+        const std::vector<u32> source(indices.begin(), indices.end());
+        size_t out = 0;
+        for (const Cluster &cluster : sorted)
+        {
+            for (u32 i = 3 * cluster.begin; i != 3 * cluster.end; ++i)
+            {
+                indices[out++] = source[i];
+            }
+        }
+    }
+
+    void optimize_vertex_fetch(MeshData &mesh)
+    {
+        std::vector<u32> remap(mesh.vertices.size(), no_vertex);
+        u32 vertex_count = 0;
+        for (u32 &index : mesh.indices)
+        {
+            if (remap[index] == no_vertex)
+            {
+                remap[index] = vertex_count++;
+            }
+            index = remap[index];
+        }
+
+        std::vector<Vertex> vertices(vertex_count);
+        for (size_t i = 0; i != remap.size(); ++i)
+        {
+            if (remap[i] != no_vertex)
+            {
+                vertices[remap[i]] = mesh.vertices[i];
+            }
+        }
+        mesh.vertices = std::move(vertices);
+    }
+
+    bool optimize_mesh(MeshData &mesh, bool overdraw)
+    {
+        if (mesh.indices.empty() || mesh.indices.size() % 3)
+        {
+            return false;
+        }
+        for (const u32 index : mesh.indices)
+        {
+            if (index >= mesh.vertices.size())
+            {
+                return false;
+            }
+        }
+
+        // Levels of detail are drawn separately, optimize them one by one
+        std::vector<MeshLod> lods = mesh.lods;
+        if (lods.empty())
+        {
+            lods.push_back(MeshLod{ 0, u32(mesh.indices.size()), 0.0f });
+        }
+
+        for (const MeshLod &lod : lods)
+        {
+            const Span<u32> indices(mesh.indices.data() + lod.first_index,
+                                    lod.index_count);
+            optimize_vertex_cache(indices, mesh.vertices.size());
+            if (overdraw)
+            {
+                optimize_overdraw(indices, mesh.vertices);
+            }
+        }
+        optimize_vertex_fetch(mesh);
+
+        return true;
+    }
+
+} // namespace OM3D
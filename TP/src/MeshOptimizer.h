@@ -0,0 +1,54 @@
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include <StaticMesh.h>
+
+namespace OM3D
+{
+
+    // Size of the simulated post-transform vertex cache (FIFO)
+    static constexpr u32 default_vertex_cache_size = 16;
+
+    struct VertexCacheStats
+    {
+        u32 triangle_count = 0;
+        u32 vertex_count = 0; // Referenced vertices
+        u32 transformed_count = 0; // Cache misses
+
+        // Average cache miss ratio: transformed vertices per triangle, in
+        // [0.5; 3]
+        float acmr() const;
+
+        // Average transform to vertex ratio: transformed vertices per
+        // referenced vertex, 1 is ideal
+        float atvr() const;
+
+        void merge(const VertexCacheStats &other);
+    };
+
+    VertexCacheStats
+    analyze_vertex_cache(Span<const u32> indices, size_t vertex_count,
+                         u32 cache_size = default_vertex_cache_size);
+
+    // Reorders triangles for post-transform cache locality (Tipsify)
+    void optimize_vertex_cache(Span<u32> indices, size_t vertex_count,
+                               u32 cache_size = default_vertex_cache_size);
+
+    // Reorders clusters of triangles so that outward facing ones come first,
+    // which reduces overdraw from any view point. Triangles must already be
+    // cache optimized, their ACMR may grow by at most threshold.
+    void optimize_overdraw(Span<u32> indices, Span<const Vertex> vertices,
+                           float threshold = 1.05f,
+                           u32 cache_size = default_vertex_cache_size);
+
+    // Reorders vertices in the order they are first referenced, and removes
+    // unused ones
+    void optimize_vertex_fetch(MeshData &mesh);
+
+    // Runs all the passes above, in order, on every level of detail. Does
+    // nothing and returns false if the mesh is not a valid triangle list.
+    bool optimize_mesh(MeshData &mesh, bool overdraw);
+
+} // namespace OM3D
+
+#endif // MESHOPTIMIZER_H
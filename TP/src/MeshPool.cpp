@@ -0,0 +1,70 @@
+#include "MeshPool.h"
+
+namespace OM3D
+{
+
+    MeshPool::MeshPool(Span<const StaticMesh *const> meshes)
+    {
+        std::array<size_t, 2> vertex_counts = {};
+        size_t index_count = 0;
+        for (const StaticMesh *mesh : meshes)
+        {
+            if (_ranges.find(mesh) != _ranges.end())
+            {
+                continue;
+            }
+
+            MeshRange &range = _ranges[mesh];
+            range.first_index = u32(index_count);
+            range.index_count = u32(mesh->get_indices()->element_count());
+
+            size_t &vertex_count = vertex_counts[size_t(mesh->vertex_format())];
+            range.base_vertex = i32(vertex_count);
+
+            vertex_count += mesh->vertex_count();
+            index_count += range.index_count;
+        }
+
+        if (!index_count)
+        {
+            return;
+        }
+
+        for (size_t i = 0; i != _vertex_buffers.size(); ++i)
+        {
+            if (vertex_counts[i])
+            {
+                _vertex_buffers[i] = ByteBuffer(
+                    nullptr, vertex_counts[i] * vertex_size(VertexFormat(i)));
+            }
+        }
+        _index_buffer = TypedBuffer<u32>(nullptr, index_count);
+
+        // Copy on the GPU, the CPU side mesh data is long gone
+        for (const auto &[mesh, range] : _ranges)
+        {
+            const VertexFormat format = mesh->vertex_format();
+            mesh->get_vertices()->copy_to(
+                _vertex_buffers[size_t(format)],
+                range.base_vertex * vertex_size(format));
+            mesh->get_indices()->copy_to(_index_buffer,
+                                         range.first_index * sizeof(u32));
+        }
+    }
+
+    const MeshRange &MeshPool::range(const StaticMesh *mesh) const
+    {
+        const auto it = _ranges.find(mesh);
+        ALWAYS_ASSERT(it != _ranges.end(), "Mesh is not part of the pool");
+        return it->second;
+    }
+
+    void MeshPool::setup(VertexFormat format) const
+    {
+        _vertex_buffers[size_t(format)].bind(BufferUsage::Attribute);
+        _index_buffer.bind(BufferUsage::Index);
+
+        StaticMesh::setup_attributes(format);
+    }
+
+} // namespace OM3D
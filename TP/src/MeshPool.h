@@ -0,0 +1,45 @@
+#ifndef MESHPOOL_H
+#define MESHPOOL_H
+
+#include <StaticMesh.h>
+
+#include <array>
+#include <unordered_map>
+
+namespace OM3D
+{
+
+    struct MeshRange
+    {
+        u32 first_index = 0;
+        u32 index_count = 0;
+        i32 base_vertex = 0;
+    };
+
+    // Packs the vertices and indices of several static meshes into shared
+    // buffers, so they can all be drawn without rebinding any geometry.
+    // Meshes with different vertex formats go in separate vertex buffers,
+    // base_vertex is relative to the buffer of the mesh format.
+    class MeshPool : NonCopyable
+    {
+    public:
+        MeshPool() = default;
+        MeshPool(MeshPool &&) = default;
+        MeshPool &operator=(MeshPool &&) = default;
+
+        MeshPool(Span<const StaticMesh *const> meshes);
+
+        const MeshRange &range(const StaticMesh *mesh) const;
+
+        void setup(VertexFormat format) const;
+
+    private:
+        std::array<ByteBuffer, 2> _vertex_buffers;
+        TypedBuffer<u32> _index_buffer;
+
+        std::unordered_map<const StaticMesh *, MeshRange> _ranges;
+    };
+
+} // namespace OM3D
+
+#endif // MESHPOOL_H
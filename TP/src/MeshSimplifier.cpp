@@ -0,0 +1,464 @@
+#include "MeshSimplifier.h"
+
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+
+namespace OM3D
+{
+
+    static constexpr u32 no_vertex = u32(-1);
+    static constexpr u32 max_passes = 64;
+
+    // Border edges are kept in place by planes orthogonal to their face,
+    // weighted more than the faces themselves
+    static constexpr double border_weight = 10.0;
+
+    // Stop the LOD chain when a level has more than this ratio of the
+    // indices of the previous one
+    static constexpr float min_lod_reduction = 0.85f;
+
+    // Largest error allowed for a LOD, relative to the mesh size
+    static constexpr float max_lod_error = 0.1f;
+
+    // Sum of squared distances to planes, p^T A p + 2 b.p + c
+    struct Quadric
+    {
+        double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0,
+               a22 = 0.0;
+        double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+        double c = 0.0;
+        double weight = 0.0;
+
+        static Quadric from_plane(const glm::dvec3 &n, double d, double w)
+        {
+            Quadric q;
+            q.a00 = n.x * n.x * w;
+            q.a01 = n.x * n.y * w;
+            q.a02 = n.x * n.z * w;
+            q.a11 = n.y * n.y * w;
+            q.a12 = n.y * n.z * w;
+            q.a22 = n.z * n.z * w;
+            q.b0 = n.x * d * w;
+            q.b1 = n.y * d * w;
+            q.b2 = n.z * d * w;
+            q.c = d * d * w;
+            q.weight = w;
+            return q;
+        }
+
+        void add(const Quadric &q)
+        {
+            a00 += q.a00;
+            a01 += q.a01;
+            a02 += q.a02;
+            a11 += q.a11;
+            a12 += q.a12;
+            a22 += q.a22;
+            b0 += q.b0;
+            b1 += q.b1;
+            b2 += q.b2;
+            c += q.c;
+            weight += q.weight;
+        }
+
+        // Weighted average of the squared distances
+        double error(const glm::vec3 &point) const
+        {
+            const double x = point.x;
+            const double y = point.y;
+            const double z = point.z;
+            const double e = a00 * x * x + a11 * y * y + a22 * z * z
+                + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+                + 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+            return weight > 0.0 ? std::max(e, 0.0) / weight : 0.0;
+        }
+    };
+
+    static u64 edge_key(u32 a, u32 b)
+    {
+        return a < b ? (u64(a) << 32) | b : (u64(b) << 32) | a;
+    }
+
+    // Vertices sharing a position are welded, so attribute seams do not
+    // open holes. Returns the first vertex of each position.
+    static std::vector<u32> weld_positions(Span<const Vertex> vertices)
+    {
+        struct PositionHash
+        {
+            size_t operator()(const glm::vec3 &p) const
+            {
+                u32 bits[3] = {};
+                std::memcpy(bits, &p, sizeof(bits));
+                return size_t(bits[0] * 73856093u ^ bits[1] * 19349663u
+                              ^ bits[2] * 83492791u);
+            }
+        };
+
+        std::unordered_map<glm::vec3, u32, PositionHash> positions;
+        positions.reserve(vertices.size());
+
+        std::vector<u32> welded(vertices.size());
+        for (size_t i = 0; i != vertices.size(); ++i)
+        {
+            welded[i] =
+                positions.emplace(vertices[i].position, u32(i)).first->second;
+        }
+        return welded;
+    }
+
+    std::vector<u32> simplify_mesh(Span<const Vertex> vertices,
+                                   Span<const u32> indices,
+                                   size_t target_index_count, float max_error,
+                                   float *error)
+    {
+        std::vector<u32> result(indices.begin(), indices.end());
+        double max_cost = 0.0;
+
+        const size_t vertex_count = vertices.size();
+        const std::vector<u32> welded = weld_positions(vertices);
+        auto position = [&](u32 vertex) -> const glm::vec3 & {
+            return vertices[vertex].position;
+        };
+
+        // Position level edges, used once by border edges and more than
+        // twice by non-manifold ones
+        std::unordered_map<u64, u32> edges;
+        auto count_edges = [&] {
+            edges.clear();
+            for (size_t i = 0; i != result.size(); i += 3)
+            {
+                for (u32 k = 0; k != 3; ++k)
+                {
+                    ++edges[edge_key(welded[result[i + k]],
+                                     welded[result[i + (k + 1) % 3]])];
+                }
+            }
+        };
+
+        // Quadrics of the original surface, per position
+        std::vector<Quadric> quadrics(vertex_count);
+        count_edges();
+        for (size_t i = 0; i != result.size(); i += 3)
+        {
+            const glm::dvec3 p[] = { position(result[i + 0]),
+                                     position(result[i + 1]),
+                                     position(result[i + 2]) };
+            const glm::dvec3 cross = glm::cross(p[1] - p[0], p[2] - p[0]);
+            const double area = glm::length(cross);
+            if (!(area > 0.0))
+            {
+                continue;
+            }
+
+            const glm::dvec3 normal = cross / area;
+            const Quadric face =
+                Quadric::from_plane(normal, -glm::dot(normal, p[0]), area);
+            for (u32 k = 0; k != 3; ++k)
+            {
+                quadrics[welded[result[i + k]]].add(face);
+            }
+
+            for (u32 k = 0; k != 3; ++k)
+            {
+                const u32 a = welded[result[i + k]];
+                const u32 b = welded[result[i + (k + 1) % 3]];
+                if (edges[edge_key(a, b)] != 1)
+                {
+                    continue;
+                }
+
+                const glm::dvec3 edge = p[(k + 1) % 3] - p[k];
+                const double length = glm::length(edge);
+                if (!(length > 0.0))
+                {
+                    continue;
+                }
+
+                const glm::dvec3 plane_normal =
+                    glm::normalize(glm::cross(edge, normal));
+                const Quadric border = Quadric::from_plane(
+                    plane_normal, -glm::dot(plane_normal, p[k]),
+                    length * length * border_weight);
+                quadrics[a].add(border);
+                quadrics[b].add(border);
+            }
+        }
+
+        struct Collapse
+        {
+            u32 from = 0;
+            u32 to = 0;
+            double cost = 0.0;
+        };
+
+        std::vector<u8> flags(vertex_count);
+        std::vector<u32> position_vertex(vertex_count);
+        std::vector<u32> offsets(vertex_count + 1);
+        std::vector<u32> adjacency;
+        std::vector<u32> remap(vertex_count);
+        std::vector<bool> touched(vertex_count);
+        std::vector<Collapse> collapses;
+
+        enum : u8
+        {
+            Referenced = 1,
+            Border = 2,
+            Locked = 4,
+        };
+
+        const double max_cost_allowed = double(max_error) * double(max_error);
+
+        for (u32 pass = 0; pass != max_passes; ++pass)
+        {
+            if (result.size() <= target_index_count)
+            {
+                break;
+            }
+
+            if (pass)
+            {
+                count_edges();
+            }
+
+            // Classify positions: seams (several vertices at the same
+            // position) and non-manifold ones are never moved
+            std::fill(flags.begin(), flags.end(), u8(0));
+            for (const u32 vertex : result)
+            {
+                const u32 p = welded[vertex];
+                if (!(flags[p] & Referenced))
+                {
+                    flags[p] |= Referenced;
+                    position_vertex[p] = vertex;
+                }
+                else if (position_vertex[p] != vertex)
+                {
+                    flags[p] |= Locked;
+                }
+            }
+            for (const auto &[key, count] : edges)
+            {
+                const u32 a = u32(key >> 32);
+                const u32 b = u32(key);
+                const u8 flag = count == 1 ? Border : count > 2 ? Locked : 0;
+                flags[a] |= flag;
+                flags[b] |= flag;
+            }
+
+            // Triangles around each vertex
+            std::fill(offsets.begin(), offsets.end(), 0);
+            for (const u32 vertex : result)
+            {
+                ++offsets[vertex + 1];
+            }
+            std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+            adjacency.resize(result.size());
+            {
+                std::vector<u32> fill(offsets.begin(), offsets.end() - 1);
+                for (size_t i = 0; i != result.size(); ++i)
+                {
+                    adjacency[fill[result[i]]++] = u32(i / 3);
+                }
+            }
+
+            // Every valid half edge collapse, cheapest first
+            collapses.clear();
+            for (size_t i = 0; i != result.size(); i += 3)
+            {
+                for (u32 k = 0; k != 3; ++k)
+                {
+                    const u32 from = result[i + k];
+                    const u32 to = result[i + (k + 1) % 3];
+                    const u32 pf = welded[from];
+                    const u32 pt = welded[to];
+                    if (pf == pt)
+                    {
+                        continue;
+                    }
+
+                    const bool border_edge = edges[edge_key(pf, pt)] == 1;
+                    auto try_collapse = [&](u32 a, u32 b, u32 pa, u32 pb) {
+                        if ((flags[pa] & Locked)
+                            || ((flags[pa] & Border) && !border_edge))
+                        {
+                            return;
+                        }
+
+                        Quadric quadric = quadrics[pa];
+                        quadric.add(quadrics[pb]);
+                        const double cost = quadric.error(position(b));
+                        if (cost <= max_cost_allowed)
+                        {
+                            collapses.push_back(Collapse{ a, b, cost });
+                        }
+                    };
+                    try_collapse(from, to, pf, pt);
+                    try_collapse(to, from, pt, pf);
+                }
+            }
+
+            if (collapses.empty())
+            {
+                break;
+            }
+
+            std::sort(collapses.begin(), collapses.end(),
+                      [](const Collapse &a, const Collapse &b) {
+                          return a.cost < b.cost;
+                      });
+
+            // Apply as many independent collapses as needed: a collapse
+            // changes the triangles around its source, so none of their
+            // vertices can be part of another collapse in this pass
+            std::iota(remap.begin(), remap.end(), 0);
+            std::fill(touched.begin(), touched.end(), false);
+
+            const size_t triangles_to_remove =
+                (result.size() - target_index_count + 2) / 3;
+            size_t removed = 0;
+            for (const Collapse &collapse : collapses)
+            {
+                if (removed >= triangles_to_remove)
+                {
+                    break;
+                }
+
+                const u32 pf = welded[collapse.from];
+                const u32 pt = welded[collapse.to];
+                if (touched[pf] || touched[pt])
+                {
+                    continue;
+                }
+
+                // Reject collapses that flip a triangle
+                bool flips = false;
+                u32 degenerate = 0;
+                const glm::vec3 &target = position(collapse.to);
+                for (u32 a = offsets[collapse.from];
+                     a != offsets[collapse.from + 1] && !flips; ++a)
+                {
+                    const u32 *triangle = &result[3 * adjacency[a]];
+                    if (welded[triangle[0]] == pt || welded[triangle[1]] == pt
+                        || welded[triangle[2]] == pt)
+                    {
+                        ++degenerate;
+                        continue;
+                    }
+
+                    glm::vec3 p[3];
+                    glm::vec3 moved[3];
+                    for (u32 k = 0; k != 3; ++k)
+                    {
+                        p[k] = position(triangle[k]);
+                        moved[k] = triangle[k] == collapse.from ? target : p[k];
+                    }
+                    const glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                    const glm::vec3 after =
+                        glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+                    flips = glm::dot(before, after) <= 0.0f;
+                }
+
+                if (flips)
+                {
+                    continue;
+                }
+
+                for (u32 a = offsets[collapse.from];
+                     a != offsets[collapse.from + 1]; ++a)
+                {
+                    const u32 *triangle = &result[3 * adjacency[a]];
+                    for (u32 k = 0; k != 3; ++k)
+                    {
+                        touched[welded[triangle[k]]] = true;
+                    }
+                }
+
+                remap[collapse.from] = collapse.to;
+                quadrics[pt].add(quadrics[pf]);
+                max_cost = std::max(max_cost, collapse.cost);
+                removed += degenerate;
+            }
+
+            if (!removed)
+            {
+                break;
+            }
+
+            // Remove the triangles that collapsed
+            size_t out = 0;
+            for (size_t i = 0; i != result.size(); i += 3)
+            {
+                const u32 a = remap[result[i + 0]];
+                const u32 b = remap[result[i + 1]];
+                const u32 c = remap[result[i + 2]];
+                if (welded[a] != welded[b] && welded[b] != welded[c]
+                    && welded[c] != welded[a])
+                {
+                    result[out++] = a;
+                    result[out++] = b;
+                    result[out++] = c;
+                }
+            }
+            result.resize(out);
+        }
+
+        if (error)
+        {
+            *error = float(std::sqrt(max_cost));
+        }
+        return result;
+    }
+
+    void generate_lods(MeshData &mesh, u32 lod_count)
+    {
+        lod_count = std::min(lod_count, max_lod_count);
+        if (lod_count <= 1 || mesh.indices.empty())
+        {
+            return;
+        }
+
+        AABB bounds;
+        for (const Vertex &vertex : mesh.vertices)
+        {
+            bounds.extend(vertex.position);
+        }
+        const float max_error = glm::length(bounds.extent()) * max_lod_error;
+
+        mesh.lods = { MeshLod{ 0, u32(mesh.indices.size()), 0.0f } };
+
+        // Each level is simplified from the previous one, so their errors
+        // add up
+        std::vector<u32> previous = mesh.indices;
+        float error = 0.0f;
+        for (u32 i = 1; i != lod_count; ++i)
+        {
+            const size_t target = previous.size() / 6 * 3;
+
+            float lod_error = 0.0f;
+            std::vector<u32> lod = simplify_mesh(
+                mesh.vertices, previous, target, max_error - error, &lod_error);
+            if (lod.empty()
+                || float(lod.size()) > float(previous.size()) * min_lod_reduction)
+            {
+                break;
+            }
+
+            error += lod_error;
+            mesh.lods.push_back(
+                MeshLod{ u32(mesh.indices.size()), u32(lod.size()), error });
+            mesh.indices.insert(mesh.indices.end(), lod.begin(), lod.end());
+            previous = std::move(lod);
+        }
+
+        if (mesh.lods.size() == 1)
+        {
+            mesh.lods.clear();
+        }
+    }
+
+} // namespace OM3D
@@ -0,0 +1,26 @@
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <StaticMesh.h>
+
+namespace OM3D
+{
+
+    // Simplifies a triangle list with quadric error edge collapses, until at
+    // most target_index_count indices are left or any further collapse would
+    // move the surface by more than max_error. Vertices are never moved, the
+    // result references a subset of the input vertices. error receives the
+    // largest error introduced, in object space units.
+    std::vector<u32> simplify_mesh(Span<const Vertex> vertices,
+                                   Span<const u32> indices,
+                                   size_t target_index_count, float max_error,
+                                   float *error = nullptr);
+
+    // Appends up to lod_count - 1 simplified levels to mesh.indices, each with
+    // about half the triangles of the previous one, and fills mesh.lods. The
+    // chain stops early once a mesh can not be simplified further.
+    void generate_lods(MeshData &mesh, u32 lod_count);
+
+} // namespace OM3D
+
+#endif // MESHSIMPLIFIER_H
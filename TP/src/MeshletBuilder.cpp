@@ -0,0 +1,134 @@
+#include "MeshletBuilder.h"
+
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace OM3D
+{
+
+    // Cones wider than this (the minimum cosine between the axis and a
+    // triangle normal) can almost never be culled, they are disabled
+    static constexpr float min_cone_cosine = 0.1f;
+
+    Meshlet compute_meshlet(Span<const Vertex> vertices, Span<const u32> indices)
+    {
+        const MeshBounds bounds = compute_bounds(vertices, indices);
+
+        Meshlet meshlet;
+        meshlet.index_count = u32(indices.size());
+        meshlet.center = bounds.sphere.center;
+        meshlet.radius = bounds.sphere.radius;
+
+        // Degenerate triangles have no orientation, they are ignored
+        std::vector<glm::vec3> normals;
+        glm::vec3 axis = glm::vec3(0.0f);
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            const glm::vec3 &p0 = vertices[indices[i + 0]].position;
+            const glm::vec3 &p1 = vertices[indices[i + 1]].position;
+            const glm::vec3 &p2 = vertices[indices[i + 2]].position;
+            const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            const float length = glm::length(normal);
+            if (length > 0.0f)
+            {
+                normals.push_back(normal / length);
+                axis += normals.back();
+            }
+        }
+
+        const float axis_length = glm::length(axis);
+        if (normals.empty() || !(axis_length > 0.0f))
+        {
+            return meshlet;
+        }
+        axis /= axis_length;
+
+        float min_cosine = 1.0f;
+        for (const glm::vec3 &normal : normals)
+        {
+            min_cosine = std::min(min_cosine, glm::dot(axis, normal));
+        }
+        if (min_cosine <= min_cone_cosine)
+        {
+            return meshlet;
+        }
+
+        // Back facing if the view direction is within 90 degrees minus the
+        // cone half angle of the axis
+        meshlet.cone_axis = axis;
+        meshlet.cone_cutoff = std::sqrt(1.0f - min_cosine * min_cosine);
+        return meshlet;
+    }
+
+    void build_meshlets(MeshData &mesh, u32 max_vertices, u32 max_triangles)
+    {
+        mesh.meshlets.clear();
+
+        const u32 first_index = mesh.lods.empty() ? 0 : mesh.lods[0].first_index;
+        const u32 end_index = mesh.lods.empty()
+            ? u32(mesh.indices.size())
+            : first_index + mesh.lods[0].index_count;
+        if ((end_index - first_index) % 3 || !max_vertices || !max_triangles)
+        {
+            return;
+        }
+
+        // Vertices are tagged with the meshlet that last referenced them
+        std::vector<u32> owners(mesh.vertices.size(), u32(-1));
+
+        // Vertices of triangle i not referenced by the current meshlet yet
+        auto new_vertex_count = [&](u32 i) {
+            const u32 *triangle = &mesh.indices[i];
+            const u32 current = u32(mesh.meshlets.size());
+            u32 count = 0;
+            for (u32 k = 0; k != 3; ++k)
+            {
+                const bool repeated = (k > 0 && triangle[0] == triangle[k])
+                                   || (k > 1 && triangle[1] == triangle[k]);
+                if (!repeated && owners[triangle[k]] != current)
+                {
+                    ++count;
+                }
+            }
+            return count;
+        };
+
+        auto add_meshlet = [&](u32 begin, u32 end) {
+            Meshlet meshlet = compute_meshlet(
+                mesh.vertices,
+                Span<const u32>(mesh.indices.data() + begin, end - begin));
+            meshlet.first_index = begin;
+            mesh.meshlets.push_back(meshlet);
+        };
+
+        u32 begin = first_index;
+        u32 vertex_count = 0;
+        for (u32 i = first_index; i != end_index; i += 3)
+        {
+            u32 new_vertices = new_vertex_count(i);
+            if (i != begin
+                && (vertex_count + new_vertices > max_vertices
+                    || (i - begin) / 3 == max_triangles))
+            {
+                add_meshlet(begin, i);
+                begin = i;
+                vertex_count = 0;
+                new_vertices = new_vertex_count(i);
+            }
+
+            for (u32 k = 0; k != 3; ++k)
+            {
+                owners[mesh.indices[i + k]] = u32(mesh.meshlets.size());
+            }
+            vertex_count += new_vertices;
+        }
+
+        if (begin != end_index)
+        {
+            add_meshlet(begin, end_index);
+        }
+    }
+
+} // namespace OM3D
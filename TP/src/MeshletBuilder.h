@@ -0,0 +1,24 @@
+#ifndef MESHLETBUILDER_H
+#define MESHLETBUILDER_H
+
+#include <StaticMesh.h>
+
+namespace OM3D
+{
+
+    static constexpr u32 max_meshlet_vertices = 64;
+    static constexpr u32 max_meshlet_triangles = 124;
+
+    // Splits the full detail level of mesh into meshlets of consecutive
+    // triangles, so the index buffer order (ideally vertex cache optimized)
+    // is kept. A meshlet ends once it would reference more than max_vertices
+    // vertices or hold more than max_triangles triangles.
+    void build_meshlets(MeshData &mesh, u32 max_vertices = max_meshlet_vertices,
+                        u32 max_triangles = max_meshlet_triangles);
+
+    // Bounding sphere and normal cone of the triangles in indices
+    Meshlet compute_meshlet(Span<const Vertex> vertices, Span<const u32> indices);
+
+} // namespace OM3D
+
+#endif // MESHLETBUILDER_H
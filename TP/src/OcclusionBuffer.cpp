@@ -0,0 +1,295 @@
+#include "OcclusionBuffer.h"
+
+#include <ThreadPool.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace OM3D
+{
+
+    // Closer to the camera plane, projected positions are too imprecise
+    static constexpr float min_w = 1e-6f;
+
+    OcclusionBuffer::OcclusionBuffer(const glm::uvec2 &size)
+    {
+        _tile_count = (glm::max(size, glm::uvec2(1)) + tile_size - 1u)
+            / tile_size;
+        _size = _tile_count * tile_size;
+        _depth.resize(size_t(_size.x) * _size.y, 0.0f);
+        _tile_depth.resize(size_t(_tile_count.x) * _tile_count.y, 0.0f);
+    }
+
+    void OcclusionBuffer::clear(const glm::mat4 &view_proj)
+    {
+        _view_proj = view_proj;
+        std::fill(_depth.begin(), _depth.end(), 0.0f);
+        std::fill(_tile_depth.begin(), _tile_depth.end(), 0.0f);
+        _triangles.clear();
+    }
+
+    void OcclusionBuffer::add_occluder(const OccluderMesh &mesh,
+                                       const glm::mat4 &transform)
+    {
+        const glm::mat4 mvp = _view_proj * transform;
+        const glm::vec2 half_size = glm::vec2(_size) * 0.5f;
+
+        // w is 0 for vertices behind the camera
+        _screen_positions.resize(mesh.positions.size());
+        for (size_t i = 0; i != mesh.positions.size(); ++i)
+        {
+            const glm::vec4 clip = mvp * glm::vec4(mesh.positions[i], 1.0f);
+            if (clip.w > min_w)
+            {
+                const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+                _screen_positions[i] = glm::vec4(
+                    (glm::vec2(ndc) + 1.0f) * half_size, ndc.z, 1.0f);
+            }
+            else
+            {
+                _screen_positions[i] = glm::vec4(0.0f);
+            }
+        }
+
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+        {
+            const glm::vec4 &a = _screen_positions[mesh.indices[i + 0]];
+            const glm::vec4 &b = _screen_positions[mesh.indices[i + 1]];
+            const glm::vec4 &c = _screen_positions[mesh.indices[i + 2]];
+            if (a.w == 0.0f || b.w == 0.0f || c.w == 0.0f)
+            {
+                continue;
+            }
+
+            // Faces are culled on their screen winding, like on the GPU. Back
+            // facing and degenerate triangles hide nothing more.
+            const glm::vec2 e1 = glm::vec2(b) - glm::vec2(a);
+            const glm::vec2 e2 = glm::vec2(c) - glm::vec2(a);
+            const float area = e1.x * e2.y - e1.y * e2.x;
+            if (!(area > 0.0f))
+            {
+                continue;
+            }
+
+            // Pixels whose center may be covered
+            const glm::vec2 min_pos = glm::min(glm::min(glm::vec2(a),
+                                                        glm::vec2(b)),
+                                               glm::vec2(c));
+            const glm::vec2 max_pos = glm::max(glm::max(glm::vec2(a),
+                                                        glm::vec2(b)),
+                                               glm::vec2(c));
+            const glm::vec2 first = glm::ceil(min_pos - 0.5f);
+            const glm::vec2 last = glm::floor(max_pos - 0.5f);
+            if (last.x < 0.0f || last.y < 0.0f || first.x >= float(_size.x)
+                || first.y >= float(_size.y) || first.x > last.x
+                || first.y > last.y)
+            {
+                continue;
+            }
+
+            Triangle triangle;
+            triangle.p0 = glm::vec2(a);
+            triangle.p1 = glm::vec2(b);
+            triangle.p2 = glm::vec2(c);
+
+            // Depth is affine in screen space
+            const float dz1 = b.z - a.z;
+            const float dz2 = c.z - a.z;
+            triangle.z0 = a.z;
+            triangle.dzdx = (dz1 * e2.y - dz2 * e1.y) / area;
+            triangle.dzdy = (dz2 * e1.x - dz1 * e2.x) / area;
+            triangle.min_z = std::min({ a.z, b.z, c.z });
+
+            triangle.min_pixel = glm::uvec2(glm::max(first, glm::vec2(0.0f)));
+            triangle.max_pixel = glm::uvec2(
+                glm::min(last, glm::vec2(_size) - 1.0f));
+            _triangles.push_back(triangle);
+        }
+    }
+
+    void OcclusionBuffer::rasterize(bool multithreaded)
+    {
+        if (multithreaded)
+        {
+            ThreadPool::global().parallel_for(_tile_count.y, [&](size_t row) {
+                rasterize_band(u32(row), u32(row + 1));
+            });
+        }
+        else
+        {
+            rasterize_band(0, _tile_count.y);
+        }
+    }
+
+    void OcclusionBuffer::rasterize_band(u32 first_tile_row, u32 end_tile_row)
+    {
+        const u32 first_y = first_tile_row * tile_size;
+        const u32 end_y = end_tile_row * tile_size;
+
+        for (const Triangle &triangle : _triangles)
+        {
+            if (triangle.max_pixel.y < first_y || triangle.min_pixel.y >= end_y)
+            {
+                continue;
+            }
+
+            // Edge functions are positive inside, and linear along a row
+            const glm::vec2 p[] = { triangle.p0, triangle.p1, triangle.p2 };
+
+            // Lowest depth over the pixel footprint, so partially covered
+            // pixels are not moved closer than the triangle
+            const float z_margin =
+                0.5f * (std::abs(triangle.dzdx) + std::abs(triangle.dzdy));
+
+            const u32 y_begin = std::max(triangle.min_pixel.y, first_y);
+            const u32 y_end = std::min(triangle.max_pixel.y + 1, end_y);
+            for (u32 y = y_begin; y != y_end; ++y)
+            {
+                const float py = float(y) + 0.5f;
+
+                float edge_base[3];
+                float edge_step[3];
+                for (u32 k = 0; k != 3; ++k)
+                {
+                    const glm::vec2 &from = p[k];
+                    const glm::vec2 &to = p[(k + 1) % 3];
+                    edge_step[k] = from.y - to.y;
+                    edge_base[k] = (to.x - from.x) * (py - from.y)
+                                 - edge_step[k] * from.x;
+                }
+                const float z_base = triangle.z0
+                    + triangle.dzdy * (py - triangle.p0.y)
+                    - triangle.dzdx * triangle.p0.x - z_margin;
+
+                const u32 first_tile = triangle.min_pixel.x / tile_size;
+                const u32 last_tile = triangle.max_pixel.x / tile_size;
+                for (u32 tile = first_tile; tile <= last_tile; ++tile)
+                {
+                    float *row = &_depth[pixel_index(tile * tile_size, y)];
+                    const float x0 = float(tile * tile_size) + 0.5f;
+
+                    // Branchless so the compiler can vectorize it
+                    for (u32 i = 0; i != tile_size; ++i)
+                    {
+                        const float px = x0 + float(i);
+                        const float e0 = edge_base[0] + edge_step[0] * px;
+                        const float e1 = edge_base[1] + edge_step[1] * px;
+                        const float e2 = edge_base[2] + edge_step[2] * px;
+                        const float z = std::max(
+                            z_base + triangle.dzdx * px, triangle.min_z);
+                        const bool inside =
+                            (e0 >= 0.0f) & (e1 >= 0.0f) & (e2 >= 0.0f);
+                        row[i] = inside ? std::max(row[i], z) : row[i];
+                    }
+                }
+            }
+        }
+
+        // Farthest depth of every tile of the band
+        const size_t pixels_per_tile = tile_size * tile_size;
+        for (u32 ty = first_tile_row; ty != end_tile_row; ++ty)
+        {
+            for (u32 tx = 0; tx != _tile_count.x; ++tx)
+            {
+                const size_t tile = size_t(ty) * _tile_count.x + tx;
+                const float *pixels = &_depth[tile * pixels_per_tile];
+                _tile_depth[tile] =
+                    *std::min_element(pixels, pixels + pixels_per_tile);
+            }
+        }
+    }
+
+    bool OcclusionBuffer::is_visible(const AABB &box) const
+    {
+        const glm::vec2 half_size = glm::vec2(_size) * 0.5f;
+
+        // Screen rectangle and nearest depth of the corners
+        glm::vec2 min_pos = glm::vec2(std::numeric_limits<float>::max());
+        glm::vec2 max_pos = -min_pos;
+        float max_z = 0.0f;
+        for (u32 i = 0; i != 8; ++i)
+        {
+            const glm::vec3 corner = glm::vec3(i & 1 ? box.max.x : box.min.x,
+                                               i & 2 ? box.max.y : box.min.y,
+                                               i & 4 ? box.max.z : box.min.z);
+            const glm::vec4 clip = _view_proj * glm::vec4(corner, 1.0f);
+            if (!(clip.w > min_w))
+            {
+                return true;
+            }
+
+            const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            const glm::vec2 pos = (glm::vec2(ndc) + 1.0f) * half_size;
+            min_pos = glm::min(min_pos, pos);
+            max_pos = glm::max(max_pos, pos);
+            max_z = std::max(max_z, ndc.z);
+        }
+
+        // Every pixel the rectangle touches, plus a one pixel border since
+        // occluders only cover the pixels whose center they contain. Off
+        // screen parts are left to frustum culling.
+        if (max_pos.x < 0.0f || max_pos.y < 0.0f
+            || min_pos.x >= float(_size.x) || min_pos.y >= float(_size.y))
+        {
+            return true;
+        }
+        const glm::uvec2 first = glm::uvec2(
+            glm::max(glm::floor(min_pos) - 1.0f, glm::vec2(0.0f)));
+        const glm::uvec2 last = glm::uvec2(
+            glm::min(glm::floor(max_pos) + 1.0f, glm::vec2(_size) - 1.0f));
+
+        for (u32 ty = first.y / tile_size; ty <= last.y / tile_size; ++ty)
+        {
+            for (u32 tx = first.x / tile_size; tx <= last.x / tile_size; ++tx)
+            {
+                if (max_z < _tile_depth[size_t(ty) * _tile_count.x + tx])
+                {
+                    continue;
+                }
+
+                const glm::uvec2 tile_first = glm::max(
+                    first, glm::uvec2(tx, ty) * tile_size);
+                const glm::uvec2 tile_last = glm::min(
+                    last, glm::uvec2(tx, ty) * tile_size + (tile_size - 1));
+                for (u32 y = tile_first.y; y <= tile_last.y; ++y)
+                {
+                    for (u32 x = tile_first.x; x <= tile_last.x; ++x)
+                    {
+                        if (max_z >= _depth[pixel_index(x, y)])
+                        {
+                            return true;
+                        }
+                    }
+                }
+            }
+        }
+
+        return false;
+    }
+
+    const glm::uvec2 &OcclusionBuffer::size() const
+    {
+        return _size;
+    }
+
+    size_t OcclusionBuffer::triangle_count() const
+    {
+        return _triangles.size();
+    }
+
+    float OcclusionBuffer::depth(u32 x, u32 y) const
+    {
+        DEBUG_ASSERT(x < _size.x && y < _size.y);
+        return _depth[pixel_index(x, y)];
+    }
+
+    size_t OcclusionBuffer::pixel_index(u32 x, u32 y) const
+    {
+        const size_t tile =
+            size_t(y / tile_size) * _tile_count.x + x / tile_size;
+        return tile * tile_size * tile_size + (y % tile_size) * tile_size
+             + x % tile_size;
+    }
+
+} // namespace OM3D
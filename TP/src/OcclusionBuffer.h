@@ -0,0 +1,88 @@
+#ifndef OCCLUSIONBUFFER_H
+#define OCCLUSIONBUFFER_H
+
+#include <Bounds.h>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <vector>
+
+namespace OM3D
+{
+
+    // Triangles an object hides the scene with, usually a coarse LOD of its
+    // mesh. Positions are in object space.
+    struct OccluderMesh
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<u32> indices;
+    };
+
+    // Low resolution depth buffer rasterized on the CPU from a few large
+    // occluders, used to reject hidden objects before they are drawn. Depth
+    // is reversed like on the GPU (1 is near, 0 is far). Pixels are stored
+    // in tiles of tile_size x tile_size, rows of a tile are processed 8
+    // pixels at a time, and every tile keeps its farthest depth so most
+    // tests never look at pixels.
+    class OcclusionBuffer
+    {
+    public:
+        static constexpr u32 tile_size = 8;
+
+        // Rounded up to a multiple of tile_size
+        OcclusionBuffer(const glm::uvec2 &size = glm::uvec2(256, 128));
+
+        // Clears to the far plane and sets the projection used by the
+        // occluders and the tests
+        void clear(const glm::mat4 &view_proj);
+
+        // Transforms and sets up the front facing triangles of an occluder.
+        // Triangles behind the camera are skipped, so what is rasterized
+        // never hides more than the occluder itself.
+        void add_occluder(const OccluderMesh &mesh, const glm::mat4 &transform);
+
+        // Rasterizes the triangles added since clear(). The buffer is split
+        // in bands of tile rows, rasterized in parallel on the global thread
+        // pool if multithreaded is set.
+        void rasterize(bool multithreaded = false);
+
+        // False if the box is entirely behind the rasterized occluders.
+        // Boxes crossing the camera plane are always visible.
+        bool is_visible(const AABB &box) const;
+
+        const glm::uvec2 &size() const;
+        size_t triangle_count() const;
+
+        float depth(u32 x, u32 y) const;
+
+    private:
+        // Screen space triangle, with its depth plane
+        struct Triangle
+        {
+            glm::vec2 p0;
+            glm::vec2 p1;
+            glm::vec2 p2;
+            float z0 = 0.0f;
+            float dzdx = 0.0f;
+            float dzdy = 0.0f;
+            float min_z = 0.0f;
+            glm::uvec2 min_pixel = {};
+            glm::uvec2 max_pixel = {};
+        };
+
+        size_t pixel_index(u32 x, u32 y) const;
+        void rasterize_band(u32 first_tile_row, u32 end_tile_row);
+
+        glm::uvec2 _size = {};
+        glm::uvec2 _tile_count = {};
+        glm::mat4 _view_proj = glm::mat4(1.0f);
+
+        std::vector<float> _depth;
+        std::vector<float> _tile_depth;
+        std::vector<Triangle> _triangles;
+        std::vector<glm::vec4> _screen_positions;
+    };
+
+} // namespace OM3D
+
+#endif // OCCLUSIONBUFFER_H
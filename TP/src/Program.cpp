@@ -1,7 +1,12 @@
 #include "Program.h"
 
+#include <ProgramCache.h>
+#include <ThreadPool.h>
+
 #include <algorithm>
+#include <atomic>
 #include <glad/glad.h>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -111,16 +116,13 @@ namespace OM3D
         return shader;
     }
 
-    static GLuint create_shader(const std::string &src, GLenum type)
-    {
-        const GLuint handle = glCreateShader(type);
-
-        const int len = int(src.size());
-        const char *c_str = src.c_str();
-
-        glShaderSource(handle, 1, &c_str, &len);
-        glCompileShader(handle);
+    // glad is generated without GL_KHR_parallel_shader_compile
+#ifndef GL_COMPLETION_STATUS_KHR
+#    define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
 
+    static void check_shader(GLuint handle)
+    {
         int res = 0;
         glGetShaderiv(handle, GL_COMPILE_STATUS, &res);
         if (!res)
@@ -130,14 +132,10 @@ namespace OM3D
             glGetShaderInfoLog(handle, sizeof(log), &len, log);
             FATAL(log);
         }
-
-        return handle;
     }
 
-    static void link_program(GLuint handle)
+    static void check_program(GLuint handle)
     {
-        glLinkProgram(handle);
-
         int res = 0;
         glGetProgramiv(handle, GL_LINK_STATUS, &res);
         if (!res)
@@ -149,38 +147,234 @@ namespace OM3D
         }
     }
 
-    Program::Program(const std::string &frag, const std::string &vert)
-        : _handle(glCreateProgram())
+    struct Program::PendingBuild
     {
-        const GLuint vert_handle = create_shader(vert, GL_VERTEX_SHADER);
-        const GLuint frag_handle = create_shader(frag, GL_FRAGMENT_SHADER);
+        enum State : u32
+        {
+            Queued,
+            Preprocessing,
+            Preprocessed,
+        };
 
-        glAttachShader(_handle.get(), vert_handle);
-        glAttachShader(_handle.get(), frag_handle);
+        // Stage types and source files, vertex first for graphics programs,
+        // the order is part of the cache key
+        std::vector<GLenum> types;
+        std::vector<std::string> files;
+        std::vector<std::string> defines;
 
-        link_program(_handle.get());
+        // Written by whoever moves the state out of Queued
+        std::atomic<u32> state = Queued;
+        std::vector<std::string> sources;
 
-        glDeleteShader(vert_handle);
-        glDeleteShader(frag_handle);
+        std::vector<GLuint> shaders;
+        u64 source_hash = 0;
+        bool linking = false;
 
-        fetch_uniform_locations();
+        // Spent on the context thread so far
+        double build_ms = 0.0;
+
+        // When the program was requested, for the time until it is ready
+        double request_time = program_time();
+
+        // Returns false if another thread got to it first
+        bool preprocess()
+        {
+            u32 expected = Queued;
+            if (!state.compare_exchange_strong(expected, Preprocessing))
+            {
+                return false;
+            }
+
+            PROFILE_ZONE("Shader preprocessing");
+            for (const std::string &file : files)
+            {
+                sources.push_back(read_shader(file, defines));
+            }
+            state.store(Preprocessed, std::memory_order_release);
+            return true;
+        }
+
+        bool is_preprocessed() const
+        {
+            return state.load(std::memory_order_acquire) == Preprocessed;
+        }
+    };
+
+    Program::Program(std::shared_ptr<PendingBuild> build, bool is_compute)
+        : _handle(glCreateProgram())
+        , _is_compute(is_compute)
+        , _pending(std::move(build))
+    {}
+
+    Program::Program(const std::string &frag, const std::string &vert)
+        : Program(std::make_shared<PendingBuild>(), false)
+    {
+        _pending->types = { GL_VERTEX_SHADER };
+        _pending->sources = { vert };
+        if (!frag.empty())
+        {
+            _pending->types.push_back(GL_FRAGMENT_SHADER);
+            _pending->sources.push_back(frag);
+        }
+        _pending->state = PendingBuild::Preprocessed;
+        wait();
     }
 
     Program::Program(const std::string &comp)
-        : _handle(glCreateProgram())
-        , _is_compute(true)
+        : Program(std::make_shared<PendingBuild>(), true)
     {
-        const GLuint comp_handle = create_shader(comp, GL_COMPUTE_SHADER);
+        _pending->types = { GL_COMPUTE_SHADER };
+        _pending->sources = { comp };
+        _pending->state = PendingBuild::Preprocessed;
+        wait();
+    }
 
-        glAttachShader(_handle.get(), comp_handle);
+    // Loads the binary linked by a previous run if the program cache has
+    // one, starts compiling and linking the stages otherwise
+    void Program::start_build()
+    {
+        PendingBuild &build = *_pending;
+        DEBUG_ASSERT(build.is_preprocessed() && !build.linking);
 
-        link_program(_handle.get());
+        ProgramCache &cache = ProgramCache::global();
+        const double start_time = program_time();
 
-        glDeleteShader(comp_handle);
+        build.source_hash = hash_bytes(nullptr, 0);
+        for (size_t i = 0; i != build.types.size(); ++i)
+        {
+            build.source_hash = hash_bytes(
+                &build.types[i], sizeof(GLenum), build.source_hash);
+            build.source_hash =
+                hash_bytes(build.sources[i].data(), build.sources[i].size(),
+                           build.source_hash);
+        }
+
+        if (cache.load(_handle.get(), build.source_hash))
+        {
+            const double end_time = program_time();
+            cache.add_load_time((end_time - start_time) * 1000.0,
+                                (end_time - build.request_time) * 1000.0);
+            _pending = nullptr;
+            fetch_uniform_locations();
+            return;
+        }
+
+        PROFILE_ZONE("Program compilation");
+
+        for (size_t i = 0; i != build.types.size(); ++i)
+        {
+            const GLuint shader = glCreateShader(build.types[i]);
+            const int len = int(build.sources[i].size());
+            const char *c_str = build.sources[i].c_str();
+            glShaderSource(shader, 1, &c_str, &len);
+            glCompileShader(shader);
+            glAttachShader(_handle.get(), shader);
+            build.shaders.push_back(shader);
+        }
+
+        glProgramParameteri(_handle.get(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                            GL_TRUE);
+        glLinkProgram(_handle.get());
+
+        build.linking = true;
+        build.build_ms += (program_time() - start_time) * 1000.0;
+    }
+
+    // Blocks until linking is done, unless polled first
+    void Program::finish_build()
+    {
+        PendingBuild &build = *_pending;
+        DEBUG_ASSERT(build.linking);
+
+        ProgramCache &cache = ProgramCache::global();
+        const double start_time = program_time();
+
+        for (const GLuint shader : build.shaders)
+        {
+            check_shader(shader);
+        }
+        check_program(_handle.get());
 
+        for (const GLuint shader : build.shaders)
+        {
+            glDetachShader(_handle.get(), shader);
+            glDeleteShader(shader);
+        }
+
+        cache.store(_handle.get(), build.source_hash);
+        const double end_time = program_time();
+        cache.add_compile_time(build.build_ms
+                                   + (end_time - start_time) * 1000.0,
+                               (end_time - build.request_time) * 1000.0);
+
+        _pending = nullptr;
         fetch_uniform_locations();
     }
 
+    bool Program::is_ready()
+    {
+        if (!_pending)
+        {
+            return true;
+        }
+
+        if (!_pending->linking)
+        {
+            if (!_pending->is_preprocessed())
+            {
+                return false;
+            }
+
+            start_build();
+            if (!_pending)
+            {
+                return true;
+            }
+        }
+
+        // Without the extension, the status query would block
+        if (has_parallel_shader_compile())
+        {
+            int done = 0;
+            glGetProgramiv(_handle.get(), GL_COMPLETION_STATUS_KHR, &done);
+            if (!done)
+            {
+                return false;
+            }
+        }
+
+        finish_build();
+        return true;
+    }
+
+    void Program::wait()
+    {
+        if (!_pending)
+        {
+            return;
+        }
+
+        if (!_pending->linking)
+        {
+            // The preprocessing task may still be queued behind others
+            if (!_pending->preprocess())
+            {
+                while (!_pending->is_preprocessed())
+                {
+                    std::this_thread::yield();
+                }
+            }
+
+            start_build();
+            if (!_pending)
+            {
+                return;
+            }
+        }
+
+        finish_build();
+    }
+
     void Program::fetch_uniform_locations()
     {
         int uniform_count = 0;
@@ -209,14 +403,22 @@ namespace OM3D
 
     Program::~Program()
     {
+        if (_pending)
+        {
+            for (const GLuint shader : _pending->shaders)
+            {
+                glDeleteShader(shader);
+            }
+        }
         if (_handle.is_valid())
         {
             glDeleteProgram(_handle.get());
         }
     }
 
-    void Program::bind() const
+    void Program::bind()
     {
+        wait();
         glUseProgram(_handle.get());
     }
 
@@ -225,24 +427,38 @@ namespace OM3D
         return _is_compute;
     }
 
+    using ProgramKey = std::vector<std::string>;
+    using ProgramMap = std::unordered_map<ProgramKey, std::weak_ptr<Program>,
+                                          CollectionHasher<ProgramKey>>;
+
+    // Programs are built once while they are alive, whether they were
+    // requested synchronously or not
+    static ProgramMap &compute_programs()
+    {
+        static ProgramMap programs;
+        return programs;
+    }
+
+    static ProgramMap &graphics_programs()
+    {
+        static ProgramMap programs;
+        return programs;
+    }
+
     std::shared_ptr<Program> Program::from_file(const std::string &comp,
                                                 Span<const std::string> defines)
     {
-        static std::unordered_map<std::vector<std::string>,
-                                  std::weak_ptr<Program>,
-                                  CollectionHasher<std::vector<std::string>>>
-            loaded;
-
-        std::vector<std::string> key(defines.begin(), defines.end());
+        ProgramKey key(defines.begin(), defines.end());
         key.emplace_back(comp);
 
-        auto &weak_program = loaded[key];
+        auto &weak_program = compute_programs()[key];
         auto program = weak_program.lock();
         if (!program)
         {
             program = std::make_shared<Program>(read_shader(comp, defines));
             weak_program = program;
         }
+        program->wait();
         return program;
     }
 
@@ -250,28 +466,79 @@ namespace OM3D
     Program::from_files(const std::string &frag, const std::string &vert,
                         Span<const std::string> defines)
     {
-        static std::unordered_map<std::vector<std::string>,
-                                  std::weak_ptr<Program>,
-                                  CollectionHasher<std::vector<std::string>>>
-            loaded;
+        ProgramKey key(defines.begin(), defines.end());
+        key.emplace_back(frag);
+        key.emplace_back(vert);
+
+        auto &weak_program = graphics_programs()[key];
+        auto program = weak_program.lock();
+        if (!program)
+        {
+            program = std::make_shared<Program>(
+                frag.empty() ? std::string() : read_shader(frag, defines),
+                read_shader(vert, defines));
+            weak_program = program;
+        }
+        program->wait();
+        return program;
+    }
+
+    std::shared_ptr<Program>
+    Program::from_file_async(const std::string &comp,
+                             Span<const std::string> defines)
+    {
+        ProgramKey key(defines.begin(), defines.end());
+        key.emplace_back(comp);
+
+        auto &weak_program = compute_programs()[key];
+        auto program = weak_program.lock();
+        if (!program)
+        {
+            auto build = std::make_shared<PendingBuild>();
+            build->types = { GL_COMPUTE_SHADER };
+            build->files = { comp };
+            build->defines.assign(defines.begin(), defines.end());
 
-        std::vector<std::string> key(defines.begin(), defines.end());
+            program = std::shared_ptr<Program>(new Program(build, true));
+            weak_program = program;
+            ThreadPool::global().schedule([build] { build->preprocess(); });
+        }
+        return program;
+    }
+
+    std::shared_ptr<Program>
+    Program::from_files_async(const std::string &frag, const std::string &vert,
+                              Span<const std::string> defines)
+    {
+        ProgramKey key(defines.begin(), defines.end());
         key.emplace_back(frag);
         key.emplace_back(vert);
 
-        auto &weak_program = loaded[key];
+        auto &weak_program = graphics_programs()[key];
         auto program = weak_program.lock();
         if (!program)
         {
-            program = std::make_shared<Program>(read_shader(frag, defines),
-                                                read_shader(vert, defines));
+            auto build = std::make_shared<PendingBuild>();
+            build->types = { GL_VERTEX_SHADER };
+            build->files = { vert };
+            if (!frag.empty())
+            {
+                build->types.push_back(GL_FRAGMENT_SHADER);
+                build->files.push_back(frag);
+            }
+            build->defines.assign(defines.begin(), defines.end());
+
+            program = std::shared_ptr<Program>(new Program(build, false));
             weak_program = program;
+            ThreadPool::global().schedule([build] { build->preprocess(); });
         }
         return program;
     }
 
     int Program::find_location(u32 hash)
     {
+        // Uniform locations are only known once linked
+        wait();
         const auto it = std::lower_bound(_uniform_locations.begin(),
                                          _uniform_locations.end(),
                                          UniformLocationInfo{ hash, 0 });
@@ -280,6 +547,14 @@ namespace OM3D
             : it->location;
     }
 
+    void Program::set_uniform(u32 name_hash, u32 value)
+    {
+        if (const int loc = find_location(name_hash); loc >= 0)
+        {
+            glProgramUniform1ui(_handle.get(), loc, value);
+        }
+    }
+
     void Program::set_uniform(u32 name_hash, float value)
     {
         if (const int loc = find_location(name_hash); loc >= 0)
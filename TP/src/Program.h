@@ -36,21 +36,44 @@ namespace OM3D
         Program(Program &&) = default;
         Program &operator=(Program &&) = default;
 
+        // An empty fragment shader gives a vertex only program, for depth only
+        // passes
         Program(const std::string &frag, const std::string &vert);
         Program(const std::string &comp);
         ~Program();
 
-        void bind() const;
+        // Waits for the program if it is built in the background
+        void bind();
 
         bool is_compute() const;
 
+        // Always true for programs built synchronously. For the others,
+        // polls the build and finishes it on the context thread once the
+        // driver is done.
+        bool is_ready();
+        void wait();
+
         static std::shared_ptr<Program>
         from_file(const std::string &comp,
                   Span<const std::string> defines = {});
+        // frag may be empty, see above
         static std::shared_ptr<Program>
         from_files(const std::string &frag, const std::string &vert,
                    Span<const std::string> defines = {});
 
+        // Same as above, but return right away and build the program in the
+        // background: sources are read and expanded on the thread pool, and
+        // compiled by the driver threads if it supports
+        // GL_KHR_parallel_shader_compile. Programs are shared with the
+        // synchronous functions, which wait for them.
+        static std::shared_ptr<Program>
+        from_file_async(const std::string &comp,
+                        Span<const std::string> defines = {});
+        static std::shared_ptr<Program>
+        from_files_async(const std::string &frag, const std::string &vert,
+                         Span<const std::string> defines = {});
+
+        void set_uniform(u32 name_hash, u32 value);
         void set_uniform(u32 name_hash, float value);
         void set_uniform(u32 name_hash, glm::vec2 value);
         void set_uniform(u32 name_hash, glm::vec3 value);
@@ -66,6 +89,13 @@ namespace OM3D
         }
 
     private:
+        struct PendingBuild;
+
+        Program(std::shared_ptr<PendingBuild> build, bool is_compute);
+
+        void start_build();
+        void finish_build();
+
         void fetch_uniform_locations();
         int find_location(u32 hash);
 
@@ -73,6 +103,9 @@ namespace OM3D
         std::vector<UniformLocationInfo> _uniform_locations;
 
         bool _is_compute = false;
+
+        // Null once the program is linked
+        std::shared_ptr<PendingBuild> _pending;
     };
 
 } // namespace OM3D
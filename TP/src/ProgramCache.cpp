@@ -0,0 +1,203 @@
+#include "ProgramCache.h"
+
+#include <glad/glad.h>
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string_view>
+#include <vector>
+
+namespace OM3D
+{
+
+    static constexpr u32 cache_magic = 0x50334D4F; // "OM3P"
+    static constexpr u32 cache_version = 1;
+
+    struct EntryHeader
+    {
+        u32 magic = cache_magic;
+        u32 version = cache_version;
+        u64 key = 0;
+        u32 binary_format = 0;
+        u32 binary_size = 0;
+    };
+
+    ProgramCache::ProgramCache()
+        : _directory(std::string(data_path) + "program_cache/")
+    {}
+
+    ProgramCache &ProgramCache::global()
+    {
+        static ProgramCache cache;
+        return cache;
+    }
+
+    void ProgramCache::set_enabled(bool enabled)
+    {
+        _enabled = enabled;
+    }
+
+    bool ProgramCache::is_enabled() const
+    {
+        return _enabled;
+    }
+
+    const std::string &ProgramCache::directory() const
+    {
+        return _directory;
+    }
+
+    void ProgramCache::set_directory(std::string directory)
+    {
+        _directory = std::move(directory);
+    }
+
+    bool ProgramCache::is_supported()
+    {
+        if (!_driver_checked)
+        {
+            _driver_checked = true;
+
+            int format_count = 0;
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+            _supported = format_count > 0;
+
+            // Binaries are only valid for the driver that produced them
+            _driver_hash = hash_bytes(&cache_version, sizeof(cache_version));
+            for (const GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+            {
+                const char *str =
+                    reinterpret_cast<const char *>(glGetString(name));
+                const std::string_view value = str ? str : "";
+                _driver_hash =
+                    hash_bytes(value.data(), value.size() + 1, _driver_hash);
+            }
+        }
+        return _supported;
+    }
+
+    u64 ProgramCache::entry_key(u64 source_hash)
+    {
+        return hash_bytes(&source_hash, sizeof(source_hash), _driver_hash);
+    }
+
+    std::string ProgramCache::entry_file_name(u64 key) const
+    {
+        char name[32] = {};
+        std::snprintf(name, sizeof(name), "%016" PRIx64 ".om3dcache", key);
+        return _directory + name;
+    }
+
+    bool ProgramCache::load(u32 program, u64 source_hash)
+    {
+        if (!_enabled || !is_supported())
+        {
+            return false;
+        }
+
+        const u64 key = entry_key(source_hash);
+        std::ifstream in(entry_file_name(key), std::ios::binary);
+        if (!in)
+        {
+            return false;
+        }
+
+        EntryHeader header;
+        in.read(reinterpret_cast<char *>(&header), sizeof(header));
+        if (!in || header.magic != cache_magic
+            || header.version != cache_version || header.key != key)
+        {
+            return false;
+        }
+
+        std::vector<char> binary(header.binary_size);
+        in.read(binary.data(), std::streamsize(binary.size()));
+        if (!in)
+        {
+            return false;
+        }
+
+        // Drivers may refuse binaries, after an update for example
+        glProgramBinary(program, header.binary_format, binary.data(),
+                        GLsizei(binary.size()));
+        int linked = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked)
+        {
+            ++_stats.rejected_count;
+            return false;
+        }
+
+        return true;
+    }
+
+    void ProgramCache::store(u32 program, u64 source_hash)
+    {
+        if (!_enabled || !is_supported())
+        {
+            return;
+        }
+
+        int size = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+        if (size <= 0)
+        {
+            return;
+        }
+
+        EntryHeader header;
+        header.key = entry_key(source_hash);
+
+        std::vector<char> binary(size);
+        GLenum format = GL_NONE;
+        glGetProgramBinary(program, size, &size, &format, binary.data());
+        header.binary_format = format;
+        header.binary_size = u32(size);
+
+        std::error_code error;
+        std::filesystem::create_directories(_directory, error);
+
+        // Write to a temporary file so a partial entry is never picked up
+        const std::string file_name = entry_file_name(header.key);
+        const std::string tmp_file_name = file_name + ".tmp";
+        bool written = false;
+        {
+            std::ofstream out(tmp_file_name, std::ios::binary);
+            out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            out.write(binary.data(), std::streamsize(header.binary_size));
+            written = bool(out);
+        }
+
+        if (written)
+        {
+            std::filesystem::rename(tmp_file_name, file_name, error);
+        }
+        if (!written || error)
+        {
+            std::filesystem::remove(tmp_file_name, error);
+        }
+    }
+
+    void ProgramCache::add_compile_time(double ms, double wall_ms)
+    {
+        ++_stats.compiled_count;
+        _stats.compile_ms += ms;
+        _stats.compile_wall_ms += wall_ms;
+    }
+
+    void ProgramCache::add_load_time(double ms, double wall_ms)
+    {
+        ++_stats.loaded_count;
+        _stats.load_ms += ms;
+        _stats.load_wall_ms += wall_ms;
+    }
+
+    const ProgramCacheStats &ProgramCache::stats() const
+    {
+        return _stats;
+    }
+
+} // namespace OM3D
@@ -0,0 +1,76 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <graphics.h>
+
+#include <string>
+
+namespace OM3D
+{
+
+    // Time spent creating programs since startup. The _ms times are spent
+    // on the context thread. The _wall_ms ones go from the request of each
+    // program to it being ready, background preprocessing and driver
+    // compilation included, summed over programs.
+    struct ProgramCacheStats
+    {
+        u32 compiled_count = 0;
+        double compile_ms = 0.0;
+        double compile_wall_ms = 0.0;
+
+        u32 loaded_count = 0;
+        double load_ms = 0.0;
+        double load_wall_ms = 0.0;
+
+        // Cached binaries the driver refused, they were compiled instead
+        u32 rejected_count = 0;
+    };
+
+    // Linked program binaries, one file per program in a cache directory.
+    // Entries are keyed by a hash of the expanded shader sources and of the
+    // driver vendor, renderer and version: a change in either gives another
+    // key, and stale entries are never read.
+    class ProgramCache : NonMovable
+    {
+    public:
+        static ProgramCache &global();
+
+        void set_enabled(bool enabled);
+        bool is_enabled() const;
+
+        const std::string &directory() const;
+        void set_directory(std::string directory);
+
+        // Links program from a cached binary, fails if there is none or if
+        // the driver does not accept it
+        bool load(u32 program, u64 source_hash);
+
+        // program must be linked, with GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+        void store(u32 program, u64 source_hash);
+
+        void add_compile_time(double ms, double wall_ms);
+        void add_load_time(double ms, double wall_ms);
+
+        const ProgramCacheStats &stats() const;
+
+    private:
+        ProgramCache();
+
+        bool is_supported();
+        std::string entry_file_name(u64 key) const;
+        u64 entry_key(u64 source_hash);
+
+        bool _enabled = true;
+        std::string _directory;
+
+        // Computed with the first entry, once a context exists
+        bool _driver_checked = false;
+        bool _supported = false;
+        u64 _driver_hash = 0;
+
+        ProgramCacheStats _stats;
+    };
+
+} // namespace OM3D
+
+#endif // PROGRAMCACHE_H
@@ -0,0 +1,224 @@
+#include "RingBuffer.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+
+namespace OM3D
+{
+
+    static constexpr size_t min_frame_size = 64 * 1024;
+    static constexpr size_t max_alignment = 256;
+
+    static constexpr GLbitfield storage_flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    static size_t align_size(size_t size, size_t alignment)
+    {
+        return (size + alignment - 1) & ~(alignment - 1);
+    }
+
+    static void wait_fence(void *fence)
+    {
+        const GLsync sync = static_cast<GLsync>(fence);
+        for (;;)
+        {
+            const GLenum res = glClientWaitSync(
+                sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000 /* 1ms */);
+            if (res != GL_TIMEOUT_EXPIRED)
+            {
+                break;
+            }
+        }
+        glDeleteSync(sync);
+    }
+
+    RingBuffer::RingBuffer(size_t frame_size, u32 frames_in_flight)
+        : _fences(frames_in_flight, nullptr)
+        , _frames_in_flight(frames_in_flight)
+    {
+        ALWAYS_ASSERT(frames_in_flight, "Ring buffer needs at least one frame");
+        if (frame_size)
+        {
+            grow(frame_size);
+        }
+    }
+
+    RingBuffer::~RingBuffer()
+    {
+        for (void *fence : _fences)
+        {
+            if (fence)
+            {
+                glDeleteSync(static_cast<GLsync>(fence));
+            }
+        }
+
+        destroy_storage(_storage);
+        for (RetiredStorage &retired : _retired)
+        {
+            destroy_storage(retired.storage);
+        }
+    }
+
+    RingBuffer::RingBuffer(RingBuffer &&other)
+    {
+        swap(other);
+    }
+
+    RingBuffer &RingBuffer::operator=(RingBuffer &&other)
+    {
+        swap(other);
+        return *this;
+    }
+
+    void RingBuffer::swap(RingBuffer &other)
+    {
+        std::swap(_storage, other._storage);
+        std::swap(_retired, other._retired);
+        std::swap(_fences, other._fences);
+        std::swap(_frame_size, other._frame_size);
+        std::swap(_head, other._head);
+        std::swap(_frame, other._frame);
+        std::swap(_frames_in_flight, other._frames_in_flight);
+    }
+
+    void RingBuffer::begin_frame()
+    {
+        // Fence everything that used the region of the frame we are leaving
+        {
+            void *&fence = _fences[_frame % _frames_in_flight];
+            if (fence)
+            {
+                glDeleteSync(static_cast<GLsync>(fence));
+            }
+            fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+
+        ++_frame;
+        _head = 0;
+
+        {
+            void *&fence = _fences[_frame % _frames_in_flight];
+            if (fence)
+            {
+                PROFILE_ZONE("RingBuffer wait");
+                wait_fence(fence);
+                fence = nullptr;
+            }
+        }
+
+        // Storages replaced more than a full cycle ago are no longer in use
+        const auto end = std::remove_if(
+            _retired.begin(), _retired.end(), [&](RetiredStorage &retired) {
+                if (retired.frame + _frames_in_flight > _frame)
+                {
+                    return false;
+                }
+                destroy_storage(retired.storage);
+                return true;
+            });
+        _retired.erase(end, _retired.end());
+    }
+
+    size_t RingBuffer::allocate_bytes(size_t size, size_t alignment)
+    {
+        DEBUG_ASSERT(alignment && alignment <= max_alignment);
+        DEBUG_ASSERT((alignment & (alignment - 1)) == 0);
+
+        size_t begin = align_size(_head, alignment);
+        if (begin + size > _frame_size)
+        {
+            grow(begin + size);
+            begin = 0;
+        }
+
+        _head = begin + size;
+        return (_frame % _frames_in_flight) * _frame_size + begin;
+    }
+
+    void RingBuffer::grow(size_t frame_size)
+    {
+        // Allocations made earlier in this frame still live in the old
+        // storage, keep it alive until the GPU is done with it
+        if (_storage.handle.is_valid())
+        {
+            _retired.push_back(RetiredStorage{ std::move(_storage), _frame });
+            _storage = Storage{};
+        }
+
+        _frame_size = align_size(
+            std::max({ frame_size, _frame_size * 2, min_frame_size }),
+            max_alignment);
+        _storage = create_storage(_frame_size * _frames_in_flight);
+        _head = 0;
+    }
+
+    void RingBuffer::bind(BufferUsage usage) const
+    {
+        glBindBuffer(buffer_usage_to_gl(usage), _storage.handle.get());
+    }
+
+    void RingBuffer::bind_range(BufferUsage usage, u32 index, size_t offset,
+                                size_t size) const
+    {
+        ALWAYS_ASSERT(
+            usage == BufferUsage::Uniform || usage == BufferUsage::Storage,
+            "Index bind is only available for uniform and storage buffers");
+        DEBUG_ASSERT(offset % bind_alignment() == 0);
+        glBindBufferRange(buffer_usage_to_gl(usage), index,
+                          _storage.handle.get(), offset,
+                          std::max(size, size_t(1)));
+    }
+
+    size_t RingBuffer::frame_size() const
+    {
+        return _frame_size;
+    }
+
+    size_t RingBuffer::bind_alignment()
+    {
+        static const size_t alignment = [] {
+            int uniform_alignment = 0;
+            int storage_alignment = 0;
+            glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT,
+                          &uniform_alignment);
+            glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT,
+                          &storage_alignment);
+            const size_t alignment = size_t(
+                std::max({ uniform_alignment, storage_alignment, 16 }));
+            ALWAYS_ASSERT(alignment <= max_alignment,
+                          "Unsupported buffer offset alignment");
+            return alignment;
+        }();
+        return alignment;
+    }
+
+    RingBuffer::Storage RingBuffer::create_storage(size_t size)
+    {
+        PROFILE_ZONE("RingBuffer::create_storage");
+
+        GLuint handle = 0;
+        glCreateBuffers(1, &handle);
+        glNamedBufferStorage(handle, size, nullptr, storage_flags);
+
+        Storage storage;
+        storage.handle = GLHandle(handle);
+        storage.size = size;
+        storage.data = static_cast<byte *>(
+            glMapNamedBufferRange(handle, 0, size, storage_flags));
+        ALWAYS_ASSERT(storage.data, "Unable to map ring buffer");
+        return storage;
+    }
+
+    void RingBuffer::destroy_storage(Storage &storage)
+    {
+        if (auto handle = storage.handle.get())
+        {
+            // Deleting the buffer also releases its mapping
+            glDeleteBuffers(1, &handle);
+        }
+        storage = Storage{};
+    }
+
+} // namespace OM3D
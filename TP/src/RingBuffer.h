@@ -0,0 +1,119 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <graphics.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace OM3D
+{
+
+    // Sub-range of a RingBuffer, only valid for the frame it was allocated in
+    template <typename T>
+    struct RingAllocation
+    {
+        T *data = nullptr;
+        size_t offset = 0;
+        size_t count = 0;
+
+        size_t byte_size() const
+        {
+            return count * sizeof(T);
+        }
+
+        T &operator[](size_t index) const
+        {
+            DEBUG_ASSERT(index < count);
+            return data[index];
+        }
+    };
+
+    // Persistently mapped buffer used to stream per-frame data to the GPU.
+    // The buffer is split in one region per frame in flight, and each region
+    // is guarded by a fence so it is never overwritten while still in use.
+    class RingBuffer : NonCopyable
+    {
+    public:
+        static constexpr u32 default_frames_in_flight = 3;
+
+        RingBuffer(size_t frame_size = 0,
+                   u32 frames_in_flight = default_frames_in_flight);
+        ~RingBuffer();
+
+        RingBuffer(RingBuffer &&other);
+        RingBuffer &operator=(RingBuffer &&other);
+
+        // Moves to the next frame region, waiting on the GPU if it has not
+        // finished using it yet
+        void begin_frame();
+
+        template <typename T>
+        RingAllocation<T> allocate(size_t count, size_t alignment = alignof(T))
+        {
+            // Never hand out empty ranges so the result can always be bound
+            const size_t offset = allocate_bytes(
+                std::max(count, size_t(1)) * sizeof(T), alignment);
+            return RingAllocation<T>{
+                reinterpret_cast<T *>(_storage.data + offset), offset, count
+            };
+        }
+
+        // Allocation whose offset is suitable for uniform and storage bindings
+        template <typename T>
+        RingAllocation<T> allocate_bindable(size_t count)
+        {
+            return allocate<T>(count, bind_alignment());
+        }
+
+        void bind(BufferUsage usage) const;
+
+        template <typename T>
+        void bind(const RingAllocation<T> &allocation, BufferUsage usage,
+                  u32 index) const
+        {
+            bind_range(usage, index, allocation.offset,
+                       allocation.byte_size());
+        }
+
+        size_t frame_size() const;
+
+        static size_t bind_alignment();
+
+    private:
+        struct Storage
+        {
+            GLHandle handle;
+            byte *data = nullptr;
+            size_t size = 0;
+        };
+
+        struct RetiredStorage
+        {
+            Storage storage;
+            u64 frame = 0;
+        };
+
+        size_t allocate_bytes(size_t size, size_t alignment);
+        void bind_range(BufferUsage usage, u32 index, size_t offset,
+                        size_t size) const;
+
+        void grow(size_t min_frame_size);
+        void swap(RingBuffer &other);
+
+        static Storage create_storage(size_t size);
+        static void destroy_storage(Storage &storage);
+
+        Storage _storage;
+        std::vector<RetiredStorage> _retired;
+        std::vector<void *> _fences;
+
+        size_t _frame_size = 0;
+        size_t _head = 0;
+        u64 _frame = 0;
+        u32 _frames_in_flight = 0;
+    };
+
+} // namespace OM3D
+
+#endif // RINGBUFFER_H
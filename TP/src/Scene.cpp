@@ -1,5 +1,7 @@
 ﻿#include "Scene.h"
 
+#include <GPUProfiler.h>
+#include <ThreadPool.h>
 #include <TypedBuffer.h>
 #include <shader_structs.h>
 
@@ -8,108 +10,1269 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include <iostream>
+#include <numeric>
+#include <set>
 
 namespace OM3D
 {
 
+    static_assert(sizeof(shader::DrawElementsIndirectCommand)
+                      == 5 * sizeof(u32),
+                  "Indirect commands must be tightly packed");
+
+    static_assert(sizeof(shader::CullingStats::lod_instance_counts)
+                      == max_lod_count * sizeof(u32),
+                  "LOD stats do not match max_lod_count");
+
+    // A LOD is selected when error * scale * lod_factor <= distance
+    static float compute_lod_factor(const Camera &camera,
+                                    const RenderSettings &settings)
+    {
+        if (!settings.lod_selection || !(settings.lod_threshold > 0.0f))
+        {
+            return 0.0f;
+        }
+        // The projection maps tan(fov / 2) * distance to half the screen
+        return camera.projection_matrix()[1][1]
+             / (2.0f * settings.lod_threshold);
+    }
+
+    // Frustum planes in the object space of an instance. They are divided by
+    // the largest scale of the transform, so object space spheres can be
+    // tested against them.
+    static FrustumPlanes object_space_planes(const FrustumPlanes &planes,
+                                             const glm::mat4 &transform,
+                                             float scale)
+    {
+        const glm::mat3 transposed = glm::transpose(glm::mat3(transform));
+        const glm::vec3 translation = glm::vec3(transform[3]);
+
+        FrustumPlanes local;
+        for (size_t i = 0; i != planes.size(); ++i)
+        {
+            const glm::vec3 normal = glm::vec3(planes[i]);
+            local[i] = glm::vec4(transposed * normal,
+                                 glm::dot(normal, translation) + planes[i].w)
+                     / scale;
+        }
+        return local;
+    }
+
+    static bool is_back_facing(const Meshlet &meshlet, const glm::vec3 &eye)
+    {
+        const glm::vec3 to_center = meshlet.center - eye;
+        return glm::dot(to_center, meshlet.cone_axis)
+            >= meshlet.cone_cutoff * glm::length(to_center) + meshlet.radius;
+    }
+
+    // Software occlusion culling only rasterizes the largest occluders
+    static constexpr size_t max_occluders = 16;
+
+    // Meshes with fewer meshlets are always drawn whole
+    static constexpr size_t min_culled_meshlets = 4;
+
+    // Height of a world space bounding sphere on screen, relative to the
+    // screen height. focal is the [1][1] entry of the projection.
+    static float screen_size(const glm::vec4 &sphere,
+                             const glm::vec3 &camera_position, float focal)
+    {
+        const float distance = glm::length(glm::vec3(sphere) - camera_position);
+        return distance > sphere.w ? sphere.w / distance * focal
+                                   : std::numeric_limits<float>::infinity();
+    }
+
+    static shader::MeshDequantization
+    mesh_dequantization(const StaticMesh &mesh)
+    {
+        const VertexDequantization dequant = mesh.dequantization();
+        const float packed =
+            mesh.vertex_format() == VertexFormat::Packed ? 1.0f : 0.0f;
+        return { glm::vec4(dequant.scale, packed),
+                 glm::vec4(dequant.offset, 0.0f) };
+    }
+
     Scene::Scene()
-    {}
+        : _depth_prepass_timer(QueryType::TimeElapsed)
+        , _lit_pass_timer(QueryType::TimeElapsed)
+        , _lighting_timer(QueryType::TimeElapsed)
+        , _lit_samples_query(QueryType::SamplesPassed)
+    {
+        // Like the light clusters, G-buffer and depth pyramid ones, these
+        // programs are built in the background. Until they are ready,
+        // render falls back to the paths that do not need them.
+        _depth_material.set_program(
+            Program::from_files_async("", "depth.vert"));
+        _culling_program = Program::from_file_async("cull.comp");
+    }
 
     void Scene::add_object(SceneObject obj)
     {
+        const u32 index = u32(_objects.size());
         _objects.emplace_back(std::move(obj));
+        _transforms_dirty = true;
+
+        const SceneObject &object = _objects.back();
+        if (!object.get_mesh() || !object.get_material())
+        {
+            return;
+        }
+
+        const auto key = std::pair<const StaticMesh *, const Material *>(
+            object.get_mesh().get(), object.get_material().get());
+        const auto [it, inserted] =
+            _batch_indices.emplace(key, _batches.size());
+        if (inserted)
+        {
+            _batches.push_back(
+                InstanceBatch{ key.first, key.second, {}, 0, {}, false });
+            _mesh_pool_dirty = true;
+        }
+        _batches[it->second].objects.push_back(index);
     }
 
     void Scene::add_object(PointLight obj)
     {
         _point_lights.emplace_back(std::move(obj));
     }
+
+    void Scene::set_object_transform(u32 index, const glm::mat4 &transform)
+    {
+        DEBUG_ASSERT(index < _objects.size());
+        _objects[index].set_transform(transform);
+        _transforms_dirty = true;
+    }
+
+    const RenderStats &Scene::stats() const
+    {
+        return _stats;
+    }
     
-    void Scene::render(const Camera &camera) const
+    Result<u32> Scene::pick(const Ray &ray) const
+    {
+        if (_transforms_dirty)
+        {
+            update_transform_buffer();
+        }
+
+        const Result<RayHit> hit = _bvh.raycast(ray);
+        if (!hit.is_ok)
+        {
+            return { false, 0 };
+        }
+        return { true, _instance_objects[hit.value.index] };
+    }
+
+    void Scene::query_objects(const AABB &box, std::vector<u32> &objects) const
+    {
+        if (_transforms_dirty)
+        {
+            update_transform_buffer();
+        }
+
+        const size_t first = objects.size();
+        _bvh.query(box, objects);
+        for (size_t i = first; i != objects.size(); ++i)
+        {
+            objects[i] = _instance_objects[objects[i]];
+        }
+    }
+
+    AABB Scene::bounds() const
+    {
+        if (_transforms_dirty)
+        {
+            update_transform_buffer();
+        }
+
+        AABB bounds;
+        for (const AABB &instance : _instance_bounds)
+        {
+            bounds.extend(instance);
+        }
+        return bounds;
+    }
+
+    void Scene::wait_for_programs() const
+    {
+        for (const InstanceBatch &batch : _batches)
+        {
+            batch.material->wait();
+        }
+        _depth_material.wait();
+        _culling_program->wait();
+        _depth_pyramid.wait();
+        _light_clusters.wait();
+        _gbuffer.wait();
+    }
+
+    void Scene::render(const Camera &camera, const RenderSettings &settings,
+                       Texture *depth, Texture *lit) const
     {
+        PROFILE_ZONE("Scene::render");
+
+        // Passes whose programs are not built yet are left out
+        const bool clustered =
+            settings.clustered_lighting && _light_clusters.is_ready();
+        const bool deferred = settings.deferred_shading && depth && lit
+            && _gbuffer.is_ready();
+        const bool depth_prepass =
+            settings.depth_prepass && _depth_material.is_ready();
+        const bool gpu_culling =
+            settings.gpu_culling && _culling_program->is_ready();
+        const bool occlusion_culling =
+            settings.occlusion_culling && _depth_pyramid.is_ready();
+
+        _frame_buffer.begin_frame();
+
         // Fill and bind frame data buffer
-        TypedBuffer<shader::FrameData> buffer(nullptr, 1);
         {
-            auto mapping = buffer.map(AccessType::WriteOnly);
-            mapping[0].camera.view_proj = camera.view_proj_matrix();
-            mapping[0].point_light_count = u32(_point_lights.size());
-            mapping[0].sun_color = glm::vec3(1.0f, 1.0f, 1.0f);
-            mapping[0].sun_dir = glm::normalize(_sun_direction);
+            auto frame = _frame_buffer.allocate_bindable<shader::FrameData>(1);
+            frame[0] = {};
+            frame[0].camera.view_proj = camera.view_proj_matrix();
+            frame[0].camera.position = camera.position();
+            const FrustumPlanes planes = camera.build_frustum_planes();
+            std::copy(planes.begin(), planes.end(),
+                      frame[0].camera.frustum_planes);
+            frame[0].point_light_count = u32(_point_lights.size());
+            frame[0].sun_color = glm::vec3(1.0f, 1.0f, 1.0f);
+            frame[0].sun_dir = glm::normalize(_sun_direction);
+            if (clustered)
+            {
+                _light_clusters.setup(frame[0], settings.cluster_grid,
+                                      settings.cluster_near,
+                                      settings.cluster_far);
+            }
+            frame[0].show_light_clusters = settings.show_light_clusters;
+            _frame_buffer.bind(frame, BufferUsage::Uniform, 0);
         }
-        buffer.bind(BufferUsage::Uniform, 0);
 
         // Fill and bind lights buffer
-        TypedBuffer<shader::PointLight> light_buffer(
-            nullptr, std::max(_point_lights.size(), size_t(1)));
         {
-            auto mapping = light_buffer.map(AccessType::WriteOnly);
+            auto lights =
+                _frame_buffer.allocate_bindable<shader::PointLight>(
+                    _point_lights.size());
             for (size_t i = 0; i != _point_lights.size(); ++i)
             {
                 const auto &light = _point_lights[i];
-                mapping[i] = { light.position(), light.radius(), light.color(),
-                               0.0f };
+                lights[i] = { light.position(), light.radius(), light.color(),
+                              0.0f };
+            }
+            _frame_buffer.bind(lights, BufferUsage::Storage, 1);
+        }
+
+        if (clustered)
+        {
+            GPU_PROFILE_SCOPE("Light clusters");
+            _light_clusters.build(camera);
+        }
+
+        // Bind instance transforms, only uploaded when they changed
+        if (_transforms_dirty)
+        {
+            update_transform_buffer();
+        }
+        _transform_buffer.bind(BufferUsage::Storage, 2);
+        _instance_indices.bind(BufferUsage::Storage, 12);
+
+        // Same readiness for every pass of the frame
+        for (InstanceBatch &batch : _batches)
+        {
+            batch.ready = batch.material->is_ready();
+        }
+
+        _stats.object_count = u32(_objects.size());
+        _stats.visible_count = 0;
+        _stats.culled_count = 0;
+        _stats.occluded_count = 0;
+        _stats.triangle_count = 0;
+        _stats.lod_instance_counts = {};
+        _stats.draw_call_count = 0;
+        _stats.meshlet_count = 0;
+        _stats.culled_meshlet_count = 0;
+
+        if (deferred)
+        {
+            _gbuffer.begin_frame(*depth, *lit, camera);
+        }
+        const Span<const DrawPass> passes =
+            draw_passes(depth_prepass, deferred);
+
+        const float lod_factor = compute_lod_factor(camera, settings);
+        if (gpu_culling)
+        {
+            draw_batches_indirect(true, lod_factor, camera,
+                                  occlusion_culling ? depth : nullptr,
+                                  passes);
+        }
+        else if (settings.cpu_culling || settings.software_occlusion
+                 || settings.meshlet_culling || lod_factor > 0.0f)
+        {
+            draw_batches_culled(camera, settings, lod_factor, passes);
+        }
+        else if (settings.multi_draw_indirect)
+        {
+            draw_batches_indirect(false, lod_factor, camera, nullptr, passes);
+        }
+        else
+        {
+            draw_batches(passes);
+        }
+
+        _stats.depth_prepass_ms = depth_prepass
+            ? float(double(_depth_prepass_timer.result()) * 1.0e-6)
+            : 0.0f;
+        _stats.lit_pass_ms = float(double(_lit_pass_timer.result()) * 1.0e-6);
+        _stats.lit_samples = _lit_samples_query.result();
+        _stats.lighting_ms = deferred
+            ? float(double(_lighting_timer.result()) * 1.0e-6)
+            : 0.0f;
+        _stats.gbuffer_bytes_per_pixel =
+            deferred ? _gbuffer.bytes_per_pixel() : 0;
+        _stats.dropped_cluster_lights = clustered
+            ? _light_clusters.dropped_light_count()
+            : 0;
+        _stats.dropped_tile_lights =
+            deferred ? _gbuffer.dropped_light_count() : 0;
+
+        ++_frame_index;
+    }
+
+    void Scene::update_transform_buffer() const
+    {
+        PROFILE_ZONE("Scene::update_transform_buffer");
+
+        // Lay transforms out batch by batch so every batch reads a contiguous
+        // range of instances
+        std::vector<shader::ModelTransform> &transforms = _instance_transforms;
+        transforms.clear();
+        transforms.reserve(std::max(_objects.size(), size_t(1)));
+
+        std::set<const StaticMesh *> meshes;
+        _stats.vertex_bytes = 0;
+        _stats.index_bytes = 0;
+        for (InstanceBatch &batch : _batches)
+        {
+            if (!batch.dequantization.byte_size())
+            {
+                const shader::MeshDequantization dequant =
+                    mesh_dequantization(*batch.mesh);
+                batch.dequantization =
+                    TypedBuffer<shader::MeshDequantization>(&dequant, 1);
+            }
+
+            batch.first_instance = u32(transforms.size());
+            for (const u32 index : batch.objects)
+            {
+                transforms.push_back({ _objects[index].transform() });
+            }
+
+            if (meshes.insert(batch.mesh).second)
+            {
+                _stats.vertex_bytes +=
+                    batch.mesh->get_vertices()->byte_size();
+                _stats.index_bytes +=
+                    batch.mesh->get_indices()->byte_size();
+            }
+        }
+
+        // World space bounds, in the same order
+        _instance_objects.resize(transforms.size());
+        _instance_bounds.resize(transforms.size());
+        _instance_spheres.resize(transforms.size());
+        _instance_scales.resize(transforms.size());
+        _culler.resize(transforms.size());
+        for (const InstanceBatch &batch : _batches)
+        {
+            for (size_t i = 0; i != batch.objects.size(); ++i)
+            {
+                const size_t instance = batch.first_instance + i;
+                const glm::mat4 &transform = transforms[instance].transform;
+                const float scale = std::max({ glm::length(transform[0]),
+                                               glm::length(transform[1]),
+                                               glm::length(transform[2]) });
+                const glm::vec3 center = glm::vec3(
+                    transform * glm::vec4(batch.mesh->get_center(), 1.0f));
+                const float radius = batch.mesh->get_radius() * scale;
+
+                _instance_objects[instance] = batch.objects[i];
+                _instance_bounds[instance] =
+                    batch.mesh->get_aabb().transformed(transform);
+                _instance_spheres[instance] = glm::vec4(center, radius);
+                _instance_scales[instance] = scale;
+                _culler.set_sphere(instance, center, radius);
+            }
+        }
+
+        // Objects only move in place when the instance count is unchanged
+        if (_bvh.size() == _instance_bounds.size())
+        {
+            _bvh.refit(_instance_bounds);
+        }
+        else
+        {
+            _bvh.build(_instance_bounds);
+        }
+
+        const size_t instance_count = std::max(transforms.size(), size_t(1));
+        if (_instance_indices.element_count() != instance_count)
+        {
+            std::vector<u32> indices(instance_count);
+            std::iota(indices.begin(), indices.end(), 0);
+            _instance_indices = TypedBuffer<u32>(indices);
+        }
+
+        if (transforms.empty())
+        {
+            _transform_buffer = TypedBuffer<shader::ModelTransform>(
+                std::vector<shader::ModelTransform>(1));
+        }
+        else
+        {
+            _transform_buffer =
+                TypedBuffer<shader::ModelTransform>(transforms);
+        }
+        _transforms_dirty = false;
+        _draw_commands_dirty = true;
+    }
+
+    void Scene::update_draw_commands() const
+    {
+        PROFILE_ZONE("Scene::update_draw_commands");
+
+        if (_mesh_pool_dirty)
+        {
+            std::vector<const StaticMesh *> meshes;
+            for (const InstanceBatch &batch : _batches)
+            {
+                meshes.push_back(batch.mesh);
+            }
+            _mesh_pool = MeshPool(meshes);
+            _mesh_pool_dirty = false;
+        }
+
+        // Sort batches by vertex format then material so each vertex buffer
+        // and material is bound only once
+        std::vector<const InstanceBatch *> sorted;
+        for (const InstanceBatch &batch : _batches)
+        {
+            sorted.push_back(&batch);
+        }
+        std::stable_sort(sorted.begin(), sorted.end(),
+                         [](const InstanceBatch *a, const InstanceBatch *b) {
+                             return std::pair(a->mesh->vertex_format(),
+                                              a->material)
+                                 < std::pair(b->mesh->vertex_format(),
+                                             b->material);
+                         });
+
+        // Every batch has one command per LOD, only the first one draws when
+        // LODs are not selected on the GPU. Culling compacts the instance
+        // indices of each command in its own slice, with room for every
+        // instance of its batch.
+        std::vector<shader::DrawElementsIndirectCommand> commands;
+        std::vector<u32> culled_offsets;
+        u32 culled_count = 0;
+        std::vector<shader::MeshDequantization> dequantizations;
+        std::vector<u32> batch_commands(_batches.size());
+        _draw_groups.clear();
+        for (const InstanceBatch *batch : sorted)
+        {
+            batch_commands[batch - _batches.data()] = u32(commands.size());
+
+            const VertexFormat format = batch->mesh->vertex_format();
+            if (_draw_groups.empty()
+                || _draw_groups.back().vertex_format != format
+                || _draw_groups.back().material != batch->material)
+            {
+                _draw_groups.push_back(
+                    DrawGroup{ format, batch->material, u32(commands.size()),
+                               0, {}, u32(batch - _batches.data()) });
+            }
+            _draw_groups.back().command_count += batch->mesh->lod_count();
+
+            const MeshRange &range = _mesh_pool.range(batch->mesh);
+            for (u32 i = 0; i != batch->mesh->lod_count(); ++i)
+            {
+                const MeshLod &lod = batch->mesh->lod(i);
+                commands.push_back(
+                    { lod.index_count, i ? 0 : u32(batch->objects.size()),
+                      range.first_index + lod.first_index, range.base_vertex,
+                      batch->first_instance });
+                culled_offsets.push_back(culled_count);
+                culled_count += u32(batch->objects.size());
+                dequantizations.push_back(mesh_dequantization(*batch->mesh));
+            }
+        }
+        for (DrawGroup &group : _draw_groups)
+        {
+            group.dequantizations = TypedBuffer<shader::MeshDequantization>(
+                dequantizations.data() + group.first_command,
+                group.command_count);
+        }
+
+        // Per instance culling data, in the same order as the transforms
+        std::vector<shader::CullingInstance> culling_instances;
+        for (size_t i = 0; i != _batches.size(); ++i)
+        {
+            const StaticMesh *mesh = _batches[i].mesh;
+            shader::CullingInstance instance = {};
+            instance.bounding_sphere =
+                glm::vec4(mesh->get_center(), mesh->get_radius());
+            instance.draw_index = batch_commands[i];
+            instance.lod_count = mesh->lod_count();
+            for (u32 k = 0; k != mesh->lod_count(); ++k)
+            {
+                instance.lod_errors[k] = mesh->lod(k).error;
             }
+            culling_instances.insert(culling_instances.end(),
+                                     _batches[i].objects.size(), instance);
+        }
+
+        if (commands.empty())
+        {
+            commands.emplace_back();
+            culled_offsets.emplace_back();
+        }
+        if (culling_instances.empty())
+        {
+            culling_instances.emplace_back();
+        }
+
+        _draw_commands =
+            TypedBuffer<shader::DrawElementsIndirectCommand>(commands);
+
+        // Culling writes its own instance counts and indices
+        for (size_t i = 0; i != commands.size(); ++i)
+        {
+            commands[i].instance_count = 0;
+            commands[i].base_instance = culled_offsets[i];
+        }
+        _empty_draw_commands =
+            TypedBuffer<shader::DrawElementsIndirectCommand>(commands);
+        _culled_draw_commands =
+            TypedBuffer<shader::DrawElementsIndirectCommand>(commands);
+        _culling_instances =
+            TypedBuffer<shader::CullingInstance>(culling_instances);
+        // The late occlusion pass fills the second half of the indices
+        const u32 late_offset = std::max(culled_count, u32(1));
+        for (auto &command : commands)
+        {
+            command.base_instance += late_offset;
         }
-        light_buffer.bind(BufferUsage::Storage, 1);
+        _empty_late_draw_commands =
+            TypedBuffer<shader::DrawElementsIndirectCommand>(commands);
+        _late_draw_commands =
+            TypedBuffer<shader::DrawElementsIndirectCommand>(commands);
+        _occluded_instances = TypedBuffer<u32>(
+            std::vector<u32>(culling_instances.size(), 0));
+        _culled_instances =
+            TypedBuffer<u32>(nullptr, size_t(late_offset) * 2);
 
-		// Fill and bind instance buffer
-        auto instances = Instances();
-        for (const auto& obj : _objects)
+        _draw_commands_dirty = false;
+    }
+
+    void Scene::cull_instances_gpu(float lod_factor, CullPass pass) const
+    {
+        GPU_PROFILE_SCOPE("GPU culling");
+
+        // Stats are double buffered over a full ring buffer cycle, so the GPU
+        // is already done with the one we read here. The late pass adds to
+        // the stats of the early one.
+        TypedBuffer<shader::CullingStats> &stats_buffer =
+            _culling_stats[_frame_index % _culling_stats.size()];
+        if (!stats_buffer.byte_size())
+        {
+            const shader::CullingStats zero = {};
+            stats_buffer = TypedBuffer<shader::CullingStats>(&zero, 1);
+        }
+        else if (pass != CullPass::Late)
         {
-            auto mat = obj.get_material().get();
-            instances[mat].push_back(&obj);
+            auto mapping = stats_buffer.map(AccessType::ReadWrite);
+            const shader::CullingStats &stats = mapping[0];
+            _stats.visible_count =
+                std::min(stats.visible_count, _stats.object_count);
+            _stats.culled_count = _stats.object_count - _stats.visible_count;
+            _stats.occluded_count =
+                std::min(stats.occluded_count, _stats.culled_count);
+            _stats.triangle_count = stats.triangle_count;
+            std::copy(std::begin(stats.lod_instance_counts),
+                      std::end(stats.lod_instance_counts),
+                      _stats.lod_instance_counts.begin());
+            mapping[0] = {};
         }
 
-        for (const auto& e : instances)
+        auto &commands = pass == CullPass::Late ? _late_draw_commands
+                                                : _culled_draw_commands;
+        (pass == CullPass::Late ? _empty_late_draw_commands
+                                : _empty_draw_commands)
+            .copy_to(commands);
+
+        _transform_buffer.bind(BufferUsage::Storage, 2);
+        _culling_instances.bind(BufferUsage::Storage, 3);
+        _culled_instances.bind(BufferUsage::Storage, 4);
+        commands.bind(BufferUsage::Storage, 5);
+        stats_buffer.bind(BufferUsage::Storage, 6);
+        _occluded_instances.bind(BufferUsage::Storage, 7);
+
+        if (pass != CullPass::Frustum)
+        {
+            _depth_pyramid.bind(0);
+            _culling_program->set_uniform(HASH("occlusion_view_proj"),
+                                          _depth_pyramid_view_proj);
+            _culling_program->set_uniform(
+                HASH("depth_size"), glm::vec2(_depth_pyramid.depth_size()));
+        }
+
+        const u32 instance_count = u32(_culling_instances.element_count());
+        _culling_program->set_uniform(HASH("instance_count"), instance_count);
+        _culling_program->set_uniform(HASH("lod_factor"), lod_factor);
+        _culling_program->set_uniform(HASH("cull_pass"), u32(pass));
+        _culling_program->bind();
+        glDispatchCompute((instance_count + 63) / 64, 1, 1);
+
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT
+                        | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+        _culled_instances.bind(BufferUsage::Storage, 12);
+    }
+
+    void Scene::cull_occluded_instances(const Camera &camera,
+                                        const RenderSettings &settings) const
+    {
+        // The largest opaque instances on screen are the occluders
+        const glm::vec3 camera_position = camera.position();
+        const float focal = camera.projection_matrix()[1][1];
+        std::vector<std::pair<float, u32>> occluders;
+        for (const u32 instance : _visible_instances)
         {
-            const auto tr_buffer = std::make_shared<TypedBuffer<shader::ModelTransform>>(
-                nullptr, 
-                std::max(e.second.size(), (size_t)1)
-            );
+            const SceneObject &object = _objects[_instance_objects[instance]];
+            if (!object.get_material()->culls_back_faces())
+            {
+                continue;
+            }
+
+            const float size =
+                screen_size(_instance_spheres[instance], camera_position, focal);
+            if (size >= settings.occluder_size)
             {
-                // Mapping model transforms to SSBO
-                auto mapping = tr_buffer->map(AccessType::WriteOnly);
-                for (int i = 0; i < e.second.size(); ++i) 
+                occluders.emplace_back(size, instance);
+            }
+        }
+
+        const size_t occluder_count = std::min(occluders.size(), max_occluders);
+        std::partial_sort(occluders.begin(),
+                          occluders.begin() + occluder_count, occluders.end(),
+                          std::greater<>());
+
+        _occlusion_buffer.clear(camera.view_proj_matrix());
+        for (size_t i = 0; i != occluder_count; ++i)
+        {
+            const u32 instance = occluders[i].second;
+            const SceneObject &object = _objects[_instance_objects[instance]];
+            _occlusion_buffer.add_occluder(
+                object.get_mesh()->occluder(),
+                _instance_transforms[instance].transform);
+        }
+        _occlusion_buffer.rasterize(true);
+
+        // Test in parallel, then compact in place to keep the order
+        static constexpr size_t chunk_size = 64;
+        const size_t count = _visible_instances.size();
+        _instance_visibility.resize(count);
+        ThreadPool::global().parallel_for(
+            (count + chunk_size - 1) / chunk_size, [&](size_t chunk) {
+                const size_t end = std::min(count, (chunk + 1) * chunk_size);
+                for (size_t i = chunk * chunk_size; i != end; ++i)
+                {
+                    _instance_visibility[i] = _occlusion_buffer.is_visible(
+                        _instance_bounds[_visible_instances[i]]);
+                }
+            });
+
+        size_t visible = 0;
+        for (size_t i = 0; i != count; ++i)
+        {
+            if (_instance_visibility[i])
+            {
+                _visible_instances[visible++] = _visible_instances[i];
+            }
+        }
+        _visible_instances.resize(visible);
+        _stats.occluded_count = u32(count - visible);
+    }
+
+    Span<const Scene::DrawPass> Scene::draw_passes(bool depth_prepass,
+                                                   bool deferred)
+    {
+        static constexpr DrawPass color[] = { DrawPass::Color };
+        static constexpr DrawPass prepass[] = { DrawPass::Depth,
+                                                DrawPass::ColorEqual };
+        static constexpr DrawPass gbuffer[] = { DrawPass::GBuffer,
+                                                DrawPass::Forward };
+        static constexpr DrawPass gbuffer_prepass[] = {
+            DrawPass::Depth, DrawPass::GBufferEqual, DrawPass::Forward
+        };
+        if (deferred)
+        {
+            if (depth_prepass)
+            {
+                return gbuffer_prepass;
+            }
+            return gbuffer;
+        }
+        if (depth_prepass)
+        {
+            return prepass;
+        }
+        return color;
+    }
+
+    const char *Scene::pass_name(DrawPass pass)
+    {
+        switch (pass)
+        {
+        case DrawPass::Color:
+            return "Color pass";
+
+        case DrawPass::Depth:
+            return "Depth prepass";
+
+        case DrawPass::ColorEqual:
+            return "Color pass (equal)";
+
+        case DrawPass::GBuffer:
+            return "G-buffer pass";
+
+        case DrawPass::GBufferEqual:
+            return "G-buffer pass (equal)";
+
+        case DrawPass::Forward:
+            return "Forward pass";
+        }
+        return "Unknown pass";
+    }
+
+    void Scene::begin_pass(DrawPass pass) const
+    {
+        GPUProfiler::global().begin_scope(pass_name(pass));
+        switch (pass)
+        {
+        case DrawPass::Depth:
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            _depth_prepass_timer.begin();
+            break;
+
+        case DrawPass::GBuffer:
+        case DrawPass::GBufferEqual:
+            _gbuffer.bind();
+            [[fallthrough]];
+
+        case DrawPass::Color:
+        case DrawPass::ColorEqual:
+            _lit_pass_timer.begin();
+            _lit_samples_query.begin();
+            break;
+
+        case DrawPass::Forward:
+            break;
+        }
+    }
+
+    void Scene::end_pass(DrawPass pass) const
+    {
+        switch (pass)
+        {
+        case DrawPass::Depth:
+            _depth_prepass_timer.end();
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            break;
+
+        case DrawPass::Color:
+        case DrawPass::ColorEqual:
+        case DrawPass::GBuffer:
+        case DrawPass::GBufferEqual:
+            _lit_samples_query.end();
+            _lit_pass_timer.end();
+            glDepthMask(GL_TRUE);
+            if (pass == DrawPass::GBuffer || pass == DrawPass::GBufferEqual)
+            {
+                GPU_PROFILE_SCOPE("Deferred lighting");
+                _lighting_timer.begin();
+                _gbuffer.shade();
+                _lighting_timer.end();
+            }
+            break;
+
+        case DrawPass::Forward:
+            break;
+        }
+        GPUProfiler::global().end_scope();
+    }
+
+    bool Scene::bind_material(const Material &material, DrawPass pass) const
+    {
+        // Only opaque materials with the standard depth test are in the
+        // prepass and, if they can, in the G-buffer. The others are drawn as
+        // usual by the color or forward pass.
+        const bool opaque = material.culls_back_faces()
+            && material.depth_test_mode() == DepthTestMode::Standard;
+        const bool deferred = opaque && material.has_gbuffer_program();
+        switch (pass)
+        {
+        case DrawPass::Color:
+            material.bind();
+            return true;
+
+        case DrawPass::Depth:
+            if (!opaque)
+            {
+                return false;
+            }
+            _depth_material.bind();
+            return true;
+
+        case DrawPass::ColorEqual:
+            material.bind(opaque ? DepthTestMode::Equal
+                                 : material.depth_test_mode());
+            return true;
+
+        case DrawPass::GBuffer:
+        case DrawPass::GBufferEqual:
+            if (!deferred)
+            {
+                return false;
+            }
+            material.bind_gbuffer(pass == DrawPass::GBufferEqual
+                                      ? DepthTestMode::Equal
+                                      : DepthTestMode::Standard);
+            return true;
+
+        case DrawPass::Forward:
+            if (deferred)
+            {
+                return false;
+            }
+            material.bind();
+            return true;
+        }
+        return false;
+    }
+
+    void Scene::draw_batches(Span<const DrawPass> passes) const
+    {
+        for (const DrawPass pass : passes)
+        {
+            begin_pass(pass);
+            for (const InstanceBatch &batch : _batches)
+            {
+                if (batch.ready && bind_material(*batch.material, pass))
                 {
-                    const SceneObject* obj = e.second[i];
-                    mapping[i] = { obj->transform() };
+                    GPU_PROFILE_SCOPE("Batch");
+                    batch.dequantization.bind(BufferUsage::Storage, 11);
+                    batch.mesh->draw_instanced(batch.objects.size(),
+                                               batch.first_instance);
+                    ++_stats.draw_call_count;
                 }
             }
-            tr_buffer->bind(BufferUsage::Storage, 2);
+            end_pass(pass);
+        }
+
+        for (const InstanceBatch &batch : _batches)
+        {
+            _stats.triangle_count +=
+                u32(batch.objects.size() * batch.mesh->lod(0).index_count / 3);
+            _stats.lod_instance_counts[0] += u32(batch.objects.size());
+        }
+    }
+
+    void Scene::draw_batches_culled(const Camera &camera,
+                                    const RenderSettings &settings,
+                                    float lod_factor,
+                                    Span<const DrawPass> passes) const
+    {
+        PROFILE_ZONE("Scene::draw_batches_culled");
 
-            auto mesh = e.second[0]->get_mesh();
-            e.first->bind();
-            mesh->draw_instanced(e.second.size());
+        if (!settings.cpu_culling)
+        {
+            _visible_instances.resize(_instance_transforms.size());
+            std::iota(_visible_instances.begin(), _visible_instances.end(), 0);
+        }
+        else if (settings.bvh_culling)
+        {
+            // The batch walk below needs the indices in order
+            _visible_instances.clear();
+            _bvh.cull(camera.build_frustum_planes(), _visible_instances);
+            std::sort(_visible_instances.begin(), _visible_instances.end());
+        }
+        else
+        {
+            _culler.cull(camera.build_frustum_planes(), _visible_instances);
+        }
+
+        if (settings.software_occlusion)
+        {
+            cull_occluded_instances(camera, settings);
         }
-		
-		// Frustum culling
-        /*
-        OM3D::Frustum frustum = camera.build_frustum();
-        for (const SceneObject &obj : _objects)
+
+        const size_t visible_count = _visible_instances.size();
+        if (settings.cpu_culling || settings.software_occlusion)
         {
-            const auto transform = obj.transform();
-            const glm::vec3 scale = glm::vec3(glm::length(transform[0]),
-                                              glm::length(transform[1]),
-                                              glm::length(transform[2]));
-            const float max_scale = std::max(std::max(scale.x, scale.y), scale.z);
-            int inside = 0;
-            for (auto normal : {frustum._top_normal, frustum._bottom_normal,
-                                frustum._left_normal, frustum._right_normal,
-                                frustum._near_normal})
+            _stats.visible_count = u32(visible_count);
+            _stats.culled_count = u32(_culler.size() - visible_count);
+        }
+
+        // Coarsest LOD whose projected error is small enough
+        const glm::vec3 camera_position = camera.position();
+        auto select_lod = [&](const StaticMesh *mesh, u32 instance) {
+            const glm::vec4 &sphere = _instance_spheres[instance];
+            const float distance = std::max(
+                glm::length(glm::vec3(sphere) - camera_position) - sphere.w,
+                0.0f);
+            const float scale = _instance_scales[instance] * lod_factor;
+
+            u8 lod = 0;
+            for (u32 l = 1; l < mesh->lod_count(); ++l)
             {
-                const auto center = obj.get_mesh()->get_center();
-                const auto mesh_pos_world = transform * glm::vec4(center, 1) + glm::vec4(normal, 1) * obj.get_mesh()->get_radius() * max_scale;
-                const auto ray = mesh_pos_world - glm::vec4(camera.position(), 1);
-                const bool is_in = glm::dot(ray, glm::vec4(normal, 1)) > 0.0f;
-                if (is_in)
-                    inside++;
+                if (mesh->lod(l).error * scale <= distance)
+                {
+                    lod = u8(l);
+                }
             }
-            if (inside >= 5)
+            return lod;
+        };
+
+        // Full detail instances large enough on screen are meshlet culled,
+        // they are counted in an extra bucket after the LODs
+        const float focal = camera.projection_matrix()[1][1];
+        static constexpr u32 meshlet_bucket = max_lod_count;
+        auto is_meshlet_culled = [&](const StaticMesh *mesh, u32 instance) {
+            return settings.meshlet_culling
+                && mesh->meshlet_count() >= min_culled_meshlets
+                && screen_size(_instance_spheres[instance], camera_position,
+                               focal)
+                       >= settings.meshlet_size;
+        };
+
+        // Visible indices are sorted, so the instances of each batch are
+        // contiguous. They are compacted LOD by LOD, so every (batch, LOD)
+        // pair is a single instanced draw.
+
+        struct LodDraw
+        {
+            const InstanceBatch *batch = nullptr;
+            u32 lod = 0;
+            u32 first_instance = 0;
+            u32 instance_count = 0;
+
+            // Meshlet commands of the meshlet culled instances, and the
+            // dequantization of each
+            bool use_meshlets = false;
+            u32 first_command = 0;
+            u32 command_count = 0;
+            RingAllocation<shader::MeshDequantization> dequantizations = {};
+        };
+        std::vector<LodDraw> draws;
+
+        _drawn_instances.resize(visible_count);
+        size_t first = 0;
+        for (const InstanceBatch &batch : _batches)
+        {
+            const u32 batch_end =
+                batch.first_instance + u32(batch.objects.size());
+
+            size_t last = first;
+            while (last != visible_count
+                   && _visible_instances[last] < batch_end)
             {
-                obj.render();
+                ++last;
             }
+
+            _instance_lods.resize(last);
+            std::array<u32, max_lod_count + 1> counts = {};
+            for (size_t i = first; i != last; ++i)
+            {
+                const u32 instance = _visible_instances[i];
+                _instance_lods[i] =
+                    lod_factor > 0.0f ? select_lod(batch.mesh, instance) : 0;
+                if (!_instance_lods[i]
+                    && is_meshlet_culled(batch.mesh, instance))
+                {
+                    _instance_lods[i] = meshlet_bucket;
+                }
+                ++counts[_instance_lods[i]];
+            }
+
+            std::array<u32, max_lod_count + 1> offsets = {};
+            u32 offset = u32(first);
+            for (u32 l = 0; l != counts.size(); ++l)
+            {
+                offsets[l] = offset;
+                if (counts[l])
+                {
+                    const bool meshlets = l == meshlet_bucket;
+                    draws.push_back(LodDraw{ &batch, meshlets ? 0 : l, offset,
+                                             counts[l], meshlets });
+                }
+                offset += counts[l];
+            }
+
+            for (size_t i = first; i != last; ++i)
+            {
+                const u32 slot = offsets[_instance_lods[i]]++;
+                _drawn_instances[slot] = _visible_instances[i];
+            }
+
+            first = last;
+        }
+        auto indices = _frame_buffer.allocate_bindable<u32>(visible_count);
+        std::copy(_drawn_instances.begin(), _drawn_instances.end(),
+                  indices.data);
+        _frame_buffer.bind(indices, BufferUsage::Storage, 12);
+
+        // Meshlet culled instances draw their visible meshlets with one
+        // indirect command each, there is room for all of them
+        size_t max_meshlet_commands = 0;
+        for (const LodDraw &draw : draws)
+        {
+            if (draw.use_meshlets)
+            {
+                max_meshlet_commands += size_t(draw.instance_count)
+                    * draw.batch->mesh->meshlet_count();
+            }
+        }
+        auto commands =
+            _frame_buffer.allocate<shader::DrawElementsIndirectCommand>(
+                max_meshlet_commands);
+        if (max_meshlet_commands)
+        {
+            _frame_buffer.bind(BufferUsage::Indirect);
+        }
+
+        // Meshlet commands are all built before drawing, so every pass draws
+        // the same ones
+        const FrustumPlanes planes = camera.build_frustum_planes();
+        size_t command_count = 0;
+        for (LodDraw &draw : draws)
+        {
+            const StaticMesh *mesh = draw.batch->mesh;
+            if (!draw.use_meshlets)
+            {
+                _stats.triangle_count +=
+                    draw.instance_count * (mesh->lod(draw.lod).index_count / 3);
+                _stats.lod_instance_counts[draw.lod] += draw.instance_count;
+                continue;
+            }
+
+            draw.first_command = u32(command_count);
+            for (u32 slot = draw.first_instance;
+                 slot != draw.first_instance + draw.instance_count; ++slot)
+            {
+                const u32 instance = _drawn_instances[slot];
+                const glm::mat4 &transform =
+                    _instance_transforms[instance].transform;
+                const float scale = _instance_scales[instance];
+                if (!(scale > 0.0f))
+                {
+                    continue;
+                }
+
+                mesh->meshlet_culler().cull(
+                    object_space_planes(planes, transform, scale),
+                    _visible_meshlets);
+
+                // Cones are tested in object space, which keeps facing unless
+                // the transform mirrors the mesh
+                const bool cull_back_faces =
+                    draw.batch->material->culls_back_faces()
+                    && glm::determinant(glm::mat3(transform)) > 0.0f;
+                const glm::vec3 eye = glm::vec3(
+                    glm::inverse(transform) * glm::vec4(camera_position, 1.0f));
+
+                for (const u32 index : _visible_meshlets)
+                {
+                    const Meshlet &meshlet = mesh->meshlet(index);
+                    if (cull_back_faces && is_back_facing(meshlet, eye))
+                    {
+                        continue;
+                    }
+                    commands[command_count++] = { meshlet.index_count, 1,
+                                                  meshlet.first_index, 0,
+                                                  slot };
+                    _stats.triangle_count += meshlet.index_count / 3;
+                }
+            }
+            draw.command_count = u32(command_count) - draw.first_command;
+
+            draw.dequantizations =
+                _frame_buffer.allocate_bindable<shader::MeshDequantization>(
+                    draw.command_count);
+            std::fill_n(draw.dequantizations.data, draw.command_count,
+                        mesh_dequantization(*mesh));
+
+            const u32 meshlet_count =
+                u32(draw.instance_count * mesh->meshlet_count());
+            _stats.meshlet_count += meshlet_count;
+            _stats.culled_meshlet_count += meshlet_count - draw.command_count;
+            _stats.lod_instance_counts[0] += draw.instance_count;
+        }
+
+        for (const DrawPass pass : passes)
+        {
+            begin_pass(pass);
+            const Material *bound_material = nullptr;
+            bool skip_material = false;
+            for (const LodDraw &draw : draws)
+            {
+                if (draw.batch->material != bound_material)
+                {
+                    bound_material = draw.batch->material;
+                    skip_material = !draw.batch->ready
+                        || !bind_material(*bound_material, pass);
+                }
+                if (skip_material)
+                {
+                    continue;
+                }
+
+                GPU_PROFILE_SCOPE("Batch");
+                const StaticMesh *mesh = draw.batch->mesh;
+                if (!draw.use_meshlets)
+                {
+                    draw.batch->dequantization.bind(BufferUsage::Storage, 11);
+                    mesh->draw_instanced(draw.instance_count,
+                                         draw.first_instance, draw.lod);
+                    ++_stats.draw_call_count;
+                }
+                else if (draw.command_count)
+                {
+                    _frame_buffer.bind(draw.dequantizations,
+                                       BufferUsage::Storage, 11);
+                    mesh->draw_indirect(
+                        commands.offset
+                            + draw.first_command
+                                * sizeof(shader::DrawElementsIndirectCommand),
+                        draw.command_count);
+                    ++_stats.draw_call_count;
+                }
+            }
+            end_pass(pass);
+        }
+    }
+
+    void Scene::draw_batches_indirect(bool culled, float lod_factor,
+                                      const Camera &camera,
+                                      const Texture *occlusion_depth,
+                                      Span<const DrawPass> passes) const
+    {
+        if (_draw_commands_dirty)
+        {
+            update_draw_commands();
+        }
+
+        if (_draw_groups.empty())
+        {
+            return;
+        }
+
+        // The pyramid of the previous frame can only be used if it matches
+        // the depth buffer
+        const bool early_occlusion = culled && occlusion_depth
+            && _depth_pyramid_frame + 1 == _frame_index
+            && _depth_pyramid.depth_size() == occlusion_depth->size();
+
+        if (culled)
+        {
+            cull_instances_gpu(lod_factor, early_occlusion ? CullPass::Early
+                                                           : CullPass::Frustum);
+        }
+        else
+        {
+            for (const InstanceBatch &batch : _batches)
+            {
+                _stats.triangle_count += u32(batch.objects.size()
+                                             * batch.mesh->lod(0).index_count
+                                             / 3);
+                _stats.lod_instance_counts[0] += u32(batch.objects.size());
+            }
+        }
+
+        const auto &commands = culled ? _culled_draw_commands : _draw_commands;
+
+        // The first pass fills the depth buffer, the occlusion passes run
+        // within it
+        begin_pass(passes[0]);
+        submit_draw_groups(commands, passes[0]);
+
+        bool late_draws = false;
+        if (culled && occlusion_depth)
+        {
+            // Build the pyramid from what was just drawn, and draw the
+            // instances that were hidden last frame but are not anymore
+            if (_depth_pyramid.depth_size() != occlusion_depth->size())
+            {
+                _depth_pyramid = DepthPyramid(occlusion_depth->size());
+            }
+            {
+                GPU_PROFILE_SCOPE("Depth pyramid");
+                _depth_pyramid.build(*occlusion_depth);
+            }
+            _depth_pyramid_view_proj = camera.view_proj_matrix();
+            _depth_pyramid_frame = _frame_index;
+
+            if (early_occlusion)
+            {
+                cull_instances_gpu(lod_factor, CullPass::Late);
+                submit_draw_groups(_late_draw_commands, passes[0]);
+                late_draws = true;
+            }
+        }
+        end_pass(passes[0]);
+
+        for (size_t i = 1; i != passes.size(); ++i)
+        {
+            begin_pass(passes[i]);
+            submit_draw_groups(commands, passes[i]);
+            if (late_draws)
+            {
+                submit_draw_groups(_late_draw_commands, passes[i]);
+            }
+            end_pass(passes[i]);
+        }
+    }
+
+    void Scene::submit_draw_groups(
+        const TypedBuffer<shader::DrawElementsIndirectCommand> &commands,
+        DrawPass pass) const
+    {
+        commands.bind(BufferUsage::Indirect);
+
+        const DrawGroup *previous = nullptr;
+        for (const DrawGroup &group : _draw_groups)
+        {
+            if (!_batches[group.first_batch].ready
+                || !bind_material(*group.material, pass))
+            {
+                continue;
+            }
+
+            if (!previous || previous->vertex_format != group.vertex_format)
+            {
+                _mesh_pool.setup(group.vertex_format);
+            }
+            previous = &group;
+
+            GPU_PROFILE_SCOPE("Batch");
+            DEBUG_ASSERT(group.dequantizations.element_count()
+                         == group.command_count);
+            group.dequantizations.bind(BufferUsage::Storage, 11);
+            glMultiDrawElementsIndirect(
+                GL_TRIANGLES, GL_UNSIGNED_INT,
+                reinterpret_cast<const void *>(
+                    group.first_command
+                    * sizeof(shader::DrawElementsIndirectCommand)),
+                GLsizei(group.command_count), 0);
+            ++_stats.draw_call_count;
         }
-		*/
     }
 
 } // namespace OM3D
@@ -1,35 +1,380 @@
 #ifndef SCENE_H
 #define SCENE_H
 
+#include <BVH.h>
 #include <Camera.h>
+#include <DepthPyramid.h>
+#include <FrustumCuller.h>
+#include <GBuffer.h>
+#include <GPUQuery.h>
+#include <LightClusters.h>
+#include <MeshPool.h>
 #include <PointLight.h>
+#include <Program.h>
+#include <RingBuffer.h>
 #include <SceneObject.h>
+#include <TypedBuffer.h>
+#include <shader_structs.h>
+
+#include <map>
 #include <memory>
 #include <vector>
-#include <unordered_map>
 
 namespace OM3D
 {
 
+    struct SceneImportSettings
+    {
+        // Decode meshes and textures on the global thread pool
+        bool multithreaded = true;
+
+        // Load from, or write, a preprocessed cache next to the source file
+        bool use_cache = true;
+
+        // Vertex format of the imported meshes
+        VertexFormat vertex_format = VertexFormat::Full;
+
+        // Reorder triangles and vertices for vertex cache and fetch locality
+        bool optimize_meshes = true;
+
+        // Also reorder triangle clusters to reduce overdraw, at the cost of
+        // a slightly worse vertex cache usage
+        bool optimize_overdraw = false;
+
+        // Levels of detail generated per mesh, including the full detail
+        // one, up to max_lod_count
+        u32 lod_count = max_lod_count;
+
+        // Split the full detail level of meshes in meshlets, with bounds
+        // for per meshlet culling
+        bool build_meshlets = true;
+    };
+
+    struct RenderSettings
+    {
+        // Pack all meshes in shared buffers and submit every batch using the
+        // same material with a single glMultiDrawElementsIndirect
+        bool multi_draw_indirect = false;
+
+        // Frustum cull instances in a compute shader that writes the indirect
+        // commands, implies multi_draw_indirect
+        bool gpu_culling = false;
+
+        // Two-phase Hi-Z occlusion culling, with gpu_culling only. Instances
+        // hidden in the depth pyramid of the previous frame are skipped, then
+        // tested again against a pyramid of the depth drawn so far and drawn
+        // if they turn out visible. Needs the depth buffer given to render.
+        bool occlusion_culling = false;
+
+        // Frustum cull instances on the CPU and draw the visible ones batch by
+        // batch, ignored when gpu_culling is set
+        bool cpu_culling = false;
+
+        // Traverse the scene BVH for CPU culling instead of testing every
+        // instance
+        bool bvh_culling = false;
+
+        // Rasterize the largest opaque instances on the CPU into a small
+        // depth buffer, and skip the instances hidden behind them. Uses the
+        // CPU path like lod_selection, ignored when gpu_culling is set.
+        bool software_occlusion = false;
+
+        // Instances whose bounding sphere covers less of the screen height
+        // are never used as occluders
+        float occluder_size = 0.2f;
+
+        // Draw each instance with the coarsest LOD of its mesh whose error,
+        // projected on screen, is below lod_threshold. Selected in the culling
+        // shader with gpu_culling, on the CPU otherwise (multi_draw_indirect
+        // is then ignored).
+        bool lod_selection = false;
+
+        // Relative to the screen height
+        float lod_threshold = 0.001f;
+
+        // Frustum and back face cull the meshlets of the instances drawn at
+        // full detail on the CPU, and draw the remaining ones with a
+        // glMultiDrawElementsIndirect per instance. Uses the CPU path like
+        // lod_selection, meshes without meshlets are drawn whole.
+        bool meshlet_culling = false;
+
+        // Only instances whose bounding sphere covers at least that much of
+        // the screen height are meshlet culled, the many small ones would
+        // cost more commands than they save triangles
+        float meshlet_size = 0.25f;
+
+        // Assign the point lights to a grid of view frustum clusters in a
+        // compute shader, so every fragment only shades the lights of its
+        // cluster. The grid is screen tiles times depth slices, the slices
+        // grow exponentially between cluster_near and cluster_far.
+        bool clustered_lighting = false;
+        glm::uvec3 cluster_grid = glm::uvec3(16, 9, 24);
+        float cluster_near = 0.1f;
+        float cluster_far = 1000.0f;
+
+        // Color fragments by the light count of their cluster instead
+        bool show_light_clusters = false;
+
+        // Draw the depth of opaque materials first with a position only
+        // shader, then shade them with an equal depth test and no depth
+        // writes, so every pixel is lit once
+        bool depth_prepass = false;
+
+        // Draw opaque materials into a G-buffer, and light it in a compute
+        // shader that culls the lights per 16x16 tile. Needs the depth and
+        // lit attachments given to render, clustered_lighting is ignored.
+        bool deferred_shading = false;
+    };
+
+    struct RenderStats
+    {
+        u32 object_count = 0;
+
+        // Only counted when culling is enabled. GPU culling results are read
+        // back a few frames late to avoid stalling.
+        u32 visible_count = 0;
+        u32 culled_count = 0;
+
+        // Instances in the frustum hidden by occlusion culling, included in
+        // culled_count
+        u32 occluded_count = 0;
+
+        // GPU memory used by the geometry of the drawn meshes
+        size_t vertex_bytes = 0;
+        size_t index_bytes = 0;
+
+        // Drawn triangles and instances per LOD, read back late as well with
+        // GPU culling
+        u32 triangle_count = 0;
+        std::array<u32, max_lod_count> lod_instance_counts = {};
+
+        // Draw calls of every pass, a multi draw counts as one
+        u32 draw_call_count = 0;
+
+        // Meshlets of the instances drawn with meshlet culling
+        u32 meshlet_count = 0;
+        u32 culled_meshlet_count = 0;
+
+        // GPU time of the depth prepass and of the lit pass, and samples
+        // passing the depth test in the lit pass (overdraw times pixels),
+        // read back a few frames late. With occlusion culling, the first of
+        // the two passes also builds the depth pyramid and runs the late
+        // culling.
+        float depth_prepass_ms = 0.0f;
+        float lit_pass_ms = 0.0f;
+        u64 lit_samples = 0;
+
+        // Deferred shading only, the lit pass above writes the G-buffer
+        float lighting_ms = 0.0f;
+        u32 gbuffer_bytes_per_pixel = 0;
+
+        // Clustered lighting only, lights ignored in clusters that were
+        // full, read back a few frames late
+        u32 dropped_cluster_lights = 0;
+
+        // Deferred shading only, same for the lights of full tiles
+        u32 dropped_tile_lights = 0;
+    };
+
     class Scene : NonMovable
     {
     public:
         Scene();
 
         static Result<std::unique_ptr<Scene>>
-        from_gltf(const std::string &file_name);
+        from_gltf(const std::string &file_name,
+                  const SceneImportSettings &settings = {});
 
-        void render(const Camera &camera) const;
+        // depth and lit are the attachments of the bound framebuffer. depth
+        // is read by occlusion culling, both are needed by deferred shading.
+        void render(const Camera &camera, const RenderSettings &settings = {},
+                    Texture *depth = nullptr, Texture *lit = nullptr) const;
 
         void add_object(SceneObject obj);
         void add_object(PointLight obj);
 
-		typedef std::vector<const SceneObject*> SceneObjectList;
-		typedef std::unordered_map<Material*, SceneObjectList> Instances;
-        
+        // Moves an object, index is the order in which it was added.
+        // Transforms are uploaded again with the next render.
+        void set_object_transform(u32 index, const glm::mat4 &transform);
+
+        const RenderStats &stats() const;
+
+        // Closest object whose bounding box is hit by the ray
+        Result<u32> pick(const Ray &ray) const;
+
+        // Appends the objects whose bounding boxes overlap box
+        void query_objects(const AABB &box, std::vector<u32> &objects) const;
+
+        // World space bounds of every object
+        AABB bounds() const;
+
+        // Blocks until the programs of every material and pass are built, so
+        // the next render draws everything as set
+        void wait_for_programs() const;
+
+        // Objects sharing a mesh and a material, drawn with a single
+        // instanced draw call. Their transforms are stored contiguously in the
+        // scene transform buffer, starting at first_instance.
+        struct InstanceBatch
+        {
+            const StaticMesh *mesh = nullptr;
+            const Material *material = nullptr;
+            std::vector<u32> objects;
+            u32 first_instance = 0;
+
+            // Single entry bound with every instanced draw of the batch, where
+            // gl_DrawIDARB is 0
+            TypedBuffer<shader::MeshDequantization> dequantization;
+
+            // Whether the programs of the material are built, checked once
+            // per frame. Batches that are not ready are skipped by every pass.
+            bool ready = false;
+        };
+
     private:
+        enum class CullPass : u32
+        {
+            Frustum,
+            Early,
+            Late,
+        };
+
+        enum class DrawPass : u32
+        {
+            Color,
+            Depth,
+            // Color over the depth pass
+            ColorEqual,
+            // Deferred shading, opaque materials are lit at the end of the
+            // G-buffer passes and the others drawn by the forward pass
+            GBuffer,
+            GBufferEqual,
+            Forward,
+        };
+
+        // Consecutive indirect commands sharing a vertex format and a material
+        struct DrawGroup
+        {
+            VertexFormat vertex_format = VertexFormat::Full;
+            const Material *material = nullptr;
+            u32 first_command = 0;
+            u32 command_count = 0;
+
+            // Mesh of each command, indexed with gl_DrawIDARB
+            TypedBuffer<shader::MeshDequantization> dequantizations;
+
+            // Any batch of the group, they share its material readiness
+            u32 first_batch = 0;
+        };
+
+        void update_transform_buffer() const;
+        void update_draw_commands() const;
+
+        // Passes drawn by every path, with or without a depth prepass
+        static Span<const DrawPass> draw_passes(bool depth_prepass,
+                                                bool deferred);
+        static const char *pass_name(DrawPass pass);
+        void begin_pass(DrawPass pass) const;
+        void end_pass(DrawPass pass) const;
+
+        // Returns false if the material is not drawn in that pass
+        bool bind_material(const Material &material, DrawPass pass) const;
+
+        void draw_batches(Span<const DrawPass> passes) const;
+        void draw_batches_indirect(bool culled, float lod_factor,
+                                   const Camera &camera,
+                                   const Texture *occlusion_depth,
+                                   Span<const DrawPass> passes) const;
+        void submit_draw_groups(
+            const TypedBuffer<shader::DrawElementsIndirectCommand> &commands,
+            DrawPass pass) const;
+        void draw_batches_culled(const Camera &camera,
+                                 const RenderSettings &settings,
+                                 float lod_factor,
+                                 Span<const DrawPass> passes) const;
+
+        void cull_instances_gpu(float lod_factor, CullPass pass) const;
+        void cull_occluded_instances(const Camera &camera,
+                                     const RenderSettings &settings) const;
+
         std::vector<SceneObject> _objects;
         std::vector<PointLight> _point_lights;
+
+        mutable std::vector<InstanceBatch> _batches;
+        std::map<std::pair<const StaticMesh *, const Material *>, size_t>
+            _batch_indices;
+
+        mutable TypedBuffer<shader::ModelTransform> _transform_buffer;
+        mutable bool _transforms_dirty = true;
+
+        // Indices of every instance in order, read by the draws that are not
+        // culled
+        mutable TypedBuffer<u32> _instance_indices;
+
+        // CPU copy of the transforms and their bounds, for CPU culling and
+        // queries. Instances are in the transform buffer order.
+        mutable std::vector<shader::ModelTransform> _instance_transforms;
+        mutable std::vector<u32> _instance_objects;
+        mutable std::vector<AABB> _instance_bounds;
+        mutable std::vector<glm::vec4> _instance_spheres;
+        mutable std::vector<float> _instance_scales;
+        mutable FrustumCuller _culler;
+        mutable BVH _bvh;
+        mutable std::vector<u32> _visible_instances;
+        mutable std::vector<u8> _instance_lods;
+        mutable std::vector<u32> _drawn_instances;
+        mutable std::vector<u32> _visible_meshlets;
+        mutable OcclusionBuffer _occlusion_buffer;
+        mutable std::vector<u8> _instance_visibility;
+
+        // Multi-draw-indirect data, only built when that path is used
+        mutable MeshPool _mesh_pool;
+        mutable TypedBuffer<shader::DrawElementsIndirectCommand>
+            _draw_commands;
+        mutable std::vector<DrawGroup> _draw_groups;
+        mutable bool _mesh_pool_dirty = true;
+        mutable bool _draw_commands_dirty = true;
+
+        // GPU culling data, built along with the draw commands
+        mutable std::shared_ptr<Program> _culling_program;
+        mutable TypedBuffer<shader::CullingInstance> _culling_instances;
+        mutable TypedBuffer<u32> _culled_instances;
+        mutable TypedBuffer<shader::DrawElementsIndirectCommand>
+            _culled_draw_commands;
+        mutable TypedBuffer<shader::DrawElementsIndirectCommand>
+            _empty_draw_commands;
+        mutable std::array<TypedBuffer<shader::CullingStats>,
+                           RingBuffer::default_frames_in_flight>
+            _culling_stats;
+
+        // Occlusion culling data. Instances drawn by the late pass use their
+        // own commands, and the second half of the culled instances.
+        mutable TypedBuffer<u32> _occluded_instances;
+        mutable TypedBuffer<shader::DrawElementsIndirectCommand>
+            _late_draw_commands;
+        mutable TypedBuffer<shader::DrawElementsIndirectCommand>
+            _empty_late_draw_commands;
+        mutable DepthPyramid _depth_pyramid;
+        mutable glm::mat4 _depth_pyramid_view_proj = glm::mat4(1.0f);
+        mutable u64 _depth_pyramid_frame = u64(-1);
+
+        mutable RenderStats _stats;
+        mutable u64 _frame_index = 0;
+
+        mutable LightClusters _light_clusters;
+
+        // Depth prepass program, deferred shading data, and the timings of
+        // the passes
+        mutable Material _depth_material;
+        mutable GBuffer _gbuffer;
+        mutable GPUQuery _depth_prepass_timer;
+        mutable GPUQuery _lit_pass_timer;
+        mutable GPUQuery _lighting_timer;
+        mutable GPUQuery _lit_samples_query;
+
+        // Per-frame data (frame constants, lights)
+        mutable RingBuffer _frame_buffer;
+
         glm::vec3 _sun_direction = glm::vec3(0.2f, 1.0f, 0.1f);
     };
 
@@ -0,0 +1,488 @@
+#include "SceneCache.h"
+
+#include <Texture.h>
+
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+
+namespace OM3D
+{
+
+    static constexpr u32 cache_magic = 0x53334D4F; // "OM3S"
+    static constexpr u32 cache_version = 5;
+    static constexpr size_t cache_alignment = 16;
+
+    // Identifies the source file the cache was built from
+    struct SourceKey
+    {
+        u64 size = 0;
+        i64 mtime = 0;
+        u64 hash = 0;
+    };
+
+    struct CacheHeader
+    {
+        u32 magic = cache_magic;
+        u32 version = cache_version;
+        u32 vertex_size = sizeof(Vertex);
+        u32 packed_vertex_size = sizeof(PackedVertex);
+        u32 vertex_format = 0;
+        u32 mesh_optimizations = 0;
+        u32 lod_count = 1;
+        u32 meshlets = 0;
+
+        SourceKey source;
+
+        u64 mesh_count = 0;
+        u64 texture_count = 0;
+        u64 material_count = 0;
+        u64 instance_count = 0;
+
+        u64 meshes_offset = 0;
+        u64 textures_offset = 0;
+        u64 materials_offset = 0;
+        u64 instances_offset = 0;
+    };
+
+    struct CachedMesh
+    {
+        u64 vertex_offset = 0;
+        u64 vertex_count = 0;
+        u64 index_offset = 0;
+        u64 index_count = 0;
+        u64 lod_offset = 0;
+        u64 lod_count = 0;
+        u64 meshlet_offset = 0;
+        u64 meshlet_count = 0;
+        MeshBounds bounds;
+    };
+
+    struct CachedTexture
+    {
+        u64 data_offset = 0;
+        u64 data_size = 0;
+        glm::uvec2 size = {};
+        u32 format = 0;
+        u32 mip_count = 0;
+    };
+
+    using CachedMaterial = SceneData::MaterialInfo;
+    using CachedInstance = SceneData::InstanceInfo;
+
+    static_assert(std::is_trivially_copyable_v<CacheHeader>
+                  && std::is_trivially_copyable_v<CachedMesh>
+                  && std::is_trivially_copyable_v<CachedTexture>
+                  && std::is_trivially_copyable_v<CachedMaterial>
+                  && std::is_trivially_copyable_v<CachedInstance>
+                  && std::is_trivially_copyable_v<Vertex>
+                  && std::is_trivially_copyable_v<PackedVertex>
+                  && std::is_trivially_copyable_v<MeshLod>
+                  && std::is_trivially_copyable_v<Meshlet>,
+                  "Cached types are written as raw bytes");
+
+    static u32 mesh_optimizations(const SceneCacheOptions &options)
+    {
+        return (options.optimize_meshes ? 1 : 0)
+             | (options.optimize_meshes && options.optimize_overdraw ? 2 : 0);
+    }
+
+    static Result<SourceKey> source_key(const std::string &source_file,
+                                        bool with_hash)
+    {
+        std::error_code error;
+        const auto mtime = std::filesystem::last_write_time(source_file, error);
+        const auto size = std::filesystem::file_size(source_file, error);
+        if (error)
+        {
+            return { false, {} };
+        }
+
+        SourceKey key;
+        key.size = u64(size);
+        key.mtime = i64(mtime.time_since_epoch().count());
+
+        if (with_hash)
+        {
+            const auto file = MappedFile::open(source_file);
+            if (!file.is_ok)
+            {
+                return { false, {} };
+            }
+            key.hash = hash_bytes(file.value.data(), file.value.size());
+        }
+
+        return { true, key };
+    }
+
+    std::string SceneCache::cache_file_name(const std::string &source_file)
+    {
+        return source_file + ".om3dcache";
+    }
+
+    const SceneData &SceneCache::data() const
+    {
+        return _data;
+    }
+
+    Result<SceneCache> SceneCache::open(const std::string &source_file,
+                                        const SceneCacheOptions &options)
+    {
+        const VertexFormat vertex_format = options.vertex_format;
+
+        auto file = MappedFile::open(cache_file_name(source_file));
+        if (!file.is_ok)
+        {
+            return { false, {} };
+        }
+
+        const byte *begin = file.value.data();
+        const size_t file_size = file.value.size();
+
+        auto in_file = [&](u64 offset, u64 count, size_t elem_size) {
+            return offset % cache_alignment == 0 && offset <= file_size
+                && count <= (file_size - offset) / elem_size;
+        };
+
+        if (file_size < sizeof(CacheHeader))
+        {
+            return { false, {} };
+        }
+
+        CacheHeader header;
+        std::memcpy(&header, begin, sizeof(header));
+        if (header.magic != cache_magic || header.version != cache_version
+            || header.vertex_size != sizeof(Vertex)
+            || header.packed_vertex_size != sizeof(PackedVertex)
+            || header.vertex_format != u32(vertex_format)
+            || header.mesh_optimizations != mesh_optimizations(options)
+            || header.lod_count != options.lod_count
+            || header.meshlets != u32(options.build_meshlets))
+        {
+            return { false, {} };
+        }
+
+        // Size and mtime are enough to know the source did not change, hash
+        // it only if they differ
+        {
+            const auto key = source_key(source_file, false);
+            if (!key.is_ok || key.value.size != header.source.size)
+            {
+                return { false, {} };
+            }
+            if (key.value.mtime != header.source.mtime)
+            {
+                const auto hashed = source_key(source_file, true);
+                if (!hashed.is_ok || hashed.value.hash != header.source.hash)
+                {
+                    return { false, {} };
+                }
+
+                // Store the new mtime so later launches do not hash again
+                std::fstream out(cache_file_name(source_file),
+                                 std::ios::binary | std::ios::in
+                                     | std::ios::out);
+                out.seekp(offsetof(CacheHeader, source)
+                          + offsetof(SourceKey, mtime));
+                out.write(reinterpret_cast<const char *>(&key.value.mtime),
+                          sizeof(key.value.mtime));
+            }
+        }
+
+        if (!in_file(header.meshes_offset, header.mesh_count,
+                     sizeof(CachedMesh))
+            || !in_file(header.textures_offset, header.texture_count,
+                        sizeof(CachedTexture))
+            || !in_file(header.materials_offset, header.material_count,
+                        sizeof(CachedMaterial))
+            || !in_file(header.instances_offset, header.instance_count,
+                        sizeof(CachedInstance)))
+        {
+            return { false, {} };
+        }
+
+        SceneCache cache;
+        SceneData &data = cache._data;
+
+        const size_t vertex_bytes = vertex_size(vertex_format);
+        const auto *meshes =
+            reinterpret_cast<const CachedMesh *>(begin + header.meshes_offset);
+        for (u64 i = 0; i != header.mesh_count; ++i)
+        {
+            const CachedMesh &mesh = meshes[i];
+            if (!in_file(mesh.vertex_offset, mesh.vertex_count, vertex_bytes)
+                || !in_file(mesh.index_offset, mesh.index_count, sizeof(u32))
+                || !in_file(mesh.lod_offset, mesh.lod_count, sizeof(MeshLod))
+                || !in_file(mesh.meshlet_offset, mesh.meshlet_count,
+                            sizeof(Meshlet))
+                || mesh.lod_count > max_lod_count)
+            {
+                return { false, {} };
+            }
+
+            SceneData::MeshView view;
+            view.indices = Span<const u32>(
+                reinterpret_cast<const u32 *>(begin + mesh.index_offset),
+                size_t(mesh.index_count));
+            view.bounds = mesh.bounds;
+            view.lods = Span<const MeshLod>(
+                reinterpret_cast<const MeshLod *>(begin + mesh.lod_offset),
+                size_t(mesh.lod_count));
+            for (const MeshLod &lod : view.lods)
+            {
+                if (lod.first_index > mesh.index_count
+                    || lod.index_count > mesh.index_count - lod.first_index)
+                {
+                    return { false, {} };
+                }
+            }
+            view.meshlets = Span<const Meshlet>(
+                reinterpret_cast<const Meshlet *>(begin + mesh.meshlet_offset),
+                size_t(mesh.meshlet_count));
+            for (const Meshlet &meshlet : view.meshlets)
+            {
+                if (meshlet.first_index > mesh.index_count
+                    || meshlet.index_count
+                        > mesh.index_count - meshlet.first_index)
+                {
+                    return { false, {} };
+                }
+            }
+            view.vertex_format = vertex_format;
+            if (vertex_format == VertexFormat::Packed)
+            {
+                view.packed_vertices = Span<const PackedVertex>(
+                    reinterpret_cast<const PackedVertex *>(
+                        begin + mesh.vertex_offset),
+                    size_t(mesh.vertex_count));
+            }
+            else
+            {
+                view.vertices = Span<const Vertex>(
+                    reinterpret_cast<const Vertex *>(begin + mesh.vertex_offset),
+                    size_t(mesh.vertex_count));
+            }
+            data.meshes.push_back(view);
+        }
+
+        const auto *textures = reinterpret_cast<const CachedTexture *>(
+            begin + header.textures_offset);
+        for (u64 i = 0; i != header.texture_count; ++i)
+        {
+            const CachedTexture &texture = textures[i];
+            if (!in_file(texture.data_offset, texture.data_size, 1)
+                || !texture.size.x || !texture.size.y || !texture.mip_count
+                || texture.mip_count > Texture::mip_levels(texture.size)
+                || texture.data_size
+                    < Texture::byte_size(texture.size, ImageFormat(texture.format),
+                                         texture.mip_count))
+            {
+                return { false, {} };
+            }
+
+            data.textures.push_back(SceneData::TextureView{
+                texture.size, ImageFormat(texture.format), texture.mip_count,
+                Span<const u8>(
+                    reinterpret_cast<const u8 *>(begin + texture.data_offset),
+                    size_t(texture.data_size)) });
+        }
+
+        const auto *materials = reinterpret_cast<const CachedMaterial *>(
+            begin + header.materials_offset);
+        data.materials.assign(materials, materials + header.material_count);
+
+        const auto *instances = reinterpret_cast<const CachedInstance *>(
+            begin + header.instances_offset);
+        data.instances.assign(instances, instances + header.instance_count);
+
+        // Check references so a corrupted cache can not crash the loading
+        auto valid_index = [](i32 index, size_t count) {
+            return index >= -1 && index < i32(count);
+        };
+        for (const SceneData::MaterialInfo &material : data.materials)
+        {
+            if (!valid_index(material.albedo, data.textures.size())
+                || !valid_index(material.normal, data.textures.size()))
+            {
+                return { false, {} };
+            }
+        }
+        for (const SceneData::InstanceInfo &instance : data.instances)
+        {
+            if (instance.mesh >= data.meshes.size()
+                || !valid_index(instance.material, data.materials.size()))
+            {
+                return { false, {} };
+            }
+        }
+
+        cache._file = std::move(file.value);
+        return { true, std::move(cache) };
+    }
+
+    // Raw vertex data of a mesh, in its own vertex format
+    static Span<const byte> vertex_bytes(const SceneData::MeshView &mesh)
+    {
+        if (mesh.vertex_format == VertexFormat::Packed)
+        {
+            return Span<const byte>(
+                reinterpret_cast<const byte *>(mesh.packed_vertices.data()),
+                mesh.packed_vertices.size() * sizeof(PackedVertex));
+        }
+        return Span<const byte>(
+            reinterpret_cast<const byte *>(mesh.vertices.data()),
+            mesh.vertices.size() * sizeof(Vertex));
+    }
+
+    bool SceneCache::write(const std::string &source_file,
+                           const SceneData &data,
+                           const SceneCacheOptions &options)
+    {
+        const VertexFormat vertex_format = options.vertex_format;
+        for (const SceneData::MeshView &mesh : data.meshes)
+        {
+            if (mesh.vertex_format != vertex_format)
+            {
+                return false;
+            }
+        }
+
+        const auto key = source_key(source_file, true);
+        if (!key.is_ok)
+        {
+            return false;
+        }
+
+        // Lay everything out first, tables then bulk data
+        u64 file_size = 0;
+        auto reserve = [&](size_t size) {
+            const u64 offset = (file_size + cache_alignment - 1)
+                / cache_alignment * cache_alignment;
+            file_size = offset + size;
+            return offset;
+        };
+
+        CacheHeader header;
+        header.source = key.value;
+        header.vertex_format = u32(vertex_format);
+        header.mesh_optimizations = mesh_optimizations(options);
+        header.lod_count = options.lod_count;
+        header.meshlets = u32(options.build_meshlets);
+        header.mesh_count = data.meshes.size();
+        header.texture_count = data.textures.size();
+        header.material_count = data.materials.size();
+        header.instance_count = data.instances.size();
+
+        reserve(sizeof(CacheHeader));
+        header.meshes_offset = reserve(data.meshes.size() * sizeof(CachedMesh));
+        header.textures_offset =
+            reserve(data.textures.size() * sizeof(CachedTexture));
+        header.materials_offset =
+            reserve(data.materials.size() * sizeof(CachedMaterial));
+        header.instances_offset =
+            reserve(data.instances.size() * sizeof(CachedInstance));
+
+        std::vector<CachedMesh> meshes;
+        for (const SceneData::MeshView &mesh : data.meshes)
+        {
+            CachedMesh cached;
+            const Span<const byte> vertices = vertex_bytes(mesh);
+            cached.vertex_count = vertices.size() / vertex_size(vertex_format);
+            cached.vertex_offset = reserve(vertices.size());
+            cached.index_count = mesh.indices.size();
+            cached.index_offset = reserve(mesh.indices.size() * sizeof(u32));
+            cached.lod_count = mesh.lods.size();
+            cached.lod_offset = reserve(mesh.lods.size() * sizeof(MeshLod));
+            cached.meshlet_count = mesh.meshlets.size();
+            cached.meshlet_offset =
+                reserve(mesh.meshlets.size() * sizeof(Meshlet));
+            cached.bounds = mesh.bounds;
+            meshes.push_back(cached);
+        }
+
+        std::vector<CachedTexture> textures;
+        for (const SceneData::TextureView &texture : data.textures)
+        {
+            CachedTexture cached;
+            cached.data_size = texture.data.size();
+            cached.data_offset = reserve(texture.data.size());
+            cached.size = texture.size;
+            cached.format = u32(texture.format);
+            cached.mip_count = texture.mip_count;
+            textures.push_back(cached);
+        }
+
+        // Write to a temporary file so a partial cache is never picked up
+        const std::string file_name = cache_file_name(source_file);
+        const std::string tmp_file_name = file_name + ".tmp";
+        {
+            std::ofstream out(tmp_file_name, std::ios::binary);
+            if (!out)
+            {
+                return false;
+            }
+
+            u64 offset = 0;
+            auto write_at = [&](u64 at, const void *bytes, size_t size) {
+                static const char zeros[cache_alignment] = {};
+                DEBUG_ASSERT(at >= offset && at - offset < cache_alignment);
+                out.write(zeros, std::streamsize(at - offset));
+                out.write(static_cast<const char *>(bytes),
+                          std::streamsize(size));
+                offset = at + size;
+            };
+
+            write_at(0, &header, sizeof(header));
+            write_at(header.meshes_offset, meshes.data(),
+                     meshes.size() * sizeof(CachedMesh));
+            write_at(header.textures_offset, textures.data(),
+                     textures.size() * sizeof(CachedTexture));
+            write_at(header.materials_offset, data.materials.data(),
+                     data.materials.size() * sizeof(CachedMaterial));
+            write_at(header.instances_offset, data.instances.data(),
+                     data.instances.size() * sizeof(CachedInstance));
+
+            for (size_t i = 0; i != meshes.size(); ++i)
+            {
+                const Span<const byte> vertices = vertex_bytes(data.meshes[i]);
+                write_at(meshes[i].vertex_offset, vertices.data(),
+                         vertices.size());
+                write_at(meshes[i].index_offset, data.meshes[i].indices.data(),
+                         data.meshes[i].indices.size() * sizeof(u32));
+                write_at(meshes[i].lod_offset, data.meshes[i].lods.data(),
+                         data.meshes[i].lods.size() * sizeof(MeshLod));
+                write_at(meshes[i].meshlet_offset,
+                         data.meshes[i].meshlets.data(),
+                         data.meshes[i].meshlets.size() * sizeof(Meshlet));
+            }
+
+            for (size_t i = 0; i != textures.size(); ++i)
+            {
+                write_at(textures[i].data_offset, data.textures[i].data.data(),
+                         data.textures[i].data.size());
+            }
+
+            DEBUG_ASSERT(offset == file_size);
+            if (!out)
+            {
+                return false;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(tmp_file_name, file_name, error);
+        if (error)
+        {
+            std::cerr << "Unable to write scene cache (" << file_name << ")"
+                      << std::endl;
+            std::filesystem::remove(tmp_file_name, error);
+            return false;
+        }
+
+        return true;
+    }
+
+} // namespace OM3D
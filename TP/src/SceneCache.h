@@ -0,0 +1,106 @@
+#ifndef SCENECACHE_H
+#define SCENECACHE_H
+
+#include <Bounds.h>
+#include <ImageFormat.h>
+#include <MappedFile.h>
+#include <StaticMesh.h>
+#include <Vertex.h>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <string>
+#include <vector>
+
+namespace OM3D
+{
+
+    // Scene content in upload-ready form. Bulk data is only viewed, either in
+    // decoded glTF data or in a mapped cache file.
+    struct SceneData
+    {
+        // Only the vertices matching vertex_format are set
+        struct MeshView
+        {
+            Span<const Vertex> vertices;
+            Span<const u32> indices;
+            MeshBounds bounds;
+
+            VertexFormat vertex_format = VertexFormat::Full;
+            Span<const PackedVertex> packed_vertices;
+
+            // Empty if the mesh has a single level of detail
+            Span<const MeshLod> lods;
+
+            // Empty unless meshlets were built
+            Span<const Meshlet> meshlets;
+        };
+
+        // mip_count levels stored one after the other
+        struct TextureView
+        {
+            glm::uvec2 size = {};
+            ImageFormat format = ImageFormat::RGBA8_UNORM;
+            u32 mip_count = 1;
+            Span<const u8> data;
+        };
+
+        // Texture indices, -1 if unused
+        struct MaterialInfo
+        {
+            i32 albedo = -1;
+            i32 normal = -1;
+        };
+
+        // Material index, -1 if the instance has none
+        struct InstanceInfo
+        {
+            glm::mat4 transform = glm::mat4(1.0f);
+            u32 mesh = 0;
+            i32 material = -1;
+        };
+
+        std::vector<MeshView> meshes;
+        std::vector<TextureView> textures;
+        std::vector<MaterialInfo> materials;
+        std::vector<InstanceInfo> instances;
+    };
+
+    // Import options the cached data depends on, a cache built with other
+    // options is not used
+    struct SceneCacheOptions
+    {
+        VertexFormat vertex_format = VertexFormat::Full;
+        bool optimize_meshes = false;
+        bool optimize_overdraw = false;
+        u32 lod_count = 1;
+        bool build_meshlets = false;
+    };
+
+    // Preprocessed scene stored next to its source file. The cache is mapped
+    // in memory when opened, so loading it requires no parsing or decoding.
+    class SceneCache : NonCopyable
+    {
+    public:
+        SceneCache() = default;
+
+        // Fails if there is no cache, if it is out of date or if it was built
+        // with other options
+        static Result<SceneCache> open(const std::string &source_file,
+                                       const SceneCacheOptions &options);
+        static bool write(const std::string &source_file,
+                          const SceneData &data,
+                          const SceneCacheOptions &options);
+
+        static std::string cache_file_name(const std::string &source_file);
+
+        const SceneData &data() const;
+
+    private:
+        MappedFile _file;
+        SceneData _data;
+    };
+
+} // namespace OM3D
+
+#endif // SCENECACHE_H
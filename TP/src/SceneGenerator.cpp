@@ -0,0 +1,445 @@
+#include "SceneGenerator.h"
+
+#include "MeshOptimizer.h"
+#include "MeshletBuilder.h"
+#include "MeshSimplifier.h"
+#include "ThreadPool.h"
+#include "VertexPacking.h"
+
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+namespace OM3D
+{
+
+    // Independent sequences, so adding a light does not move the rocks
+    enum class RandomStream : u32
+    {
+        Mesh,
+        Texture,
+        Instance,
+        Light,
+    };
+
+    // std::mt19937 and std::seed_seq are fully specified, unlike the
+    // standard distributions, so the values are built by hand
+    class Random
+    {
+    public:
+        Random(u32 seed, RandomStream stream, u32 index = 0)
+        {
+            std::seed_seq sequence = { seed, u32(stream), index };
+            _engine.seed(sequence);
+        }
+
+        // In [0; 1), from the top 24 bits
+        float next()
+        {
+            return float(_engine() >> 8) * (1.0f / 16777216.0f);
+        }
+
+        float next(float min, float max)
+        {
+            return min + (max - min) * next();
+        }
+
+        // In [0; count)
+        u32 next_index(u32 count)
+        {
+            return u32((u64(_engine()) * count) >> 32);
+        }
+
+        // Standard normal, with the Box-Muller transform
+        float next_normal()
+        {
+            const float u = 1.0f - next();
+            const float v = next();
+            return std::sqrt(-2.0f * std::log(u))
+                 * std::cos(glm::two_pi<float>() * v);
+        }
+
+        glm::vec3 next_direction()
+        {
+            const float z = next(-1.0f, 1.0f);
+            const float phi = next(0.0f, glm::two_pi<float>());
+            const float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+            return glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+        }
+
+    private:
+        std::mt19937 _engine;
+    };
+
+    struct GeneratedMesh
+    {
+        MeshData data;
+        MeshBounds bounds;
+        std::vector<PackedVertex> packed_vertices;
+    };
+
+    static constexpr u32 texture_size = 256;
+
+    // Thousand instances per cluster
+    static constexpr u32 cluster_size = 1000;
+
+    // A squashed UV sphere with a few bumps. The ring count varies, so the
+    // meshes do not all have the same number of triangles.
+    static MeshData generate_rock(Random &random)
+    {
+        const u32 rings = 8 + random.next_index(25);
+        const u32 segments = 2 * rings;
+        const u32 row_size = segments + 1;
+
+        const glm::vec3 scale(random.next(0.6f, 1.4f),
+                              random.next(0.4f, 1.0f),
+                              random.next(0.6f, 1.4f));
+        const glm::vec3 color(random.next(0.7f, 1.0f));
+
+        // xyz: direction, w: height
+        std::array<glm::vec4, 8> bumps;
+        for (glm::vec4 &bump : bumps)
+        {
+            bump = glm::vec4(random.next_direction(),
+                             random.next(-0.15f, 0.3f));
+        }
+
+        MeshData mesh;
+        mesh.vertices.reserve(size_t(rings + 1) * row_size);
+        for (u32 r = 0; r <= rings; ++r)
+        {
+            const float theta = glm::pi<float>() * float(r) / float(rings);
+            for (u32 s = 0; s <= segments; ++s)
+            {
+                const float phi =
+                    glm::two_pi<float>() * float(s) / float(segments);
+                const glm::vec3 dir(std::sin(theta) * std::cos(phi),
+                                    std::cos(theta),
+                                    std::sin(theta) * std::sin(phi));
+
+                float radius = 1.0f;
+                for (const glm::vec4 &bump : bumps)
+                {
+                    const float d =
+                        std::max(0.0f, glm::dot(dir, glm::vec3(bump)));
+                    radius += bump.w * d * d * d * d;
+                }
+
+                Vertex vertex = {};
+                vertex.position = dir * radius * scale;
+                vertex.normal = glm::vec3(0.0f);
+                vertex.uv = glm::vec2(2.0f * float(s) / float(segments),
+                                      float(r) / float(rings));
+                vertex.color = color;
+                mesh.vertices.push_back(vertex);
+            }
+        }
+
+        // The triangles touching the poles are skipped
+        for (u32 r = 0; r != rings; ++r)
+        {
+            for (u32 s = 0; s != segments; ++s)
+            {
+                const u32 a = r * row_size + s;
+                const u32 b = a + 1;
+                const u32 c = a + row_size;
+                const u32 d = c + 1;
+                if (r != 0)
+                {
+                    mesh.indices.insert(mesh.indices.end(), { a, b, c });
+                }
+                if (r + 1 != rings)
+                {
+                    mesh.indices.insert(mesh.indices.end(), { b, d, c });
+                }
+            }
+        }
+
+        // Area weighted face normals
+        for (size_t i = 0; i < mesh.indices.size(); i += 3)
+        {
+            Vertex &v0 = mesh.vertices[mesh.indices[i]];
+            Vertex &v1 = mesh.vertices[mesh.indices[i + 1]];
+            Vertex &v2 = mesh.vertices[mesh.indices[i + 2]];
+            const glm::vec3 normal = glm::cross(v1.position - v0.position,
+                                                v2.position - v0.position);
+            v0.normal += normal;
+            v1.normal += normal;
+            v2.normal += normal;
+        }
+
+        // The seam and the poles are made of duplicated vertices
+        auto merge_normals = [&](u32 first, u32 count, u32 stride) {
+            glm::vec3 normal(0.0f);
+            for (u32 i = 0; i != count; ++i)
+            {
+                normal += mesh.vertices[first + i * stride].normal;
+            }
+            for (u32 i = 0; i != count; ++i)
+            {
+                mesh.vertices[first + i * stride].normal = normal;
+            }
+        };
+        for (u32 r = 0; r <= rings; ++r)
+        {
+            merge_normals(r * row_size, 2, segments);
+        }
+        merge_normals(0, row_size, 1);
+        merge_normals(rings * row_size, row_size, 1);
+
+        for (Vertex &vertex : mesh.vertices)
+        {
+            const float length = glm::length(vertex.normal);
+            vertex.normal = length > 0.0f
+                ? vertex.normal / length
+                : glm::normalize(vertex.position);
+        }
+
+        return mesh;
+    }
+
+    // Tiling blocks of random brightness over a base color, RGBA8
+    static std::vector<u8> generate_texture(Random &random)
+    {
+        const glm::vec3 base(random.next(0.3f, 0.9f), random.next(0.3f, 0.9f),
+                             random.next(0.3f, 0.9f));
+
+        std::array<float, 8 * 8> coarse;
+        std::array<float, 32 * 32> fine;
+        for (float &shade : coarse)
+        {
+            shade = random.next(0.6f, 1.0f);
+        }
+        for (float &shade : fine)
+        {
+            shade = random.next(0.85f, 1.0f);
+        }
+
+        std::vector<u8> texels(size_t(texture_size) * texture_size * 4);
+        for (u32 y = 0; y != texture_size; ++y)
+        {
+            for (u32 x = 0; x != texture_size; ++x)
+            {
+                const float shade =
+                    coarse[(y * 8 / texture_size) * 8 + x * 8 / texture_size]
+                    * fine[(y * 32 / texture_size) * 32
+                           + x * 32 / texture_size];
+                const glm::vec3 color = base * shade * 255.0f;
+
+                u8 *texel = &texels[(size_t(y) * texture_size + x) * 4];
+                texel[0] = u8(color.r);
+                texel[1] = u8(color.g);
+                texel[2] = u8(color.b);
+                texel[3] = 255;
+            }
+        }
+
+        return texels;
+    }
+
+    std::unique_ptr<Scene>
+    generate_scene(const SceneGeneratorSettings &settings,
+                   const SceneImportSettings &import_settings)
+    {
+        PROFILE_ZONE("Generate scene");
+        const double start_time = program_time();
+
+        auto for_each_job = [&](size_t count, auto &&job) {
+            if (import_settings.multithreaded)
+            {
+                ThreadPool::global().parallel_for(count, job);
+            }
+            else
+            {
+                for (size_t i = 0; i != count; ++i)
+                {
+                    job(i);
+                }
+            }
+        };
+
+        std::vector<GeneratedMesh> generated(settings.mesh_count);
+        for_each_job(generated.size(), [&](size_t i) {
+            PROFILE_ZONE("Generate mesh");
+            Random random(settings.seed, RandomStream::Mesh, u32(i));
+
+            GeneratedMesh &mesh = generated[i];
+            mesh.data = generate_rock(random);
+            if (import_settings.lod_count > 1)
+            {
+                generate_lods(mesh.data, import_settings.lod_count);
+            }
+            if (import_settings.optimize_meshes)
+            {
+                optimize_mesh(mesh.data, import_settings.optimize_overdraw);
+            }
+            if (import_settings.build_meshlets)
+            {
+                build_meshlets(mesh.data);
+            }
+            mesh.bounds = compute_bounds(mesh.data.vertices);
+            if (import_settings.vertex_format == VertexFormat::Packed)
+            {
+                mesh.packed_vertices =
+                    pack_vertices(mesh.data.vertices, mesh.bounds.aabb);
+            }
+        });
+
+        std::vector<std::vector<u8>> textures(settings.material_count);
+        for_each_job(textures.size(), [&](size_t i) {
+            Random random(settings.seed, RandomStream::Texture, u32(i));
+            textures[i] = generate_texture(random);
+        });
+
+        // GL objects have to be created on the context thread
+        std::vector<std::shared_ptr<StaticMesh>> meshes;
+        for (const GeneratedMesh &mesh : generated)
+        {
+            if (import_settings.vertex_format == VertexFormat::Packed)
+            {
+                meshes.push_back(std::make_shared<StaticMesh>(
+                    mesh.packed_vertices, mesh.data.indices, mesh.bounds,
+                    mesh.data.lods, mesh.data.meshlets));
+            }
+            else
+            {
+                meshes.push_back(std::make_shared<StaticMesh>(
+                    mesh.data.vertices, mesh.data.indices, mesh.bounds,
+                    mesh.data.lods, mesh.data.meshlets));
+            }
+        }
+
+        std::vector<std::shared_ptr<Material>> materials;
+        for (const std::vector<u8> &texels : textures)
+        {
+            auto texture = std::make_shared<Texture>(
+                glm::uvec2(texture_size), ImageFormat::RGBA8_sRGB, texels, 1);
+            auto &material = materials.emplace_back(
+                std::make_shared<Material>(Material::textured_material()));
+            material->set_texture(0u, std::move(texture));
+        }
+        if (materials.empty())
+        {
+            materials.push_back(Material::empty_material());
+        }
+
+        auto scene = std::make_unique<Scene>();
+
+        const u32 instance_count = meshes.empty() ? 0 : settings.instance_count;
+        const float side =
+            settings.spacing * std::sqrt(float(instance_count));
+        const u32 columns = u32(std::ceil(std::sqrt(double(instance_count))));
+
+        Random random(settings.seed, RandomStream::Instance);
+
+        std::vector<glm::vec2> cluster_centers;
+        float cluster_spread = 0.0f;
+        if (settings.distribution == InstanceDistribution::Clusters)
+        {
+            cluster_centers.resize(
+                std::max(1u, instance_count / cluster_size));
+            for (glm::vec2 &center : cluster_centers)
+            {
+                center = glm::vec2(random.next(-0.5f, 0.5f),
+                                   random.next(-0.5f, 0.5f))
+                       * side;
+            }
+            cluster_spread =
+                side / (4.0f * std::sqrt(float(cluster_centers.size())));
+        }
+
+        for (u32 i = 0; i != instance_count; ++i)
+        {
+            glm::vec2 position;
+            switch (settings.distribution)
+            {
+            case InstanceDistribution::Uniform:
+                position = glm::vec2(random.next(-0.5f, 0.5f),
+                                     random.next(-0.5f, 0.5f))
+                         * side;
+                break;
+
+            case InstanceDistribution::Grid:
+                position = (glm::vec2(float(i % columns), float(i / columns))
+                            - float(columns - 1) * 0.5f)
+                         * settings.spacing;
+                break;
+
+            case InstanceDistribution::Clusters:
+                position = cluster_centers[random.next_index(
+                               u32(cluster_centers.size()))]
+                         + glm::vec2(random.next_normal(),
+                                     random.next_normal())
+                               * cluster_spread;
+                break;
+            }
+
+            const float yaw = random.next(0.0f, glm::two_pi<float>());
+            const float scale = random.next(0.5f, 1.5f);
+            const u32 mesh = random.next_index(u32(meshes.size()));
+            const u32 material = random.next_index(u32(materials.size()));
+
+            glm::mat4 transform = glm::translate(
+                glm::mat4(1.0f), glm::vec3(position.x, 0.0f, position.y));
+            transform =
+                glm::rotate(transform, yaw, glm::vec3(0.0f, 1.0f, 0.0f));
+            transform = glm::scale(transform, glm::vec3(scale));
+
+            SceneObject object(meshes[mesh], materials[material]);
+            object.set_transform(transform);
+            scene->add_object(std::move(object));
+        }
+
+        // Lights cover the instance area, from a few spacings above
+        Random light_random(settings.seed, RandomStream::Light);
+        const float light_side = std::max(side, settings.spacing);
+        for (u32 i = 0; i != settings.light_count; ++i)
+        {
+            const glm::vec3 position(
+                light_random.next(-0.5f, 0.5f) * light_side,
+                light_random.next(0.5f, 2.0f) * settings.spacing,
+                light_random.next(-0.5f, 0.5f) * light_side);
+            const glm::vec3 hue(light_random.next(), light_random.next(),
+                                light_random.next());
+            const float intensity = light_random.next(2.0f, 10.0f);
+
+            PointLight light;
+            light.set_position(position);
+            const float max_hue = std::max({ hue.r, hue.g, hue.b, 0.01f });
+            light.set_color(hue / max_hue * intensity);
+            light.set_radius(light_random.next(2.0f, 6.0f) * settings.spacing);
+            scene->add_object(std::move(light));
+        }
+
+        std::cout << "Generated " << instance_count << " instances of "
+                  << meshes.size() << " meshes and " << settings.light_count
+                  << " lights in "
+                  << std::round((program_time() - start_time) * 100.0) / 100.0
+                  << "s" << std::endl;
+
+        return scene;
+    }
+
+    const char *distribution_name(InstanceDistribution distribution)
+    {
+        switch (distribution)
+        {
+        case InstanceDistribution::Uniform:
+            return "uniform";
+
+        case InstanceDistribution::Grid:
+            return "grid";
+
+        case InstanceDistribution::Clusters:
+            return "clusters";
+        }
+
+        FATAL("Unknown distribution");
+    }
+
+} // namespace OM3D
@@ -0,0 +1,50 @@
+#ifndef SCENEGENERATOR_H
+#define SCENEGENERATOR_H
+
+#include <Scene.h>
+
+namespace OM3D
+{
+
+    enum class InstanceDistribution
+    {
+        // Random positions over the whole area
+        Uniform,
+        // Rows and columns, spacing apart
+        Grid,
+        // Dense groups of about a thousand instances
+        Clusters,
+    };
+
+    // Parameters of a procedural scene: instances of randomly shaped rocks
+    // spread on a square of the XZ plane, and point lights above them. The
+    // area grows with the instance count, so the density stays the same.
+    struct SceneGeneratorSettings
+    {
+        // Same seed, same scene, whatever the thread count
+        u32 seed = 1;
+
+        u32 mesh_count = 16;
+        u32 instance_count = 10000;
+        InstanceDistribution distribution = InstanceDistribution::Uniform;
+
+        // Average distance between neighbouring instances
+        float spacing = 3.0f;
+
+        // Each with its own texture, untextured if 0
+        u32 material_count = 4;
+
+        u32 light_count = 2;
+    };
+
+    // Meshes are processed like imported ones: import_settings selects the
+    // vertex format, optimizations, LODs and meshlets. The cache is not used.
+    std::unique_ptr<Scene>
+    generate_scene(const SceneGeneratorSettings &settings,
+                   const SceneImportSettings &import_settings = {});
+
+    const char *distribution_name(InstanceDistribution distribution);
+
+} // namespace OM3D
+
+#endif // SCENEGENERATOR_H
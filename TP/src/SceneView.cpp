@@ -17,11 +17,12 @@ namespace OM3D
         return _camera;
     }
 
-    void SceneView::render() const
+    void SceneView::render(const RenderSettings &settings, Texture *depth,
+                           Texture *lit) const
     {
         if (_scene)
         {
-            _scene->render(_camera);
+            _scene->render(_camera, settings, depth, lit);
         }
     }
 
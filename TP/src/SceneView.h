@@ -15,7 +15,9 @@ namespace OM3D
         Camera &camera();
         const Camera &camera() const;
 
-        void render() const;
+        // See Scene::render
+        void render(const RenderSettings &settings = {},
+                    Texture *depth = nullptr, Texture *lit = nullptr) const;
 
     private:
         const Scene *_scene = nullptr;
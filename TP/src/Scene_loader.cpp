@@ -1,9 +1,16 @@
 #include <glm/gtc/quaternion.hpp>
+#include <algorithm>
 #include <iostream>
+#include <map>
 #include <utils.h>
 
+#include "MeshOptimizer.h"
+#include "MeshletBuilder.h"
+#include "MeshSimplifier.h"
 #include "Scene.h"
+#include "SceneCache.h"
 #include "StaticMesh.h"
+#include "ThreadPool.h"
 
 #define TINYGLTF_IMPLEMENTATION
 #define TINYGLTF_NO_STB_IMAGE_WRITE
@@ -249,7 +256,52 @@ namespace OM3D
             }
         }
 
-        return { true, MeshData{ std::move(vertices), std::move(indices) } };
+        return { true,
+                 MeshData{ std::move(vertices), std::move(indices), {}, {} } };
+    }
+
+    // Images are kept encoded while parsing so they can be decoded in parallel
+    // once we know which ones are actually used
+    static bool store_encoded_image(tinygltf::Image *image, const int,
+                                    std::string *, std::string *, int, int,
+                                    const unsigned char *bytes, int size,
+                                    void *)
+    {
+        image->as_is = true;
+        image->image.assign(bytes, bytes + size);
+        return true;
+    }
+
+    static bool decode_image(tinygltf::Image &image)
+    {
+        if (!image.as_is)
+        {
+            return true;
+        }
+
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+        u8 *data = stbi_load_from_memory(image.image.data(),
+                                         int(image.image.size()), &width,
+                                         &height, &channels, 4);
+        DEFER(stbi_image_free(data));
+        if (!data || width <= 0 || height <= 0)
+        {
+            std::cerr << "Unable to decode image \"" << image.name << "\""
+                      << std::endl;
+            return false;
+        }
+
+        image.width = width;
+        image.height = height;
+        image.component = 4;
+        image.bits = 8;
+        image.pixel_type = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+        image.image.assign(data, data + size_t(width) * size_t(height) * 4);
+        image.as_is = false;
+
+        return true;
     }
 
     static Result<TextureData> build_texture_data(const tinygltf::Image &image,
@@ -373,14 +425,167 @@ namespace OM3D
         }
     }
 
+    template <typename T>
+    static int texture_image_index(const tinygltf::Model &gltf,
+                                   const T &texture_info)
+    {
+        if (texture_info.texCoord != 0)
+        {
+            std::cerr << "Unsupported texture coordinate channel ("
+                      << texture_info.texCoord << ")" << std::endl;
+            return -1;
+        }
+
+        if (texture_info.index < 0)
+        {
+            return -1;
+        }
+
+        return gltf.textures[texture_info.index].source;
+    }
+
+    // Create GL objects, this has to happen on the context thread
+    static std::unique_ptr<Scene> create_scene(const SceneData &data)
+    {
+        auto scene = std::make_unique<Scene>();
+
+        std::vector<std::shared_ptr<Texture>> textures;
+        for (const SceneData::TextureView &texture : data.textures)
+        {
+            textures.push_back(std::make_shared<Texture>(
+                texture.size, texture.format, texture.data, texture.mip_count));
+        }
+
+        std::vector<std::shared_ptr<Material>> materials;
+        for (const SceneData::MaterialInfo &info : data.materials)
+        {
+            auto find_texture = [&](i32 index) -> std::shared_ptr<Texture> {
+                return index < 0 ? nullptr : textures[index];
+            };
+
+            auto albedo = find_texture(info.albedo);
+            auto normal = find_texture(info.normal);
+
+            auto &mat = materials.emplace_back();
+            if (!albedo)
+            {
+                mat = Material::empty_material();
+            }
+            else if (!normal)
+            {
+                mat = std::make_shared<Material>(
+                    Material::textured_material());
+                mat->set_texture(0u, albedo);
+            }
+            else
+            {
+                mat = std::make_shared<Material>(
+                    Material::textured_normal_mapped_material());
+                mat->set_texture(0u, albedo);
+                mat->set_texture(1u, normal);
+            }
+        }
+
+        std::vector<std::shared_ptr<StaticMesh>> meshes;
+        for (const SceneData::MeshView &mesh : data.meshes)
+        {
+            if (mesh.vertex_format == VertexFormat::Packed)
+            {
+                meshes.push_back(std::make_shared<StaticMesh>(
+                    mesh.packed_vertices, mesh.indices, mesh.bounds,
+                    mesh.lods, mesh.meshlets));
+            }
+            else
+            {
+                meshes.push_back(std::make_shared<StaticMesh>(
+                    mesh.vertices, mesh.indices, mesh.bounds, mesh.lods,
+                    mesh.meshlets));
+            }
+        }
+
+        for (const SceneData::InstanceInfo &instance : data.instances)
+        {
+            std::shared_ptr<Material> material;
+            if (instance.material >= 0)
+            {
+                material = materials[instance.material];
+            }
+
+            auto scene_object =
+                SceneObject(meshes[instance.mesh], std::move(material));
+            scene_object.set_transform(instance.transform);
+
+            scene->add_object(std::move(scene_object));
+        }
+
+        return scene;
+    }
+
     Result<std::unique_ptr<Scene>>
-    Scene::from_gltf(const std::string &file_name)
+    Scene::from_gltf(const std::string &file_name,
+                     const SceneImportSettings &settings)
     {
+        PROFILE_ZONE("Scene::from_gltf");
+
         const double time = program_time();
         DEFER(std::cout << file_name << " loaded in "
                         << std::round((program_time() - time) * 100.0) / 100.0
                         << "s" << std::endl);
 
+        // Stages are also profiler zones, named when they end
+        double stage_time = time;
+        u64 stage_zone = begin_profile_zone();
+        DEFER(if (stage_zone != no_profile_zone) {
+            end_profile_zone("finished", stage_zone);
+        });
+        auto print_stage_time = [&](const char *stage) {
+            if (stage_zone != no_profile_zone)
+            {
+                end_profile_zone(stage, stage_zone);
+            }
+            stage_zone = begin_profile_zone();
+
+            const double now = program_time();
+            std::cout << file_name << " " << stage << " in "
+                      << std::round((now - stage_time) * 100.0) / 100.0 << "s"
+                      << std::endl;
+            stage_time = now;
+        };
+
+        auto for_each_job = [&](size_t count, auto &&job) {
+            if (settings.multithreaded)
+            {
+                ThreadPool::global().parallel_for(count, job);
+            }
+            else
+            {
+                for (size_t i = 0; i != count; ++i)
+                {
+                    job(i);
+                }
+            }
+        };
+
+        SceneCacheOptions cache_options;
+        cache_options.vertex_format = settings.vertex_format;
+        cache_options.optimize_meshes = settings.optimize_meshes;
+        cache_options.optimize_overdraw = settings.optimize_overdraw;
+        cache_options.lod_count =
+            std::clamp(settings.lod_count, u32(1), max_lod_count);
+        cache_options.build_meshlets = settings.build_meshlets;
+
+        if (settings.use_cache)
+        {
+            const auto cache = SceneCache::open(file_name, cache_options);
+            if (cache.is_ok)
+            {
+                print_stage_time("mapped from cache");
+                auto scene = create_scene(cache.value.data());
+                print_stage_time("uploaded");
+                return { true, std::move(scene) };
+            }
+        }
+
         tinygltf::TinyGLTF ctx;
         tinygltf::Model gltf;
 
@@ -388,6 +593,8 @@ namespace OM3D
             std::string err;
             std::string warn;
 
+            ctx.SetImageLoader(store_encoded_image, nullptr);
+
             const bool is_ascii = ends_with(file_name, ".gltf");
             const bool ok = is_ascii
                 ? ctx.LoadASCIIFromFile(&gltf, &err, &warn, file_name)
@@ -409,14 +616,8 @@ namespace OM3D
             }
         }
 
-        std::cout << file_name << " parsed in "
-                  << std::round((program_time() - time) * 100.0) / 100.0 << "s"
-                  << std::endl;
-
-        auto scene = std::make_unique<Scene>();
+        print_stage_time("parsed");
 
-        std::unordered_map<int, std::shared_ptr<Texture>> textures;
-        std::unordered_map<int, std::shared_ptr<Material>> materials;
         std::unordered_map<int, glm::mat4> node_transforms;
 
         {
@@ -440,122 +641,383 @@ namespace OM3D
             }
         }
 
-        for (auto [node_index, node_transform] : node_transforms)
+        // Gather everything that needs decoding
+        struct PrimitiveJob
+        {
+            const tinygltf::Primitive *primitive = nullptr;
+            Result<MeshData> mesh = { false, {} };
+            MeshBounds bounds;
+            std::vector<PackedVertex> packed_vertices;
+            VertexCacheStats cache_before;
+            VertexCacheStats cache_after;
+        };
+
+        struct PrimitiveInstance
+        {
+            glm::mat4 transform;
+            size_t job = 0;
+        };
+
+        struct ImageJob
+        {
+            int index = -1;
+            bool as_sRGB = false;
+            Result<TextureData> texture = { false, {} };
+            std::vector<u8> mips;
+        };
+
+        struct MaterialTextures
+        {
+            int albedo = -1;
+            int normal = -1;
+        };
+
+        std::vector<PrimitiveJob> primitive_jobs;
+        std::vector<PrimitiveInstance> primitive_instances;
+        std::vector<ImageJob> image_jobs;
+        std::unordered_map<int, MaterialTextures> material_textures;
+
         {
-            const tinygltf::Node &node = gltf.nodes[node_index];
-            if (node.mesh < 0)
+            // Primitives are decoded once per (mesh, primitive) and shared by
+            // all the nodes referencing them
+            std::map<std::pair<int, size_t>, size_t> primitive_jobs_indices;
+            std::unordered_map<int, size_t> image_jobs_indices;
+            auto add_image = [&](int index, bool as_sRGB) {
+                if (index >= 0
+                    && image_jobs_indices.find(index)
+                        == image_jobs_indices.end())
+                {
+                    image_jobs_indices[index] = image_jobs.size();
+                    image_jobs.push_back(
+                        ImageJob{ index, as_sRGB, { false, {} }, {} });
+                }
+            };
+
+            for (auto [node_index, node_transform] : node_transforms)
             {
-                continue;
+                const tinygltf::Node &node = gltf.nodes[node_index];
+                if (node.mesh < 0)
+                {
+                    continue;
+                }
+
+                const tinygltf::Mesh &mesh = gltf.meshes[node.mesh];
+
+                for (size_t j = 0; j != mesh.primitives.size(); ++j)
+                {
+                    const tinygltf::Primitive &prim = mesh.primitives[j];
+
+                    if (prim.mode != TINYGLTF_MODE_TRIANGLES)
+                    {
+                        continue;
+                    }
+
+                    const auto [it, inserted] = primitive_jobs_indices.emplace(
+                        std::pair(node.mesh, j), primitive_jobs.size());
+                    primitive_instances.push_back(
+                        PrimitiveInstance{ node_transform, it->second });
+
+                    if (!inserted)
+                    {
+                        continue;
+                    }
+
+                    primitive_jobs.push_back(
+                        PrimitiveJob{ &prim, { false, {} }, {}, {}, {}, {} });
+
+                    if (prim.material < 0
+                        || material_textures.find(prim.material)
+                            != material_textures.end())
+                    {
+                        continue;
+                    }
+
+                    const tinygltf::Material &material =
+                        gltf.materials[prim.material];
+
+                    MaterialTextures &textures =
+                        material_textures[prim.material];
+                    textures.albedo = texture_image_index(
+                        gltf, material.pbrMetallicRoughness.baseColorTexture);
+                    textures.normal =
+                        texture_image_index(gltf, material.normalTexture);
+
+                    add_image(textures.albedo, true);
+                    add_image(textures.normal, false);
+                }
             }
+        }
 
-            const tinygltf::Mesh &mesh = gltf.meshes[node.mesh];
+        // Start building the programs of the materials now, they compile in
+        // the background while the scene decodes. create_scene() gets the
+        // same programs as long as these materials are alive.
+        std::vector<std::shared_ptr<Material>> program_warm_up;
+        {
+            bool untextured = false;
+            bool textured = false;
+            bool normal_mapped = false;
+            for (const auto &[index, textures] : material_textures)
+            {
+                untextured |= textures.albedo < 0;
+                textured |= textures.albedo >= 0 && textures.normal < 0;
+                normal_mapped |= textures.albedo >= 0 && textures.normal >= 0;
+            }
 
-            for (size_t j = 0; j != mesh.primitives.size(); ++j)
+            if (untextured)
+            {
+                program_warm_up.push_back(Material::empty_material());
+            }
+            if (textured)
             {
-                const tinygltf::Primitive &prim = mesh.primitives[j];
+                program_warm_up.push_back(
+                    std::make_shared<Material>(Material::textured_material()));
+            }
+            if (normal_mapped)
+            {
+                program_warm_up.push_back(std::make_shared<Material>(
+                    Material::textured_normal_mapped_material()));
+            }
+        }
 
-                if (prim.mode != TINYGLTF_MODE_TRIANGLES)
+        // Decode attributes, indices and images, and generate tangents
+        for_each_job(primitive_jobs.size() + image_jobs.size(), [&](size_t i) {
+            if (i < primitive_jobs.size())
+            {
+                PROFILE_ZONE("Decode primitive");
+                PrimitiveJob &job = primitive_jobs[i];
+                job.mesh = build_mesh_data(gltf, *job.primitive);
+                if (job.mesh.is_ok
+                    && job.mesh.value.vertices[0].tangent_bitangent_sign
+                        == glm::vec4(0.0f))
                 {
-                    continue;
+                    compute_tangents(job.mesh.value);
+                }
+                if (job.mesh.is_ok && settings.optimize_meshes)
+                {
+                    job.cache_before = analyze_vertex_cache(
+                        job.mesh.value.indices, job.mesh.value.vertices.size());
+                }
+                if (job.mesh.is_ok && cache_options.lod_count > 1)
+                {
+                    generate_lods(job.mesh.value, cache_options.lod_count);
+                }
+                if (job.mesh.is_ok && settings.optimize_meshes)
+                {
+                    MeshData &mesh = job.mesh.value;
+                    if (optimize_mesh(mesh, settings.optimize_overdraw))
+                    {
+                        // Only the full detail level is compared
+                        const size_t index_count = mesh.lods.empty()
+                            ? mesh.indices.size()
+                            : mesh.lods[0].index_count;
+                        job.cache_after = analyze_vertex_cache(
+                            Span<const u32>(mesh.indices.data(), index_count),
+                            mesh.vertices.size());
+                    }
+                    else
+                    {
+                        job.cache_before = {};
+                    }
+                }
+                if (job.mesh.is_ok && settings.build_meshlets)
+                {
+                    build_meshlets(job.mesh.value);
+                }
+                if (job.mesh.is_ok)
+                {
+                    job.bounds = compute_bounds(job.mesh.value.vertices);
+                    if (settings.vertex_format == VertexFormat::Packed)
+                    {
+                        job.packed_vertices = pack_vertices(
+                            job.mesh.value.vertices, job.bounds.aabb);
+                    }
+                }
+            }
+            else
+            {
+                PROFILE_ZONE("Decode image");
+                ImageJob &job = image_jobs[i - primitive_jobs.size()];
+                tinygltf::Image &image = gltf.images[job.index];
+                if (decode_image(image))
+                {
+                    job.texture = build_texture_data(image, job.as_sRGB);
                 }
 
-                auto mesh = build_mesh_data(gltf, prim);
-                if (!mesh.is_ok)
+                // Mips are only worth building on the CPU if they are cached
+                if (settings.use_cache && job.texture.is_ok
+                    && (job.texture.value.format == ImageFormat::RGBA8_UNORM
+                        || job.texture.value.format
+                            == ImageFormat::RGBA8_sRGB))
                 {
-                    return { false, {} };
+                    job.mips = Texture::build_mip_chain(job.texture.value);
                 }
+            }
+        });
+
+        print_stage_time("decoded");
 
-                if (mesh.value.vertices[0].tangent_bitangent_sign
-                    == glm::vec4(0.0f))
+        if (cache_options.lod_count > 1)
+        {
+            std::array<size_t, max_lod_count> lod_triangles = {};
+            for (const PrimitiveJob &job : primitive_jobs)
+            {
+                if (!job.mesh.is_ok)
                 {
-                    compute_tangents(mesh.value);
+                    continue;
                 }
 
-                std::shared_ptr<Material> material;
-                if (prim.material >= 0)
+                const MeshData &mesh = job.mesh.value;
+                for (size_t i = 0; i != lod_triangles.size(); ++i)
                 {
-                    auto &mat = materials[prim.material];
+                    // Meshes that could not be simplified use their last
+                    // level
+                    const size_t index_count = mesh.lods.empty()
+                        ? mesh.indices.size()
+                        : mesh.lods[std::min(i, mesh.lods.size() - 1)]
+                              .index_count;
+                    lod_triangles[i] += index_count / 3;
+                }
+            }
 
-                    if (!mat)
+            std::cout << file_name << " LOD triangles";
+            for (u32 i = 0; i != cache_options.lod_count; ++i)
+            {
+                std::cout << (i ? " / " : " ") << lod_triangles[i];
+            }
+            std::cout << std::endl;
+        }
+
+        if (settings.build_meshlets)
+        {
+            size_t meshlet_count = 0;
+            size_t triangle_count = 0;
+            for (const PrimitiveJob &job : primitive_jobs)
+            {
+                if (job.mesh.is_ok)
+                {
+                    for (const Meshlet &meshlet : job.mesh.value.meshlets)
                     {
-                        const auto &albedo_info =
-                            gltf.materials[prim.material]
-                                .pbrMetallicRoughness.baseColorTexture;
-                        const auto &normal_info =
-                            gltf.materials[prim.material].normalTexture;
-
-                        auto load_texture =
-                            [&](auto texture_info,
-                                bool as_sRGB) -> std::shared_ptr<Texture> {
-                            if (texture_info.texCoord != 0)
-                            {
-                                std::cerr << "Unsupported texture coordinate "
-                                             "channel ("
-                                          << texture_info.texCoord << ")"
-                                          << std::endl;
-                                return nullptr;
-                            }
-
-                            if (texture_info.index < 0)
-                            {
-                                return nullptr;
-                            }
-
-                            const int index =
-                                gltf.textures[texture_info.index].source;
-                            if (index < 0)
-                            {
-                                return nullptr;
-                            }
-
-                            auto &texture = textures[index];
-                            if (!texture)
-                            {
-                                if (const auto r = build_texture_data(
-                                        gltf.images[index], as_sRGB);
-                                    r.is_ok)
-                                {
-                                    texture =
-                                        std::make_shared<Texture>(r.value);
-                                }
-                            }
-                            return texture;
-                        };
-
-                        auto albedo = load_texture(albedo_info, true);
-                        auto normal = load_texture(normal_info, false);
-
-                        if (!albedo)
-                        {
-                            mat = Material::empty_material();
-                        }
-                        else if (!normal)
-                        {
-                            mat = std::make_shared<Material>(
-                                Material::textured_material());
-                            mat->set_texture(0u, albedo);
-                        }
-                        else
-                        {
-                            mat = std::make_shared<Material>(
-                                Material::textured_normal_mapped_material());
-                            mat->set_texture(0u, albedo);
-                            mat->set_texture(1u, normal);
-                        }
+                        ++meshlet_count;
+                        triangle_count += meshlet.index_count / 3;
                     }
-
-                    material = mat;
                 }
-                
-                auto scene_object =
-                    SceneObject(std::make_shared<StaticMesh>(mesh.value),
-                        std::move(material));
-                scene_object.set_transform(node_transform);
-                
-                scene->add_object(std::move(scene_object));
             }
+            std::cout << file_name << " " << meshlet_count << " meshlets, "
+                      << (meshlet_count ? float(triangle_count)
+                                              / float(meshlet_count)
+                                        : 0.0f)
+                      << " triangles per meshlet" << std::endl;
+        }
+
+        if (settings.optimize_meshes)
+        {
+            VertexCacheStats before;
+            VertexCacheStats after;
+            for (const PrimitiveJob &job : primitive_jobs)
+            {
+                before.merge(job.cache_before);
+                after.merge(job.cache_after);
+            }
+            std::cout << file_name << " vertex cache ACMR " << before.acmr()
+                      << " -> " << after.acmr() << ", ATVR " << before.atvr()
+                      << " -> " << after.atvr() << std::endl;
+        }
+
+        // Reference the decoded data in upload-ready form
+        SceneData data;
+
+        std::unordered_map<int, i32> texture_indices;
+        for (const ImageJob &job : image_jobs)
+        {
+            if (!job.texture.is_ok)
+            {
+                continue;
+            }
+
+            const TextureData &texture = job.texture.value;
+            texture_indices[job.index] = i32(data.textures.size());
+            if (job.mips.empty())
+            {
+                data.textures.push_back(SceneData::TextureView{
+                    texture.size, texture.format, 1,
+                    Span<const u8>(texture.data.get(),
+                                   Texture::byte_size(texture.size,
+                                                      texture.format)) });
+            }
+            else
+            {
+                data.textures.push_back(SceneData::TextureView{
+                    texture.size, texture.format,
+                    Texture::mip_levels(texture.size), job.mips });
+            }
+        }
+
+        std::unordered_map<int, i32> material_indices;
+        for (const auto &[material_index, material_textures] :
+             material_textures)
+        {
+            auto find_texture = [&](int index) {
+                const auto it = texture_indices.find(index);
+                return it == texture_indices.end() ? -1 : it->second;
+            };
+
+            material_indices[material_index] = i32(data.materials.size());
+            data.materials.push_back(SceneData::MaterialInfo{
+                find_texture(material_textures.albedo),
+                find_texture(material_textures.normal) });
+        }
+
+        for (const PrimitiveJob &job : primitive_jobs)
+        {
+            if (!job.mesh.is_ok)
+            {
+                return { false, {} };
+            }
+
+            SceneData::MeshView mesh;
+            mesh.indices = job.mesh.value.indices;
+            mesh.bounds = job.bounds;
+            mesh.lods = job.mesh.value.lods;
+            mesh.meshlets = job.mesh.value.meshlets;
+            mesh.vertex_format = settings.vertex_format;
+            if (mesh.vertex_format == VertexFormat::Packed)
+            {
+                mesh.packed_vertices = job.packed_vertices;
+            }
+            else
+            {
+                mesh.vertices = job.mesh.value.vertices;
+            }
+            data.meshes.push_back(mesh);
+        }
+
+        for (const PrimitiveInstance &instance : primitive_instances)
+        {
+            const tinygltf::Primitive &prim =
+                *primitive_jobs[instance.job].primitive;
+
+            SceneData::InstanceInfo info;
+            info.transform = instance.transform;
+            info.mesh = u32(instance.job);
+            if (prim.material >= 0)
+            {
+                info.material = material_indices[prim.material];
+            }
+            data.instances.push_back(info);
         }
 
+        if (settings.use_cache)
+        {
+            if (SceneCache::write(file_name, data, cache_options))
+            {
+                print_stage_time("cached");
+            }
+        }
+
+        auto scene = create_scene(data);
+
+        print_stage_time("uploaded");
+
         return { true, std::move(scene) };
     }
 
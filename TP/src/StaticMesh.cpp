@@ -1,49 +1,242 @@
 #include "StaticMesh.h"
 
 #include <glad/glad.h>
-#include <glm/gtx/norm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
 
 namespace OM3D
 {
     
 
-    StaticMesh::StaticMesh(const MeshData &data)
-        : _vertex_buffer(data.vertices)
-        , _index_buffer(data.indices)
+    static std::vector<MeshLod> build_lods(Span<const MeshLod> lods,
+                                           size_t index_count)
+    {
+        if (lods.is_empty())
+        {
+            return { MeshLod{ 0, u32(index_count), 0.0f } };
+        }
+
+        ALWAYS_ASSERT(lods.size() <= max_lod_count, "Too many LODs");
+        for (const MeshLod &lod : lods)
+        {
+            ALWAYS_ASSERT(lod.first_index + lod.index_count <= index_count,
+                          "LOD out of the index buffer");
+        }
+        return std::vector<MeshLod>(lods.begin(), lods.end());
+    }
+
+    static FrustumCuller build_meshlet_culler(Span<const Meshlet> meshlets,
+                                              size_t index_count)
     {
-        // Ritter's bounding sphere
-        const OM3D::Vertex x = data.vertices[0];
-        OM3D::Vertex y = data.vertices[1];
-        
-        float max_dist = glm::length2(x.position - y.position);
+        FrustumCuller culler;
+        culler.resize(meshlets.size());
+        for (size_t i = 0; i != meshlets.size(); ++i)
+        {
+            const Meshlet &meshlet = meshlets[i];
+            ALWAYS_ASSERT(meshlet.first_index + meshlet.index_count
+                              <= index_count,
+                          "Meshlet out of the index buffer");
+            culler.set_sphere(i, meshlet.center, meshlet.radius);
+        }
+        return culler;
+    }
 
-        for (const Vertex& v : data.vertices)
+    // Coarsest LOD close enough to the surface to hide what the full detail
+    // mesh hides, within a fraction of a software occlusion pixel
+    static const MeshLod &occluder_lod(const std::vector<MeshLod> &lods,
+                                       float radius)
+    {
+        static constexpr float max_relative_error = 0.01f;
+        size_t lod = 0;
+        for (size_t i = 1; i != lods.size(); ++i)
         {
-            float dst = glm::length2(v.position - x.position);
-            if (dst > max_dist) {
-                max_dist = dst;
-                y = v;
+            if (lods[i].error <= radius * max_relative_error)
+            {
+                lod = i;
             }
         }
+        return lods[lod];
+    }
 
-        OM3D::Vertex z = x;
-        for (const Vertex& v : data.vertices)
+    // Compacts the vertices referenced by a LOD
+    template <typename F>
+    static OccluderMesh build_occluder(Span<const u32> indices,
+                                       const MeshLod &lod, size_t vertex_count,
+                                       F &&position)
+    {
+        OccluderMesh occluder;
+        std::vector<u32> remap(vertex_count, u32(-1));
+        for (u32 i = 0; i != lod.index_count; ++i)
         {
-            float dst = glm::length2(v.position - z.position);
-            if (dst > max_dist) {
-                max_dist = dst;
-                z = v;
+            const u32 index = indices[lod.first_index + i];
+            if (remap[index] == u32(-1))
+            {
+                remap[index] = u32(occluder.positions.size());
+                occluder.positions.push_back(position(index));
             }
+            occluder.indices.push_back(remap[index]);
         }
+        return occluder;
+    }
+
+    StaticMesh::StaticMesh(const MeshData &data)
+        : StaticMesh(data.vertices, data.indices,
+                     compute_bounds(data.vertices), data.lods, data.meshlets)
+    {}
+
+    StaticMesh::StaticMesh(Span<const Vertex> vertices, Span<const u32> indices,
+                           const MeshBounds &bounds, Span<const MeshLod> lods,
+                           Span<const Meshlet> meshlets)
+        : _vertex_buffer(vertices.data(), vertices.size() * sizeof(Vertex))
+        , _index_buffer(indices)
+        , _lods(build_lods(lods, indices.size()))
+        , _meshlets(meshlets.begin(), meshlets.end())
+        , _meshlet_culler(build_meshlet_culler(meshlets, indices.size()))
+        , _aabb(bounds.aabb)
+        , _center(bounds.sphere.center)
+        , _radius(bounds.sphere.radius)
+    {}
+
+    StaticMesh::StaticMesh(Span<const PackedVertex> vertices,
+                           Span<const u32> indices, const MeshBounds &bounds,
+                           Span<const MeshLod> lods,
+                           Span<const Meshlet> meshlets)
+        : _vertex_buffer(vertices.data(),
+                         vertices.size() * sizeof(PackedVertex))
+        , _index_buffer(indices)
+        , _vertex_format(VertexFormat::Packed)
+        , _lods(build_lods(lods, indices.size()))
+        , _meshlets(meshlets.begin(), meshlets.end())
+        , _meshlet_culler(build_meshlet_culler(meshlets, indices.size()))
+        , _aabb(bounds.aabb)
+        , _center(bounds.sphere.center)
+        , _radius(bounds.sphere.radius)
+    {}
 
-        this->_center = (z.position - y.position) / 2.0f;
-        this->_radius = max_dist / 2.0f;
+    u32 StaticMesh::lod_count() const {
+        return u32(_lods.size());
+    }
+
+    const MeshLod &StaticMesh::lod(u32 index) const {
+        DEBUG_ASSERT(index < _lods.size());
+        return _lods[index];
+    }
+
+    size_t StaticMesh::meshlet_count() const {
+        return _meshlets.size();
+    }
+
+    const Meshlet &StaticMesh::meshlet(size_t index) const {
+        DEBUG_ASSERT(index < _meshlets.size());
+        return _meshlets[index];
+    }
+
+    const FrustumCuller &StaticMesh::meshlet_culler() const {
+        return _meshlet_culler;
+    }
+
+    const OccluderMesh &StaticMesh::occluder() const {
+        // Most meshes are never occluders, or software occlusion is off
+        if (!_occluder_read) {
+            _occluder_read = true;
+            _occluder = read_occluder();
+        }
+        return _occluder;
+    }
+
+    OccluderMesh StaticMesh::read_occluder() const {
+        const MeshLod &lod = occluder_lod(_lods, _radius);
+        if (!lod.index_count) {
+            return {};
+        }
+
+        std::vector<u32> indices(lod.index_count);
+        _index_buffer.read(lod.first_index * sizeof(u32),
+                           indices.size() * sizeof(u32), indices.data());
+
+        // Only the vertices in the range used by the LOD
+        const auto [min_index, max_index] =
+            std::minmax_element(indices.begin(), indices.end());
+        const u32 first_vertex = *min_index;
+        const size_t vertex_count = *max_index - first_vertex + 1;
+        for (u32 &index : indices) {
+            index -= first_vertex;
+        }
+
+        const size_t stride = vertex_size(_vertex_format);
+        std::vector<byte> vertices(vertex_count * stride);
+        _vertex_buffer.read(first_vertex * stride, vertices.size(),
+                            vertices.data());
+
+        const MeshLod range = { 0, lod.index_count, 0.0f };
+        if (_vertex_format == VertexFormat::Packed) {
+            const VertexDequantization dequant = vertex_dequantization(_aabb);
+            return build_occluder(indices, range, vertex_count, [&](u32 index) {
+                PackedVertex vertex;
+                std::memcpy(&vertex, vertices.data() + index * stride,
+                            sizeof(vertex));
+                const u16 *position = vertex.position;
+                return glm::vec3(position[0], position[1], position[2])
+                         / 65535.0f * dequant.scale
+                     + dequant.offset;
+            });
+        }
+
+        return build_occluder(indices, range, vertex_count, [&](u32 index) {
+            Vertex vertex;
+            std::memcpy(&vertex, vertices.data() + index * stride,
+                        sizeof(vertex));
+            return vertex.position;
+        });
+    }
+
+    size_t StaticMesh::vertex_count() const {
+        return _vertex_buffer.byte_size() / vertex_size(_vertex_format);
+    }
+
+    VertexDequantization StaticMesh::dequantization() const {
+        if (_vertex_format == VertexFormat::Packed) {
+            return vertex_dequantization(_aabb);
+        }
+        return {};
     }
 
     void StaticMesh::setup() const {
         _vertex_buffer.bind(BufferUsage::Attribute);
         _index_buffer.bind(BufferUsage::Index);
 
+        setup_attributes(_vertex_format);
+    }
+
+    void StaticMesh::setup_attributes(VertexFormat format) {
+        if (format == VertexFormat::Packed) {
+            const GLsizei stride = sizeof(PackedVertex);
+            // Quantized position, w is the bitangent sign
+            glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, true, stride,
+                reinterpret_cast<void*>(offsetof(PackedVertex, position)));
+            // Octahedral normal
+            glVertexAttribPointer(1, 2, GL_SHORT, true, stride,
+                reinterpret_cast<void*>(offsetof(PackedVertex, normal)));
+            // Half float uv
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, false, stride,
+                reinterpret_cast<void*>(offsetof(PackedVertex, uv)));
+            // Octahedral tangent
+            glVertexAttribPointer(3, 2, GL_SHORT, true, stride,
+                reinterpret_cast<void*>(offsetof(PackedVertex, tangent)));
+            // Vertex color
+            glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, true, stride,
+                reinterpret_cast<void*>(offsetof(PackedVertex, color)));
+
+            glEnableVertexAttribArray(0);
+            glEnableVertexAttribArray(1);
+            glEnableVertexAttribArray(2);
+            glEnableVertexAttribArray(3);
+            glEnableVertexAttribArray(4);
+            return;
+        }
+
         // Vertex position
         glVertexAttribPointer(0, 3, GL_FLOAT, false, sizeof(Vertex), nullptr);
         // Vertex normal
@@ -66,15 +259,21 @@ namespace OM3D
         glEnableVertexAttribArray(4);
     }
 
-    void StaticMesh::draw_instanced(size_t instances) const {
+    void StaticMesh::draw_instanced(size_t instances, size_t first_instance, u32 lod) const {
+        setup();
+        const MeshLod &range = this->lod(lod);
+        glDrawElementsInstancedBaseInstance(GL_TRIANGLES, int(range.index_count), GL_UNSIGNED_INT, reinterpret_cast<void*>(range.first_index * sizeof(u32)), GLsizei(instances), GLuint(first_instance));
+    }
+
+    void StaticMesh::draw_indirect(size_t offset, size_t command_count) const {
         setup();
-        glDrawElementsInstanced(GL_TRIANGLES, int(_index_buffer.element_count()), GL_UNSIGNED_INT, 0, (GLsizei)instances);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<const void*>(offset), GLsizei(command_count), 0);
     }
 
     void StaticMesh::draw() const
     {
         setup();
-        glDrawElements(GL_TRIANGLES, int(_index_buffer.element_count()), GL_UNSIGNED_INT, nullptr);
+        glDrawElements(GL_TRIANGLES, int(_lods[0].index_count), GL_UNSIGNED_INT, reinterpret_cast<void*>(_lods[0].first_index * sizeof(u32)));
     }
 
 } // namespace OM3D
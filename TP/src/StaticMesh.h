@@ -1,18 +1,54 @@
 #ifndef STATICMESH_H
 #define STATICMESH_H
 
+#include <Bounds.h>
+#include <FrustumCuller.h>
+#include <OcclusionBuffer.h>
 #include <TypedBuffer.h>
 #include <Vertex.h>
+#include <VertexPacking.h>
 #include <graphics.h>
 #include <vector>
 
 namespace OM3D
 {
 
+    static constexpr u32 max_lod_count = 4;
+
+    // Range of the index buffer drawn for a level of detail. error is the
+    // largest distance between the level and the full detail surface, in
+    // object space.
+    struct MeshLod
+    {
+        u32 first_index = 0;
+        u32 index_count = 0;
+        float error = 0.0f;
+    };
+
+    // Cluster of triangles of the full detail level, stored as a range of
+    // the index buffer. The normals of all its triangles are in the cone, so
+    // the whole meshlet faces away from any view point p for which
+    // dot(center - p, cone_axis) >= cone_cutoff * length(center - p) + radius
+    struct Meshlet
+    {
+        u32 first_index = 0;
+        u32 index_count = 0;
+        glm::vec3 center = glm::vec3(0.0f);
+        float radius = 0.0f;
+        glm::vec3 cone_axis = glm::vec3(0.0f);
+        float cone_cutoff = 1.0f;
+    };
+
     struct MeshData
     {
         std::vector<Vertex> vertices;
         std::vector<u32> indices;
+
+        // Finest first, empty if the whole index buffer is the only level
+        std::vector<MeshLod> lods;
+
+        // Empty unless built at import
+        std::vector<Meshlet> meshlets;
     };
 
     class StaticMesh : NonCopyable
@@ -23,28 +59,83 @@ namespace OM3D
         StaticMesh &operator=(StaticMesh &&) = default;
 
         StaticMesh(const MeshData &data);
+        // Without lods, all the indices are drawn as a single level
+        StaticMesh(Span<const Vertex> vertices, Span<const u32> indices,
+                   const MeshBounds &bounds, Span<const MeshLod> lods = {},
+                   Span<const Meshlet> meshlets = {});
+
+        // Positions must be quantized against bounds.aabb
+        StaticMesh(Span<const PackedVertex> vertices, Span<const u32> indices,
+                   const MeshBounds &bounds, Span<const MeshLod> lods = {},
+                   Span<const Meshlet> meshlets = {});
 
         void setup() const;
+        static void setup_attributes(VertexFormat format = VertexFormat::Full);
         void draw() const;
-        void draw_instanced(size_t instances) const;
+        void draw_instanced(size_t instances, size_t first_instance = 0,
+                            u32 lod = 0) const;
+
+        // Draws command_count commands from the bound indirect buffer,
+        // starting at byte offset. Indices are relative to this mesh.
+        void draw_indirect(size_t offset, size_t command_count) const;
+
+        u32 lod_count() const;
+        const MeshLod &lod(u32 index) const;
+
+        size_t meshlet_count() const;
+        const Meshlet &meshlet(size_t index) const;
+
+        // Object space bounding spheres of the meshlets
+        const FrustumCuller &meshlet_culler() const;
+
+        // CPU copy of a coarse LOD, for software occlusion culling. Read
+        // back from the GPU the first time, needs the GL context.
+        const OccluderMesh &occluder() const;
 		
 		TypedBuffer<u32>* get_indices() { return &_index_buffer; }
-		TypedBuffer<Vertex>* get_vertices() { return &_vertex_buffer; }
+		ByteBuffer* get_vertices() { return &_vertex_buffer; }
+		const TypedBuffer<u32>* get_indices() const { return &_index_buffer; }
+		const ByteBuffer* get_vertices() const { return &_vertex_buffer; }
+
+        size_t vertex_count() const;
+
+        inline VertexFormat vertex_format() const {
+            return _vertex_format;
+        }
+
+        // Maps the vertex buffer positions to object space
+        VertexDequantization dequantization() const;
 
         inline const glm::vec3& get_center() const {
             return _center;
         }
 
-        inline const float get_radius() const {
+        inline float get_radius() const {
             return _radius;
         }
 
+        inline const AABB& get_aabb() const {
+            return _aabb;
+        }
+
     private:
-        TypedBuffer<Vertex> _vertex_buffer;
+        OccluderMesh read_occluder() const;
+
+        ByteBuffer _vertex_buffer;
         TypedBuffer<u32> _index_buffer;
+        VertexFormat _vertex_format = VertexFormat::Full;
+
+        std::vector<MeshLod> _lods;
+
+        std::vector<Meshlet> _meshlets;
+        FrustumCuller _meshlet_culler;
+
+        mutable OccluderMesh _occluder;
+        mutable bool _occluder_read = false;
 
-        glm::vec3 _center;
-        float _radius;
+        AABB _aabb;
+        glm::vec3 _center = glm::vec3(0.0f);
+        float _radius = 0.0f;
     };
 
 } // namespace OM3D
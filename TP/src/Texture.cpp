@@ -1,6 +1,7 @@
 #include "Texture.h"
 
 #include <glad/glad.h>
+#include <glm/common.hpp>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <algorithm>
@@ -40,28 +41,80 @@ namespace OM3D
         return handle;
     }
 
+    static size_t bytes_per_pixel(ImageFormat format)
+    {
+        switch (format)
+        {
+            case ImageFormat::RGB8_UNORM:
+            case ImageFormat::RGB8_sRGB:
+                return 3;
+
+            case ImageFormat::RGBA16_FLOAT:
+                return 8;
+
+            default:
+                return 4;
+        }
+    }
+
+    static glm::uvec2 mip_size(const glm::uvec2 &size, u32 level)
+    {
+        return glm::max(glm::uvec2(size.x >> level, size.y >> level),
+                        glm::uvec2(1));
+    }
+
     Texture::Texture(const TextureData &data)
+        : Texture(data.size, data.format,
+                  Span<const u8>(data.data.get(),
+                                 byte_size(data.size, data.format)),
+                  1)
+    {}
+
+    Texture::Texture(const glm::uvec2 &size, ImageFormat format,
+                     Span<const u8> data, u32 mip_count)
         : _handle(create_texture_handle())
-        , _size(data.size)
-        , _format(data.format)
+        , _size(size)
+        , _format(format)
+        , _mip_count(mip_levels(size))
     {
+        const u32 levels = _mip_count;
+        DEBUG_ASSERT(mip_count && mip_count <= levels);
+
         const ImageFormatGL gl_format = image_format_to_gl(_format);
-        glTextureStorage2D(_handle.get(), mip_levels(_size),
-                           gl_format.internal_format, _size.x, _size.y);
-        glTextureSubImage2D(_handle.get(), 0, 0, 0, _size.x, _size.y,
-                            gl_format.format, gl_format.component_type,
-                            data.data.get());
-        glGenerateTextureMipmap(_handle.get());
+        glTextureStorage2D(_handle.get(), levels, gl_format.internal_format,
+                           _size.x, _size.y);
+
+        DEBUG_ASSERT(byte_size(_size, _format, mip_count) <= data.size());
+
+        size_t offset = 0;
+        for (u32 level = 0; level != mip_count; ++level)
+        {
+            const glm::uvec2 level_size = mip_size(_size, level);
+            glTextureSubImage2D(_handle.get(), level, 0, 0, level_size.x,
+                                level_size.y, gl_format.format,
+                                gl_format.component_type,
+                                data.data() + offset);
+            offset += byte_size(level_size, _format);
+        }
+
+        if (mip_count != levels)
+        {
+            glGenerateTextureMipmap(_handle.get());
+        }
     }
 
-    Texture::Texture(const glm::uvec2 &size, ImageFormat format)
+    Texture::Texture(const glm::uvec2 &size, ImageFormat format,
+                     u32 mip_count)
         : _handle(create_texture_handle())
         , _size(size)
         , _format(format)
+        , _mip_count(mip_count)
     {
+        DEBUG_ASSERT(mip_count && mip_count <= mip_levels(_size));
+
         const ImageFormatGL gl_format = image_format_to_gl(_format);
-        glTextureStorage2D(_handle.get(), 1, gl_format.internal_format, _size.x,
-                           _size.y);
+        glTextureStorage2D(_handle.get(), mip_count, gl_format.internal_format,
+                           _size.x, _size.y);
     }
 
     Texture::~Texture()
@@ -77,9 +130,10 @@ namespace OM3D
         glBindTextureUnit(index, _handle.get());
     }
 
-    void Texture::bind_as_image(u32 index, AccessType access)
+    void Texture::bind_as_image(u32 index, AccessType access, u32 level)
     {
-        glBindImageTexture(index, _handle.get(), 0, false, 0,
+        DEBUG_ASSERT(level < _mip_count);
+        glBindImageTexture(index, _handle.get(), GLint(level), false, 0,
                            access_type_to_gl(access),
                            image_format_to_gl(_format).internal_format);
     }
@@ -89,6 +143,11 @@ namespace OM3D
         return _size;
     }
 
+    u32 Texture::mip_count() const
+    {
+        return _mip_count;
+    }
+
     // Return number of mip levels needed
     u32 Texture::mip_levels(glm::uvec2 size)
     {
@@ -96,4 +155,98 @@ namespace OM3D
         return 1 + u32(std::floor(std::log2(side)));
     }
 
+    size_t Texture::byte_size(glm::uvec2 size, ImageFormat format,
+                              u32 mip_count)
+    {
+        size_t bytes = 0;
+        for (u32 level = 0; level != mip_count; ++level)
+        {
+            const glm::uvec2 level_size = mip_size(size, level);
+            bytes += size_t(level_size.x) * level_size.y
+                * bytes_per_pixel(format);
+        }
+        return bytes;
+    }
+
+    std::vector<u8> Texture::build_mip_chain(const TextureData &data)
+    {
+        const bool is_sRGB = data.format == ImageFormat::RGBA8_sRGB;
+        ALWAYS_ASSERT(is_sRGB || data.format == ImageFormat::RGBA8_UNORM,
+                      "Mip chains can only be built for RGBA8 textures");
+
+        static const auto to_linear = [] {
+            std::array<float, 256> lut = {};
+            for (size_t i = 0; i != lut.size(); ++i)
+            {
+                const float c = float(i) / 255.0f;
+                lut[i] = c <= 0.04045f
+                    ? c / 12.92f
+                    : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            return lut;
+        }();
+
+        const auto to_sRGB = [](float c) {
+            return c <= 0.0031308f ? c * 12.92f
+                                   : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+        };
+
+        const u32 levels = mip_levels(data.size);
+        const size_t base_size = byte_size(data.size, data.format);
+
+        std::vector<u8> chain(byte_size(data.size, data.format, levels));
+        std::copy_n(data.data.get(), base_size, chain.data());
+
+        // Box filter each level from the previous one, alpha is linear
+        size_t src_offset = 0;
+        size_t dst_offset = base_size;
+        for (u32 level = 1; level != levels; ++level)
+        {
+            const glm::uvec2 src_size = mip_size(data.size, level - 1);
+            const glm::uvec2 dst_size = mip_size(data.size, level);
+            const u8 *src = chain.data() + src_offset;
+            u8 *dst = chain.data() + dst_offset;
+
+            for (u32 y = 0; y != dst_size.y; ++y)
+            {
+                for (u32 x = 0; x != dst_size.x; ++x)
+                {
+                    const u32 xs[] = { std::min(x * 2, src_size.x - 1),
+                                       std::min(x * 2 + 1, src_size.x - 1) };
+                    const u32 ys[] = { std::min(y * 2, src_size.y - 1),
+                                       std::min(y * 2 + 1, src_size.y - 1) };
+
+                    for (u32 c = 0; c != 4; ++c)
+                    {
+                        float sum = 0.0f;
+                        for (const u32 sy : ys)
+                        {
+                            for (const u32 sx : xs)
+                            {
+                                const u8 value =
+                                    src[(size_t(sy) * src_size.x + sx) * 4 + c];
+                                sum += is_sRGB && c != 3
+                                    ? to_linear[value]
+                                    : float(value) / 255.0f;
+                            }
+                        }
+
+                        float value = sum * 0.25f;
+                        if (is_sRGB && c != 3)
+                        {
+                            value = to_sRGB(value);
+                        }
+                        dst[(size_t(y) * dst_size.x + x) * 4 + c] =
+                            u8(std::clamp(value * 255.0f + 0.5f, 0.0f, 255.0f));
+                    }
+                }
+            }
+
+            src_offset = dst_offset;
+            dst_offset += size_t(dst_size.x) * dst_size.y * 4;
+        }
+
+        return chain;
+    }
+
 } // namespace OM3D
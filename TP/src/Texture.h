@@ -29,21 +29,36 @@ namespace OM3D
         ~Texture();
 
         Texture(const TextureData &data);
-        Texture(const glm::uvec2 &size, ImageFormat format);
+        // Uninitialized storage for mip_count levels
+        Texture(const glm::uvec2 &size, ImageFormat format, u32 mip_count = 1);
+
+        // Uploads mip_count levels stored one after the other, all missing
+        // levels are generated
+        Texture(const glm::uvec2 &size, ImageFormat format, Span<const u8> data,
+                u32 mip_count);
 
         void bind(u32 index) const;
-        void bind_as_image(u32 index, AccessType access);
+        void bind_as_image(u32 index, AccessType access, u32 level = 0);
 
         const glm::uvec2 &size() const;
+        u32 mip_count() const;
 
         static u32 mip_levels(glm::uvec2 size);
 
+        // Size of the first mip_count levels of a texture
+        static size_t byte_size(glm::uvec2 size, ImageFormat format,
+                                u32 mip_count = 1);
+
+        // Full mip chain of an 8 bit RGBA image, filtered in linear space
+        static std::vector<u8> build_mip_chain(const TextureData &data);
+
     private:
         friend class Framebuffer;
 
         GLHandle _handle;
         glm::uvec2 _size = {};
         ImageFormat _format;
+        u32 _mip_count = 1;
     };
 
 } // namespace OM3D
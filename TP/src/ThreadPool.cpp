@@ -0,0 +1,109 @@
+#include "ThreadPool.h"
+
+#include <CPUProfiler.h>
+
+namespace OM3D
+{
+
+    ThreadPool::ThreadPool(u32 thread_count)
+    {
+        for (u32 i = 0; i != thread_count; ++i)
+        {
+            _threads.emplace_back([this, i] {
+                CPUProfiler::global().set_thread_name("Worker "
+                                                      + std::to_string(i));
+                worker();
+            });
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::unique_lock lock(_lock);
+            _stop = true;
+        }
+        _condition.notify_all();
+
+        for (std::thread &thread : _threads)
+        {
+            thread.join();
+        }
+    }
+
+    void ThreadPool::schedule(std::function<void()> task)
+    {
+        if (_threads.empty())
+        {
+            task();
+            return;
+        }
+
+        {
+            std::unique_lock lock(_lock);
+            _tasks.emplace_back(std::move(task));
+        }
+        _condition.notify_one();
+    }
+
+    u32 ThreadPool::thread_count() const
+    {
+        return u32(_threads.size());
+    }
+
+    u32 ThreadPool::default_thread_count()
+    {
+        // Keep one core for the main (GL) thread
+        const u32 cores = std::thread::hardware_concurrency();
+        return cores > 1 ? cores - 1 : 0;
+    }
+
+    ThreadPool &ThreadPool::global()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    void ThreadPool::worker()
+    {
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(_lock);
+                _condition.wait(lock, [&] { return _stop || !_tasks.empty(); });
+
+                if (_tasks.empty())
+                {
+                    return;
+                }
+
+                task = std::move(_tasks.front());
+                _tasks.pop_front();
+            }
+
+            PROFILE_ZONE("Task");
+            task();
+        }
+    }
+
+    void ThreadPool::ParallelForState::run()
+    {
+        for (size_t i = next++; i < count; i = next++)
+        {
+            func(i);
+            if (++done == count)
+            {
+                std::unique_lock l(lock);
+                condition.notify_all();
+            }
+        }
+    }
+
+    void ThreadPool::ParallelForState::wait()
+    {
+        std::unique_lock l(lock);
+        condition.wait(l, [&] { return done == count; });
+    }
+
+} // namespace OM3D
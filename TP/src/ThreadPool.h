@@ -0,0 +1,96 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <utils.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace OM3D
+{
+
+    class ThreadPool : NonMovable
+    {
+    public:
+        ThreadPool(u32 thread_count = default_thread_count());
+        ~ThreadPool();
+
+        void schedule(std::function<void()> task);
+
+        // Calls func(i) for every i in [0; count) and returns once all calls
+        // are done. The calling thread takes part in the work, so this is safe
+        // to call from inside a task.
+        template <typename F>
+        void parallel_for(size_t count, F &&func)
+        {
+            if (!count)
+            {
+                return;
+            }
+
+            if (count == 1 || _threads.empty())
+            {
+                for (size_t i = 0; i != count; ++i)
+                {
+                    func(i);
+                }
+                return;
+            }
+
+            auto state = std::make_shared<ParallelForState>();
+            state->count = count;
+            state->func = [&](size_t i) { func(i); };
+
+            const size_t tasks = std::min(count - 1, _threads.size());
+            for (size_t i = 0; i != tasks; ++i)
+            {
+                schedule([state] { state->run(); });
+            }
+
+            state->run();
+            state->wait();
+        }
+
+        u32 thread_count() const;
+
+        static u32 default_thread_count();
+
+        // Pool shared by the whole application
+        static ThreadPool &global();
+
+    private:
+        struct ParallelForState
+        {
+            std::function<void(size_t)> func;
+            size_t count = 0;
+
+            std::atomic<size_t> next = 0;
+            std::atomic<size_t> done = 0;
+
+            std::mutex lock;
+            std::condition_variable condition;
+
+            void run();
+            void wait();
+        };
+
+        void worker();
+
+        std::vector<std::thread> _threads;
+        std::deque<std::function<void()>> _tasks;
+
+        std::mutex _lock;
+        std::condition_variable _condition;
+        bool _stop = false;
+    };
+
+} // namespace OM3D
+
+#endif // THREADPOOL_H
@@ -4,6 +4,7 @@
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
+#include <utils.h>
 
 namespace OM3D
 {
@@ -19,6 +20,35 @@ namespace OM3D
             1.0f); // to avoid completly black meshes if no color is present
     };
 
+    enum class VertexFormat
+    {
+        Full,
+        Packed,
+    };
+
+    // Quantized vertex (24 bytes instead of 80):
+    //  - position is unorm16 relative to the mesh AABB, the 4th component
+    //    holds the bitangent sign (0: negative, 1: positive)
+    //  - normal and tangent are octahedral encoded snorm16
+    //  - uv is half float
+    //  - color is unorm8, alpha is unused
+    struct PackedVertex
+    {
+        u16 position[4];
+        i16 normal[2];
+        i16 tangent[2];
+        u16 uv[2];
+        u8 color[4];
+    };
+
+    static_assert(sizeof(PackedVertex) == 24, "PackedVertex is not packed");
+
+    inline size_t vertex_size(VertexFormat format)
+    {
+        return format == VertexFormat::Packed ? sizeof(PackedVertex)
+                                              : sizeof(Vertex);
+    }
+
 } // namespace OM3D
 
 #endif // VERTEX_H
@@ -0,0 +1,100 @@
+#include "VertexPacking.h"
+
+#include <glm/geometric.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <cmath>
+
+namespace OM3D
+{
+
+    static u16 to_unorm16(float value)
+    {
+        return u16(std::round(glm::clamp(value, 0.0f, 1.0f) * 65535.0f));
+    }
+
+    static i16 to_snorm16(float value)
+    {
+        return i16(std::round(glm::clamp(value, -1.0f, 1.0f) * 32767.0f));
+    }
+
+    static u8 to_unorm8(float value)
+    {
+        return u8(std::round(glm::clamp(value, 0.0f, 1.0f) * 255.0f));
+    }
+
+    // Octahedral mapping of a unit vector to [-1; 1]^2
+    static glm::vec2 octahedral_encode(glm::vec3 n)
+    {
+        const float norm = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+        if (!(norm > 0.0f))
+        {
+            return glm::vec2(0.0f);
+        }
+
+        n /= norm;
+        glm::vec2 e = glm::vec2(n);
+        if (n.z < 0.0f)
+        {
+            e = (1.0f - glm::abs(glm::vec2(e.y, e.x)))
+              * glm::vec2(e.x >= 0.0f ? 1.0f : -1.0f,
+                          e.y >= 0.0f ? 1.0f : -1.0f);
+        }
+        return e;
+    }
+
+    VertexDequantization vertex_dequantization(const AABB &bounds)
+    {
+        VertexDequantization dequant;
+        if (!bounds.is_empty())
+        {
+            dequant.scale = bounds.extent();
+            dequant.offset = bounds.min;
+        }
+        return dequant;
+    }
+
+    std::vector<PackedVertex> pack_vertices(Span<const Vertex> vertices,
+                                            const AABB &bounds)
+    {
+        const VertexDequantization dequant = vertex_dequantization(bounds);
+        const glm::vec3 inv_scale =
+            glm::vec3(dequant.scale.x > 0.0f ? 1.0f / dequant.scale.x : 0.0f,
+                      dequant.scale.y > 0.0f ? 1.0f / dequant.scale.y : 0.0f,
+                      dequant.scale.z > 0.0f ? 1.0f / dequant.scale.z : 0.0f);
+
+        std::vector<PackedVertex> packed(vertices.size());
+        for (size_t i = 0; i != vertices.size(); ++i)
+        {
+            const Vertex &vertex = vertices[i];
+            PackedVertex &out = packed[i];
+
+            const glm::vec3 position =
+                (vertex.position - dequant.offset) * inv_scale;
+            out.position[0] = to_unorm16(position.x);
+            out.position[1] = to_unorm16(position.y);
+            out.position[2] = to_unorm16(position.z);
+            out.position[3] = vertex.tangent_bitangent_sign.w > 0.0f ? 65535 : 0;
+
+            const glm::vec2 normal = octahedral_encode(vertex.normal);
+            out.normal[0] = to_snorm16(normal.x);
+            out.normal[1] = to_snorm16(normal.y);
+
+            const glm::vec2 tangent =
+                octahedral_encode(glm::vec3(vertex.tangent_bitangent_sign));
+            out.tangent[0] = to_snorm16(tangent.x);
+            out.tangent[1] = to_snorm16(tangent.y);
+
+            out.uv[0] = glm::packHalf1x16(vertex.uv.x);
+            out.uv[1] = glm::packHalf1x16(vertex.uv.y);
+
+            out.color[0] = to_unorm8(vertex.color.r);
+            out.color[1] = to_unorm8(vertex.color.g);
+            out.color[2] = to_unorm8(vertex.color.b);
+            out.color[3] = 255;
+        }
+
+        return packed;
+    }
+
+} // namespace OM3D
@@ -0,0 +1,28 @@
+#ifndef VERTEXPACKING_H
+#define VERTEXPACKING_H
+
+#include <Bounds.h>
+#include <Vertex.h>
+
+#include <vector>
+
+namespace OM3D
+{
+
+    // Maps packed positions back to object space:
+    // position = packed * scale + offset
+    struct VertexDequantization
+    {
+        glm::vec3 scale = glm::vec3(1.0f);
+        glm::vec3 offset = glm::vec3(0.0f);
+    };
+
+    VertexDequantization vertex_dequantization(const AABB &bounds);
+
+    // Positions are quantized against bounds, which must contain them all
+    std::vector<PackedVertex> pack_vertices(Span<const Vertex> vertices,
+                                            const AABB &bounds);
+
+} // namespace OM3D
+
+#endif // VERTEXPACKING_H
@@ -4,6 +4,7 @@
 
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
+#include <cstring>
 #include <iostream>
 
 namespace OM3D
@@ -43,6 +44,9 @@ namespace OM3D
 
         case BufferUsage::Storage:
             return GL_SHADER_STORAGE_BUFFER;
+
+        case BufferUsage::Indirect:
+            return GL_DRAW_INDIRECT_BUFFER;
         }
 
         FATAL("Unknown usage value");
@@ -76,10 +80,31 @@ namespace OM3D
 
     static GLuint global_vao = 0;
 
-    void init_graphics()
+    bool has_parallel_shader_compile()
     {
-        ALWAYS_ASSERT(gladLoadGLLoader((GLADloadproc)(glfwGetProcAddress)),
-                      "glad initialization failed");
+        static const bool supported = [] {
+            int count = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+            for (int i = 0; i != count; ++i)
+            {
+                const char *name = reinterpret_cast<const char *>(
+                    glGetStringi(GL_EXTENSIONS, i));
+                if (!std::strcmp(name, "GL_KHR_parallel_shader_compile")
+                    || !std::strcmp(name, "GL_ARB_parallel_shader_compile"))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }();
+        return supported;
+    }
+
+    void init_graphics(GLProcLoader loader)
+    {
+        const GLADloadproc load =
+            loader ? GLADloadproc(loader) : (GLADloadproc)(glfwGetProcAddress);
+        ALWAYS_ASSERT(gladLoadGLLoader(load), "glad initialization failed");
 
         std::cout << "OpenGL " << glGetString(GL_VERSION) << " initialized on "
                   << glGetString(GL_VENDOR) << " " << glGetString(GL_RENDERER)
@@ -109,6 +134,24 @@ namespace OM3D
 
         glGenVertexArrays(1, &global_vao);
         glBindVertexArray(global_vao);
+
+        // Let the driver compile on as many threads as it wants, drivers may
+        // use none until told. glad is generated without the extension.
+        if (has_parallel_shader_compile())
+        {
+            using MaxThreadsProc = void(APIENTRYP)(GLuint);
+            auto max_threads = reinterpret_cast<MaxThreadsProc>(
+                load("glMaxShaderCompilerThreadsKHR"));
+            if (!max_threads)
+            {
+                max_threads = reinterpret_cast<MaxThreadsProc>(
+                    load("glMaxShaderCompilerThreadsARB"));
+            }
+            if (max_threads)
+            {
+                max_threads(0xFFFFFFFF);
+            }
+        }
     }
 
 } // namespace OM3D
@@ -59,6 +59,7 @@ namespace OM3D
         Index,
         Uniform,
         Storage,
+        Indirect,
     };
 
     enum class AccessType
@@ -73,7 +74,15 @@ namespace OM3D
 
     u32 align_up_to(u32 val, u32 up_to);
 
-    void init_graphics();
+    // Returns the address of a GL function
+    using GLProcLoader = void *(*)(const char *name);
+
+    // Uses GLFW to load GL functions if loader is null
+    void init_graphics(GLProcLoader loader = nullptr);
+
+    // GL_KHR_parallel_shader_compile or its ARB version: compiling and
+    // linking return right away, and completion can be polled
+    bool has_parallel_shader_compile();
 
 } // namespace OM3D
 
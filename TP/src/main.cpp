@@ -1,16 +1,34 @@
 #include <glad/glad.h>
 
 #define GLFW_INCLUDE_NONE
+#include <BVH.h>
+#include <CPUProfiler.h>
+#include <CameraPath.h>
 #include <Framebuffer.h>
+#include <FrustumCuller.h>
 #include <GLFW/glfw3.h>
+#include <GPUProfiler.h>
+#include <HeadlessContext.h>
 #include <ImGuiRenderer.h>
+#include <ProgramCache.h>
+#include <SceneGenerator.h>
 #include <SceneView.h>
 #include <Texture.h>
 #include <graphics.h>
 #include <imgui/imgui.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <random>
 #include <vector>
 
+#ifdef OS_LINUX
+#    include <sys/resource.h>
+#endif
+
 using namespace OM3D;
 
 static float delta_time = 0.0f;
@@ -94,47 +112,931 @@ void process_inputs(GLFWwindow *window, Camera &camera)
     mouse_pos = new_mouse_pos;
 }
 
-std::unique_ptr<Scene> create_default_scene()
+void add_default_lights(Scene &scene)
 {
-    auto scene = std::make_unique<Scene>();
-
-    // Load default cube model
-    auto result = Scene::from_gltf(std::string(data_path) + "forest_huge.glb");
-    ALWAYS_ASSERT(result.is_ok, "Unable to load default scene");
-    scene = std::move(result.value);
-
-    // Add lights
     {
         PointLight light;
         light.set_position(glm::vec3(1.0f, 2.0f, 4.0f));
         light.set_color(glm::vec3(0.0f, 10.0f, 0.0f));
         light.set_radius(100.0f);
-        scene->add_object(std::move(light));
+        scene.add_object(std::move(light));
     }
     {
         PointLight light;
         light.set_position(glm::vec3(1.0f, 2.0f, -4.0f));
         light.set_color(glm::vec3(10.0f, 0.0f, 0.0f));
         light.set_radius(50.0f);
-        scene->add_object(std::move(light));
+        scene.add_object(std::move(light));
     }
+}
 
+// Falls back to a generated scene if the default model is missing
+std::unique_ptr<Scene> create_default_scene()
+{
+    const std::string file_name = std::string(data_path) + "forest_huge.glb";
+    auto result = Scene::from_gltf(file_name);
+    if (!result.is_ok)
+    {
+        std::cerr << "Unable to load default scene (" << file_name
+                  << "), generating one" << std::endl;
+        return generate_scene(SceneGeneratorSettings());
+    }
+
+    std::unique_ptr<Scene> scene = std::move(result.value);
+    add_default_lights(*scene);
     return scene;
 }
 
-int main(int, char **)
+// Compares the culling paths against a naive per-object loop, no GL needed
+void run_culling_benchmark(size_t object_count)
+{
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+    std::uniform_real_distribution<float> radius(0.5f, 5.0f);
+
+    std::vector<glm::vec4> spheres(object_count);
+    FrustumCuller culler;
+    culler.resize(object_count);
+    for (size_t i = 0; i != object_count; ++i)
+    {
+        spheres[i] = glm::vec4(position(rng), position(rng), position(rng),
+                               radius(rng));
+        culler.set_sphere(i, glm::vec3(spheres[i]), spheres[i].w);
+    }
+
+    Camera camera;
+    camera.set_view(glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f, 0.2f, 0.5f),
+                                glm::vec3(0.0f, 1.0f, 0.0f)));
+    const FrustumPlanes planes = camera.build_frustum_planes();
+
+    const size_t iterations =
+        std::max(size_t(200000000) / std::max(object_count, size_t(1)),
+                 size_t(1));
+    std::vector<u32> visible;
+
+    const auto run = [&](const char *name, auto &&cull) {
+        const double start = program_time();
+        for (size_t i = 0; i != iterations; ++i)
+        {
+            cull();
+        }
+        const double ns = (program_time() - start) * 1.0e9;
+        std::cout << name << ": " << visible.size() << " visible, "
+                  << double(object_count * iterations) / ns << " objects/ns"
+                  << std::endl;
+    };
+
+    std::cout << "Culling " << object_count << " spheres, " << iterations
+              << " iterations" << std::endl;
+
+    run("naive", [&] {
+        visible.clear();
+        for (size_t i = 0; i != object_count; ++i)
+        {
+            bool inside = true;
+            for (const glm::vec4 &plane : planes)
+            {
+                if (glm::dot(glm::vec3(plane), glm::vec3(spheres[i])) + plane.w
+                    < -spheres[i].w)
+                {
+                    inside = false;
+                    break;
+                }
+            }
+            if (inside)
+            {
+                visible.push_back(u32(i));
+            }
+        }
+    });
+
+    const std::pair<CullingPath, const char *> paths[] = {
+        { CullingPath::Scalar, "scalar" },
+        { CullingPath::SSE, "sse" },
+        { CullingPath::AVX, "avx" },
+    };
+    for (const auto &[path, name] : paths)
+    {
+        if (FrustumCuller::is_supported(path))
+        {
+            run(name, [&, path = path] { culler.cull(planes, visible, path); });
+        }
+    }
+}
+
+// Measures BVH build, refit and query throughput on random boxes
+void run_bvh_benchmark(size_t object_count)
+{
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+    std::uniform_real_distribution<float> size(0.5f, 5.0f);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+    std::vector<AABB> boxes(object_count);
+    for (AABB &box : boxes)
+    {
+        const glm::vec3 center(position(rng), position(rng), position(rng));
+        const glm::vec3 half_extent(size(rng), size(rng), size(rng));
+        box = AABB{ center - half_extent, center + half_extent };
+    }
+
+    const auto measure = [](size_t iterations, auto &&func) {
+        const double start = program_time();
+        for (size_t i = 0; i != iterations; ++i)
+        {
+            func(i);
+        }
+        return (program_time() - start) / double(iterations);
+    };
+
+    std::cout << "BVH over " << object_count << " boxes" << std::endl;
+
+    BVH bvh;
+    const double build_time =
+        measure(10, [&](size_t) { bvh.build(boxes); });
+    std::cout << "build: " << build_time * 1000.0 << "ms, "
+              << bvh.node_count() << " nodes" << std::endl;
+
+    for (AABB &box : boxes)
+    {
+        const glm::vec3 offset(unit(rng), unit(rng), unit(rng));
+        box = AABB{ box.min + offset, box.max + offset };
+    }
+    const double refit_time =
+        measure(10, [&](size_t) { bvh.refit(boxes); });
+    std::cout << "refit: " << refit_time * 1000.0 << "ms" << std::endl;
+
+    std::vector<u32> result;
+    {
+        Camera camera;
+        camera.set_view(glm::lookAt(glm::vec3(0.0f),
+                                    glm::vec3(1.0f, 0.2f, 0.5f),
+                                    glm::vec3(0.0f, 1.0f, 0.0f)));
+        const FrustumPlanes planes = camera.build_frustum_planes();
+
+        const double cull_time = measure(100, [&](size_t) {
+            result.clear();
+            bvh.cull(planes, result);
+        });
+        std::cout << "frustum cull: " << result.size() << " visible, "
+                  << cull_time * 1.0e6 << "us, "
+                  << double(object_count) / (cull_time * 1.0e9)
+                  << " objects/ns" << std::endl;
+    }
+
+    const size_t query_count = 10000;
+    {
+        std::vector<Ray> rays(query_count);
+        for (Ray &ray : rays)
+        {
+            ray.origin = glm::vec3(position(rng), position(rng), position(rng));
+            ray.direction =
+                glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)));
+        }
+
+        size_t hits = 0;
+        const double ray_time = measure(query_count, [&](size_t i) {
+            hits += bvh.raycast(rays[i]).is_ok;
+        });
+        std::cout << "raycast: " << hits << " hits, "
+                  << 1.0 / (ray_time * 1.0e6) << " Mrays/s" << std::endl;
+    }
+    {
+        std::vector<AABB> queries(query_count);
+        for (AABB &query : queries)
+        {
+            query = AABB::from_sphere(
+                glm::vec3(position(rng), position(rng), position(rng)), 20.0f);
+        }
+
+        size_t overlaps = 0;
+        const double box_time = measure(query_count, [&](size_t i) {
+            result.clear();
+            bvh.query(queries[i], result);
+            overlaps += result.size();
+        });
+        std::cout << "box query: " << overlaps << " overlaps, "
+                  << 1.0 / (box_time * 1.0e6) << " Mqueries/s" << std::endl;
+    }
+}
+
+// Compares the frame time of clustered and deferred lighting to shading every
+// light in every fragment, on a generated scene. Needs a GL context.
+void run_light_benchmark(size_t light_count)
+{
+    // The generator spreads the lights over the instances
+    SceneGeneratorSettings generator;
+    generator.light_count = u32(light_count);
+    std::unique_ptr<Scene> scene = generate_scene(generator);
+    scene->wait_for_programs();
+
+    SceneView scene_view(scene.get());
+    scene_view.camera().set_view(
+        CameraPath::orbit(scene->bounds()).view_matrix(0.0f));
+    Texture depth(window_size, ImageFormat::Depth32_FLOAT);
+    Texture lit(window_size, ImageFormat::RGBA16_FLOAT);
+    Framebuffer framebuffer(&depth, std::array{ &lit });
+
+    std::cout << "Shading " << light_count << " lights at " << window_size.x
+              << "x" << window_size.y << std::endl;
+
+    const size_t frame_count = 50;
+    RenderSettings modes[3];
+    modes[1].clustered_lighting = true;
+    modes[2].deferred_shading = true;
+    const char *mode_names[] = { "all lights", "clustered", "deferred" };
+    for (size_t mode = 0; mode != std::size(modes); ++mode)
+    {
+        const RenderSettings &settings = modes[mode];
+
+        const auto render = [&] {
+            framebuffer.bind();
+            scene_view.render(settings, &depth, &lit);
+        };
+
+        // Warm up
+        for (size_t i = 0; i != 5; ++i)
+        {
+            render();
+        }
+        glFinish();
+
+        const double start = program_time();
+        for (size_t i = 0; i != frame_count; ++i)
+        {
+            render();
+        }
+        glFinish();
+        const double ms = (program_time() - start) * 1000.0 / frame_count;
+        std::cout << mode_names[mode] << ": " << ms << "ms per frame";
+        if (const u32 dropped = scene->stats().dropped_cluster_lights)
+        {
+            std::cout << " (" << dropped << " lights dropped from full "
+                      << "clusters)";
+        }
+        if (const u32 dropped = scene->stats().dropped_tile_lights)
+        {
+            std::cout << " (" << dropped << " lights dropped from full "
+                      << "tiles)";
+        }
+        std::cout << std::endl;
+    }
+
+    scene = nullptr;
+}
+
+// Options of --bench-scene
+struct SceneBenchmark
+{
+    bool enabled = false;
+    std::string scene_file;
+
+    // Replaces scene_file with a procedural scene, implied if it is empty
+    bool generate = false;
+    SceneGeneratorSettings generator;
+
+    // Orbit around the scene if empty
+    std::string camera_path_file;
+
+    std::string report_file = "benchmark.json";
+    size_t frame_count = 500;
+    RenderSettings settings;
+};
+
+// Boolean render settings, by name
+std::array<std::pair<const char *, bool *>, 11>
+render_setting_flags(RenderSettings &settings)
+{
+    return { {
+        { "multi_draw_indirect", &settings.multi_draw_indirect },
+        { "gpu_culling", &settings.gpu_culling },
+        { "occlusion_culling", &settings.occlusion_culling },
+        { "cpu_culling", &settings.cpu_culling },
+        { "bvh_culling", &settings.bvh_culling },
+        { "software_occlusion", &settings.software_occlusion },
+        { "lod_selection", &settings.lod_selection },
+        { "meshlet_culling", &settings.meshlet_culling },
+        { "clustered_lighting", &settings.clustered_lighting },
+        { "depth_prepass", &settings.depth_prepass },
+        { "deferred_shading", &settings.deferred_shading },
+    } };
+}
+
+std::string json_string(std::string_view str)
+{
+    std::string json = "\"";
+    for (const char c : str)
+    {
+        if (c == '"' || c == '\\')
+        {
+            json += '\\';
+        }
+        json += c;
+    }
+    return json + "\"";
+}
+
+// Nearest rank percentiles
+void write_frame_times(std::ostream &out, std::vector<double> times)
+{
+    if (times.empty())
+    {
+        out << "null";
+        return;
+    }
+
+    std::sort(times.begin(), times.end());
+    auto percentile = [&](double p) {
+        const size_t rank = size_t(std::ceil(p * double(times.size())));
+        return times[std::clamp(rank, size_t(1), times.size()) - 1];
+    };
+
+    double sum = 0.0;
+    for (const double time : times)
+    {
+        sum += time;
+    }
+
+    out << "{\"min\":" << times.front()
+        << ",\"mean\":" << sum / double(times.size())
+        << ",\"p50\":" << percentile(0.5) << ",\"p90\":" << percentile(0.9)
+        << ",\"p95\":" << percentile(0.95) << ",\"p99\":" << percentile(0.99)
+        << ",\"max\":" << times.back() << "}";
+}
+
+size_t peak_memory_bytes()
+{
+#ifdef OS_LINUX
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    return size_t(usage.ru_maxrss) * 1024;
+#else
+    return 0;
+#endif
+}
+
+// Replays a camera path for a fixed number of frames, as fast as possible,
+// and writes CPU and GPU frame time percentiles and scene statistics to a
+// JSON report. Needs a GL context.
+int run_scene_benchmark(SceneBenchmark benchmark)
+{
+    benchmark.generate |= benchmark.scene_file.empty();
+
+    std::unique_ptr<Scene> scene;
+    if (benchmark.generate)
+    {
+        scene = generate_scene(benchmark.generator);
+    }
+    else
+    {
+        auto result = Scene::from_gltf(benchmark.scene_file);
+        if (!result.is_ok)
+        {
+            std::cerr << "Unable to load scene (" << benchmark.scene_file
+                      << ")" << std::endl;
+            return 1;
+        }
+        scene = std::move(result.value);
+        add_default_lights(*scene);
+    }
+
+    CameraPath path = CameraPath::orbit(scene->bounds());
+    if (!benchmark.camera_path_file.empty())
+    {
+        auto result = CameraPath::from_file(benchmark.camera_path_file);
+        if (!result.is_ok)
+        {
+            std::cerr << "Unable to load camera path ("
+                      << benchmark.camera_path_file << ")" << std::endl;
+            return 1;
+        }
+        path = std::move(result.value);
+    }
+
+    // Materials skip the frames where their programs are not built, which
+    // would be measured as fast frames
+    scene->wait_for_programs();
+
+    SceneView scene_view(scene.get());
+    auto tonemap_program = Program::from_file("tonemap.comp");
+
+    Texture depth(window_size, ImageFormat::Depth32_FLOAT);
+    Texture lit(window_size, ImageFormat::RGBA16_FLOAT);
+    Texture color(window_size, ImageFormat::RGBA8_UNORM);
+    Framebuffer framebuffer(&depth, std::array{ &lit });
+
+    // Warm up frames let GPU culling results come back
+    const size_t warmup_frames = 10;
+    const size_t frame_count = std::max(benchmark.frame_count, size_t(1));
+
+    std::vector<double> cpu_times;
+    std::vector<double> frame_times;
+    std::vector<double> gpu_times;
+    double draw_calls = 0.0;
+    double triangles = 0.0;
+
+    GPUProfiler &gpu_profiler = GPUProfiler::global();
+    auto read_gpu_time = [&] {
+        const std::deque<GPUFrame> &frames = gpu_profiler.frames();
+        if (!frames.empty() && frames.back().index >= warmup_frames
+            && frames.back().index < warmup_frames + frame_count
+            && gpu_times.size() < frames.back().index + 1 - warmup_frames)
+        {
+            gpu_times.push_back(frames.back().zones[0].duration_ms());
+        }
+    };
+
+    std::cout << "Rendering " << frame_count << " frames at " << window_size.x
+              << "x" << window_size.y << std::endl;
+
+    gpu_profiler.set_enabled(true);
+    double previous_start = 0.0;
+    for (size_t i = 0; i != warmup_frames + frame_count; ++i)
+    {
+        const bool measured = i >= warmup_frames;
+        const double start = program_time();
+        if (i > warmup_frames)
+        {
+            frame_times.push_back((start - previous_start) * 1000.0);
+        }
+        previous_start = start;
+
+        gpu_profiler.begin_frame();
+        read_gpu_time();
+
+        const float t =
+            measured ? float(i - warmup_frames) / float(frame_count) : 0.0f;
+        scene_view.camera().set_view(path.view_matrix(t));
+
+        framebuffer.bind();
+        scene_view.render(benchmark.settings, &depth, &lit);
+
+        tonemap_program->bind();
+        lit.bind(0);
+        color.bind_as_image(1, AccessType::WriteOnly);
+        glDispatchCompute(align_up_to(window_size.x, 8) / 8,
+                          align_up_to(window_size.y, 8) / 8, 1);
+
+        gpu_profiler.end_frame();
+        glFlush();
+
+        if (measured)
+        {
+            cpu_times.push_back((program_time() - start) * 1000.0);
+            draw_calls += scene->stats().draw_call_count;
+            triangles += scene->stats().triangle_count;
+        }
+    }
+    glFinish();
+
+    // Read back the last frames
+    gpu_profiler.set_enabled(false);
+    for (size_t i = 0; i != GPUProfiler::pending_frame_count; ++i)
+    {
+        gpu_profiler.begin_frame();
+        read_gpu_time();
+        gpu_profiler.end_frame();
+    }
+
+    const RenderStats &stats = scene->stats();
+    const ProgramCacheStats &program_stats = ProgramCache::global().stats();
+    std::ofstream out(benchmark.report_file);
+    if (!out)
+    {
+        std::cerr << "Unable to write " << benchmark.report_file << std::endl;
+        return 1;
+    }
+
+    const SceneGeneratorSettings &generator = benchmark.generator;
+    out << "{\n\"scene\":"
+        << (benchmark.generate ? "null" : json_string(benchmark.scene_file))
+        << ",\n\"generator\":";
+    if (benchmark.generate)
+    {
+        out << "{\"seed\":" << generator.seed
+            << ",\"meshes\":" << generator.mesh_count
+            << ",\"instances\":" << generator.instance_count
+            << ",\"distribution\":"
+            << json_string(distribution_name(generator.distribution))
+            << ",\"spacing\":" << generator.spacing
+            << ",\"materials\":" << generator.material_count
+            << ",\"lights\":" << generator.light_count << "}";
+    }
+    else
+    {
+        out << "null";
+    }
+    out << ",\n\"camera_path\":"
+        << (benchmark.camera_path_file.empty()
+                ? "null"
+                : json_string(benchmark.camera_path_file))
+        << ",\n\"renderer\":"
+        << json_string(reinterpret_cast<const char *>(
+               glGetString(GL_RENDERER)))
+        << ",\n\"width\":" << window_size.x
+        << ",\n\"height\":" << window_size.y
+        << ",\n\"frames\":" << frame_count
+        << ",\n\"warmup_frames\":" << warmup_frames << ",\n\"settings\":{";
+    const char *separator = "";
+    for (const auto &[name, value] : render_setting_flags(benchmark.settings))
+    {
+        out << separator << json_string(name) << ":"
+            << (*value ? "true" : "false");
+        separator = ",";
+    }
+    out << "},\n\"cpu_ms\":";
+    write_frame_times(out, cpu_times);
+    out << ",\n\"frame_ms\":";
+    write_frame_times(out, frame_times);
+    out << ",\n\"gpu_ms\":";
+    write_frame_times(out, gpu_times);
+    out << ",\n\"gpu_frames_dropped\":" << frame_count - gpu_times.size()
+        << ",\n\"draw_calls\":" << draw_calls / double(frame_count)
+        << ",\n\"triangles\":" << triangles / double(frame_count)
+        << ",\n\"objects\":" << stats.object_count
+        << ",\n\"programs\":{\"cache\":"
+        << (ProgramCache::global().is_enabled() ? "true" : "false")
+        << ",\"compiled\":" << program_stats.compiled_count
+        << ",\"compile_ms\":" << program_stats.compile_ms
+        << ",\"compile_wall_ms\":" << program_stats.compile_wall_ms
+        << ",\"loaded\":" << program_stats.loaded_count
+        << ",\"load_ms\":" << program_stats.load_ms
+        << ",\"load_wall_ms\":" << program_stats.load_wall_ms
+        << ",\"rejected\":" << program_stats.rejected_count << "}"
+        << ",\n\"memory\":{\"vertex_bytes\":" << stats.vertex_bytes
+        << ",\"index_bytes\":" << stats.index_bytes
+        << ",\"peak_process_bytes\":" << peak_memory_bytes() << "}\n}\n";
+
+    std::sort(cpu_times.begin(), cpu_times.end());
+    std::sort(gpu_times.begin(), gpu_times.end());
+    std::cout << "CPU median: " << cpu_times[cpu_times.size() / 2] << "ms";
+    if (!gpu_times.empty())
+    {
+        std::cout << ", GPU median: " << gpu_times[gpu_times.size() / 2]
+                  << "ms";
+    }
+    std::cout << std::endl
+              << "Programs: " << program_stats.compiled_count
+              << " compiled in " << program_stats.compile_ms << "ms ("
+              << program_stats.compile_wall_ms << "ms wall), "
+              << program_stats.loaded_count << " from cache in "
+              << program_stats.load_ms << "ms ("
+              << program_stats.load_wall_ms << "ms wall)" << std::endl;
+    std::cout << "Report written to " << benchmark.report_file
+              << std::endl;
+
+    scene = nullptr;
+    return 0;
+}
+
+// Object under the cursor, or -1
+int pick_object(GLFWwindow *window, const Scene &scene, const Camera &camera)
+{
+    glm::dvec2 mouse_pos;
+    glfwGetCursorPos(window, &mouse_pos.x, &mouse_pos.y);
+    const glm::vec2 ndc(float(mouse_pos.x / window_size.x) * 2.0f - 1.0f,
+                        1.0f - float(mouse_pos.y / window_size.y) * 2.0f);
+
+    Ray ray;
+    ray.origin = camera.position();
+    ray.direction = camera.ray_direction(ndc);
+
+    const Result<u32> hit = scene.pick(ray);
+    return hit.is_ok ? int(hit.value) : -1;
+}
+
+void draw_gpu_profiler()
+{
+    GPUProfiler &profiler = GPUProfiler::global();
+    if (!ImGui::CollapsingHeader("GPU profiler"))
+    {
+        return;
+    }
+
+    bool enabled = profiler.is_enabled();
+    if (ImGui::Checkbox("Profile GPU", &enabled))
+    {
+        profiler.set_enabled(enabled);
+    }
+
+    const std::deque<GPUFrame> &frames = profiler.frames();
+    if (frames.empty())
+    {
+        return;
+    }
+
+    if (ImGui::Button("Export GPU trace"))
+    {
+        if (!profiler.write_chrome_trace("gpu_trace.json").is_ok)
+        {
+            std::cerr << "Unable to write gpu_trace.json" << std::endl;
+        }
+    }
+
+    std::vector<float> frame_times;
+    for (const GPUFrame &frame : frames)
+    {
+        frame_times.push_back(float(frame.zones[0].duration_ms()));
+    }
+    ImGui::PlotLines("GPU frame (ms)", frame_times.data(),
+                     int(frame_times.size()), 0, nullptr, 0.0f, FLT_MAX,
+                     ImVec2(0.0f, 60.0f));
+    const u64 dropped_frames = profiler.dropped_frame_count();
+    ImGui::Text("Dropped frames: %llu",
+                static_cast<unsigned long long>(dropped_frames));
+
+    const GPUFrame &last = frames.back();
+    const double frame_ms = last.zones[0].duration_ms();
+    if (ImGui::BeginTable("GPU zones", 3,
+                          ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY,
+                          ImVec2(0.0f, 200.0f)))
+    {
+        ImGui::TableSetupColumn("Zone");
+        ImGui::TableSetupColumn("ms");
+        ImGui::TableSetupColumn("%");
+        ImGui::TableHeadersRow();
+        for (const GPUZone &zone : last.zones)
+        {
+            const double ms = zone.duration_ms();
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%*s%s", int(zone.depth * 2), "", zone.name);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", ms);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", frame_ms > 0.0 ? ms * 100.0 / frame_ms : 0.0);
+        }
+        ImGui::EndTable();
+    }
+}
+
+// Zones of every thread over the last window_ms, one row per nesting level
+void draw_cpu_profiler()
+{
+    CPUProfiler &profiler = CPUProfiler::global();
+    if (!ImGui::CollapsingHeader("CPU profiler"))
+    {
+        return;
+    }
+
+    bool enabled = profiler.is_enabled();
+    if (ImGui::Checkbox("Profile CPU", &enabled))
+    {
+        profiler.set_enabled(enabled);
+    }
+
+    if (ImGui::Button("Export CPU trace"))
+    {
+        if (!profiler.write_chrome_trace("cpu_trace.json").is_ok)
+        {
+            std::cerr << "Unable to write cpu_trace.json" << std::endl;
+        }
+    }
+
+    static bool paused = false;
+    static float window_ms = 50.0f;
+    static u64 window_end = 0;
+    static std::vector<CPUThreadZones> threads;
+    ImGui::SameLine();
+    ImGui::Checkbox("Pause", &paused);
+    ImGui::SliderFloat("Window (ms)", &window_ms, 1.0f, 1000.0f, "%.1f",
+                       ImGuiSliderFlags_Logarithmic);
+    if (!paused)
+    {
+        threads = profiler.snapshot();
+        window_end = CPUProfiler::time();
+    }
+
+    const float row_height = ImGui::GetTextLineHeightWithSpacing();
+    const double window_ns = double(window_ms) * 1.0e6;
+    const double window_begin = double(window_end) - window_ns;
+    for (const CPUThreadZones &thread : threads)
+    {
+        u32 max_depth = 0;
+        for (const CPUZone &zone : thread.zones)
+        {
+            max_depth = std::max(max_depth, zone.depth);
+        }
+
+        ImGui::TextUnformatted(thread.name.c_str());
+        const ImVec2 origin = ImGui::GetCursorScreenPos();
+        const float width = ImGui::GetContentRegionAvail().x;
+        ImGui::Dummy(ImVec2(width, row_height * float(max_depth + 1)));
+
+        ImDrawList *draw_list = ImGui::GetWindowDrawList();
+        const float scale = float(double(width) / window_ns);
+        for (const CPUZone &zone : thread.zones)
+        {
+            if (double(zone.end) < window_begin)
+            {
+                continue;
+            }
+
+            // At least a pixel wide, so short zones stay visible
+            const float begin = float(double(zone.begin) - window_begin);
+            const float end = float(double(zone.end) - window_begin);
+            const float x0 = origin.x + std::max(0.0f, begin * scale);
+            const float x1 = std::max(x0 + 1.0f, origin.x + end * scale);
+            const float y0 = origin.y + row_height * float(zone.depth);
+            const ImVec2 min(x0, y0);
+            const ImVec2 max(x1, y0 + row_height - 1.0f);
+
+            const u32 hash = str_hash(zone.name);
+            draw_list->AddRectFilled(
+                min, max, IM_COL32(64 + (hash & 0x7F), 64 + (hash >> 8 & 0x7F),
+                                   64 + (hash >> 16 & 0x7F), 255));
+            if (x1 - x0 > 20.0f)
+            {
+                draw_list->PushClipRect(min, max, true);
+                draw_list->AddText(ImVec2(x0 + 2.0f, y0), IM_COL32_WHITE,
+                                   zone.name);
+                draw_list->PopClipRect();
+            }
+            if (ImGui::IsMouseHoveringRect(min, max))
+            {
+                ImGui::SetTooltip("%s: %.3f ms", zone.name,
+                                  zone.duration_ms());
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv)
 {
+    CPUProfiler::global().set_thread_name("Main");
+
+    size_t light_benchmark_count = 0;
+    SceneBenchmark scene_benchmark;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!std::strcmp(argv[i], "--bench-culling"))
+        {
+            const size_t count =
+                i + 1 < argc ? std::strtoull(argv[i + 1], nullptr, 10) : 0;
+            run_culling_benchmark(count ? count : 100000);
+            return 0;
+        }
+        if (!std::strcmp(argv[i], "--bench-bvh"))
+        {
+            const size_t count =
+                i + 1 < argc ? std::strtoull(argv[i + 1], nullptr, 10) : 0;
+            run_bvh_benchmark(count ? count : 100000);
+            return 0;
+        }
+        if (!std::strcmp(argv[i], "--profile-cpu"))
+        {
+            // Also captures loading, the trace is written on exit
+            CPUProfiler::global().set_enabled(true);
+        }
+        if (!std::strcmp(argv[i], "--no-program-cache"))
+        {
+            // To measure shader compilation from scratch
+            ProgramCache::global().set_enabled(false);
+        }
+        if (!std::strcmp(argv[i], "--bench-lights"))
+        {
+            const size_t count =
+                i + 1 < argc ? std::strtoull(argv[i + 1], nullptr, 10) : 0;
+            light_benchmark_count = count ? count : 1000;
+        }
+
+        // --bench-scene [scene.glb] [--frames N] [--camera-path path.txt]
+        // [--report report.json] [--set render_setting]...
+        // [--generate [--seed N] [--meshes N] [--instances N]
+        // [--distribution uniform|grid|clusters] [--spacing X]
+        // [--materials N] [--lights N]]
+        // The scene is generated if no file is given
+        const bool has_value =
+            i + 1 < argc && std::strncmp(argv[i + 1], "--", 2);
+        if (!std::strcmp(argv[i], "--bench-scene"))
+        {
+            scene_benchmark.enabled = true;
+            if (has_value)
+            {
+                scene_benchmark.scene_file = argv[++i];
+            }
+        }
+        else if (!std::strcmp(argv[i], "--frames") && has_value)
+        {
+            scene_benchmark.frame_count =
+                std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (!std::strcmp(argv[i], "--camera-path") && has_value)
+        {
+            scene_benchmark.camera_path_file = argv[++i];
+        }
+        else if (!std::strcmp(argv[i], "--report") && has_value)
+        {
+            scene_benchmark.report_file = argv[++i];
+        }
+        else if (!std::strcmp(argv[i], "--generate"))
+        {
+            scene_benchmark.generate = true;
+        }
+        else if (!std::strcmp(argv[i], "--seed") && has_value)
+        {
+            scene_benchmark.generator.seed =
+                u32(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (!std::strcmp(argv[i], "--meshes") && has_value)
+        {
+            scene_benchmark.generator.mesh_count =
+                u32(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (!std::strcmp(argv[i], "--instances") && has_value)
+        {
+            scene_benchmark.generator.instance_count =
+                u32(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (!std::strcmp(argv[i], "--distribution") && has_value)
+        {
+            bool found = false;
+            for (const InstanceDistribution distribution :
+                 { InstanceDistribution::Uniform, InstanceDistribution::Grid,
+                   InstanceDistribution::Clusters })
+            {
+                if (!std::strcmp(distribution_name(distribution), argv[i + 1]))
+                {
+                    scene_benchmark.generator.distribution = distribution;
+                    found = true;
+                }
+            }
+            if (!found)
+            {
+                std::cerr << "Unknown distribution: " << argv[i + 1]
+                          << std::endl;
+                return 1;
+            }
+            ++i;
+        }
+        else if (!std::strcmp(argv[i], "--spacing") && has_value)
+        {
+            scene_benchmark.generator.spacing =
+                std::strtof(argv[++i], nullptr);
+        }
+        else if (!std::strcmp(argv[i], "--materials") && has_value)
+        {
+            scene_benchmark.generator.material_count =
+                u32(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (!std::strcmp(argv[i], "--lights") && has_value)
+        {
+            scene_benchmark.generator.light_count =
+                u32(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (!std::strcmp(argv[i], "--set") && has_value)
+        {
+            bool found = false;
+            for (const auto &[name, value] :
+                 render_setting_flags(scene_benchmark.settings))
+            {
+                if (!std::strcmp(name, argv[i + 1]))
+                {
+                    *value = found = true;
+                }
+            }
+            if (!found)
+            {
+                std::cerr << "Unknown render setting: " << argv[i + 1]
+                          << std::endl;
+                return 1;
+            }
+            ++i;
+        }
+    }
+
     DEBUG_ASSERT([] {
         std::cout << "Debug asserts enabled" << std::endl;
         return true;
     }());
 
+    // Runs without any display when EGL is available
+    if (light_benchmark_count || scene_benchmark.enabled)
+    {
+        const auto context = HeadlessContext::create();
+        if (context.is_ok)
+        {
+            init_graphics(HeadlessContext::get_proc_address);
+            if (light_benchmark_count)
+            {
+                run_light_benchmark(light_benchmark_count);
+                return 0;
+            }
+            return run_scene_benchmark(scene_benchmark);
+        }
+        std::cout << "No headless context, using a hidden window" << std::endl;
+    }
+
     glfw_check(glfwInit());
     DEFER(glfwTerminate());
 
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    if (light_benchmark_count || scene_benchmark.enabled)
+    {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    }
 
     GLFWwindow *window = glfwCreateWindow(window_size.x, window_size.y,
                                           "TP window", nullptr, nullptr);
@@ -145,6 +1047,17 @@ int main(int, char **)
     glfwSwapInterval(1); // Enable vsync
     init_graphics();
 
+    if (light_benchmark_count)
+    {
+        run_light_benchmark(light_benchmark_count);
+        return 0;
+    }
+    if (scene_benchmark.enabled)
+    {
+        // Only renders offscreen, vsync does not apply
+        return run_scene_benchmark(scene_benchmark);
+    }
+
     ImGuiRenderer imgui(window);
 
     std::unique_ptr<Scene> scene = create_default_scene();
@@ -158,6 +1071,16 @@ int main(int, char **)
     Framebuffer main_framebuffer(&depth, std::array{ &lit });
     Framebuffer tonemap_framebuffer(nullptr, std::array{ &color });
 
+    RenderSettings render_settings;
+    SceneImportSettings import_settings;
+    SceneGeneratorSettings generator_settings;
+    int picked_object = -1;
+
+    // For --bench-scene --camera-path
+    CameraPath recorded_path;
+    bool recording_path = false;
+    double next_path_key_time = 0.0;
+
     for (;;)
     {
         glfwPollEvents();
@@ -167,40 +1090,68 @@ int main(int, char **)
             break;
         }
 
+        PROFILE_ZONE("Frame");
+
         update_delta_time();
 
+        // A key every quarter of a second, smoothed by the spline on replay
+        if (recording_path && program_time() >= next_path_key_time)
+        {
+            const Camera &camera = scene_view.camera();
+            recorded_path.add_key(
+                { camera.position(), camera.position() + camera.forward() });
+            next_path_key_time = program_time() + 0.25;
+        }
+
         if (const auto &io = ImGui::GetIO();
             !io.WantCaptureMouse && !io.WantCaptureKeyboard)
         {
             process_inputs(window, scene_view.camera());
+
+            if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT)
+                == GLFW_PRESS)
+            {
+                picked_object =
+                    pick_object(window, *scene, scene_view.camera());
+            }
         }
 
+        GPUProfiler::global().begin_frame();
+
         // Render the scene
         {
+            GPU_PROFILE_SCOPE("Main pass");
             main_framebuffer.bind();
-            scene_view.render();
+            scene_view.render(render_settings, &depth, &lit);
         }
 
         // Apply a tonemap in compute shader
         {
+            GPU_PROFILE_SCOPE("Tonemap");
             tonemap_program->bind();
             lit.bind(0);
             color.bind_as_image(1, AccessType::WriteOnly);
-            glDispatchCompute(align_up_to(window_size.x, 8),
-                              align_up_to(window_size.y, 8), 1);
+            glDispatchCompute(align_up_to(window_size.x, 8) / 8,
+                              align_up_to(window_size.y, 8) / 8, 1);
         }
         // Blit tonemap result to screen
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        tonemap_framebuffer.blit();
+        {
+            GPU_PROFILE_SCOPE("Blit");
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            tonemap_framebuffer.blit();
+        }
 
         // GUI
+        GPUProfiler::global().begin_scope("ImGui");
         imgui.start();
         {
+            PROFILE_ZONE("ImGui");
+
             char buffer[1024] = {};
             if (ImGui::InputText("Load scene", buffer, sizeof(buffer),
                                  ImGuiInputTextFlags_EnterReturnsTrue))
             {
-                auto result = Scene::from_gltf(buffer);
+                auto result = Scene::from_gltf(buffer, import_settings);
                 if (!result.is_ok)
                 {
                     std::cerr << "Unable to load scene (" << buffer << ")"
@@ -212,11 +1163,152 @@ int main(int, char **)
                     scene_view = SceneView(scene.get());
                 }
             }
+
+            bool packed_vertices =
+                import_settings.vertex_format == VertexFormat::Packed;
+            if (ImGui::Checkbox("Load with packed vertices", &packed_vertices))
+            {
+                import_settings.vertex_format =
+                    packed_vertices ? VertexFormat::Packed : VertexFormat::Full;
+            }
+
+            int instance_count = int(generator_settings.instance_count);
+            if (ImGui::InputInt("Instances", &instance_count, 1000))
+            {
+                generator_settings.instance_count =
+                    u32(std::max(instance_count, 0));
+            }
+            int light_count = int(generator_settings.light_count);
+            if (ImGui::InputInt("Lights", &light_count, 100))
+            {
+                generator_settings.light_count = u32(std::max(light_count, 0));
+            }
+            int distribution = int(generator_settings.distribution);
+            if (ImGui::Combo("Distribution", &distribution,
+                             "Uniform\0Grid\0Clusters\0"))
+            {
+                generator_settings.distribution =
+                    InstanceDistribution(distribution);
+            }
+            if (ImGui::Button("Generate scene"))
+            {
+                scene = generate_scene(generator_settings, import_settings);
+                scene_view = SceneView(scene.get());
+                picked_object = -1;
+            }
+
+            if (ImGui::Checkbox("Record camera path", &recording_path)
+                && recording_path)
+            {
+                recorded_path = CameraPath();
+            }
+            if (!recording_path && !recorded_path.is_empty())
+            {
+                ImGui::SameLine();
+                if (ImGui::Button("Save camera path")
+                    && !recorded_path.write("camera_path.txt").is_ok)
+                {
+                    std::cerr << "Unable to write camera_path.txt"
+                              << std::endl;
+                }
+            }
+
+            ImGui::Checkbox("Multi draw indirect",
+                            &render_settings.multi_draw_indirect);
+            ImGui::Checkbox("GPU culling", &render_settings.gpu_culling);
+            ImGui::Checkbox("Occlusion culling",
+                            &render_settings.occlusion_culling);
+            ImGui::Checkbox("CPU culling", &render_settings.cpu_culling);
+            ImGui::Checkbox("BVH culling", &render_settings.bvh_culling);
+            ImGui::Checkbox("Software occlusion",
+                            &render_settings.software_occlusion);
+            ImGui::Checkbox("LOD selection", &render_settings.lod_selection);
+            ImGui::SliderFloat("LOD threshold", &render_settings.lod_threshold,
+                               0.0001f, 0.01f, "%.4f",
+                               ImGuiSliderFlags_Logarithmic);
+            ImGui::Checkbox("Meshlet culling",
+                            &render_settings.meshlet_culling);
+            ImGui::SliderFloat("Meshlet size", &render_settings.meshlet_size,
+                               0.01f, 1.0f, "%.2f",
+                               ImGuiSliderFlags_Logarithmic);
+            ImGui::Checkbox("Depth prepass", &render_settings.depth_prepass);
+            ImGui::Checkbox("Deferred shading",
+                            &render_settings.deferred_shading);
+            ImGui::Checkbox("Clustered lighting",
+                            &render_settings.clustered_lighting);
+            ImGui::Checkbox("Show light clusters",
+                            &render_settings.show_light_clusters);
+            int cluster_grid[3] = { int(render_settings.cluster_grid.x),
+                                    int(render_settings.cluster_grid.y),
+                                    int(render_settings.cluster_grid.z) };
+            if (ImGui::SliderInt3("Cluster grid", cluster_grid, 1, 64))
+            {
+                render_settings.cluster_grid =
+                    glm::uvec3(cluster_grid[0], cluster_grid[1],
+                               cluster_grid[2]);
+            }
+
+            const RenderStats &stats = scene->stats();
+            ImGui::Text("Objects: %u", stats.object_count);
+            ImGui::Text("Visible: %u, culled: %u (occluded: %u)",
+                        stats.visible_count, stats.culled_count,
+                        stats.occluded_count);
+            ImGui::Text("Picked object: %d", picked_object);
+            ImGui::Text("Triangles: %u, draw calls: %u", stats.triangle_count,
+                        stats.draw_call_count);
+            const ProgramCacheStats &program_stats =
+                ProgramCache::global().stats();
+            ImGui::Text("Programs: %u compiled in %.1fms (%.1fms wall)",
+                        program_stats.compiled_count, program_stats.compile_ms,
+                        program_stats.compile_wall_ms);
+            ImGui::Text("%u cached in %.1fms (%.1fms wall)",
+                        program_stats.loaded_count, program_stats.load_ms,
+                        program_stats.load_wall_ms);
+            ImGui::Text("Instances per LOD: %u / %u / %u / %u",
+                        stats.lod_instance_counts[0],
+                        stats.lod_instance_counts[1],
+                        stats.lod_instance_counts[2],
+                        stats.lod_instance_counts[3]);
+            ImGui::Text("Meshlets: %u, culled: %u", stats.meshlet_count,
+                        stats.culled_meshlet_count);
+            ImGui::Text("Depth prepass: %.3f ms, lit pass: %.3f ms",
+                        stats.depth_prepass_ms, stats.lit_pass_ms);
+            ImGui::Text("Lit pass overdraw: %.2f",
+                        double(stats.lit_samples)
+                            / double(window_size.x * window_size.y));
+            if (stats.gbuffer_bytes_per_pixel)
+            {
+                // Written once per shaded sample, read once by the lighting
+                const double overdraw = double(stats.lit_samples)
+                    / double(window_size.x * window_size.y);
+                ImGui::Text("Lighting: %.3f ms, %u lights dropped",
+                            stats.lighting_ms, stats.dropped_tile_lights);
+                ImGui::Text("G-buffer: %u B/px, %.1f B/px per frame",
+                            stats.gbuffer_bytes_per_pixel,
+                            stats.gbuffer_bytes_per_pixel * (overdraw + 1.0));
+            }
+            ImGui::Text("Geometry: %.2f MB vertices, %.2f MB indices",
+                        double(stats.vertex_bytes) / (1024.0 * 1024.0),
+                        double(stats.index_bytes) / (1024.0 * 1024.0));
+
+            draw_gpu_profiler();
+            draw_cpu_profiler();
         }
         imgui.finish();
+        GPUProfiler::global().end_scope();
+
+        GPUProfiler::global().end_frame();
 
         glfwSwapBuffers(window);
     }
 
     scene = nullptr; // destroy scene and child OpenGL objects
+
+    if (CPUProfiler::global().is_enabled())
+    {
+        if (!CPUProfiler::global().write_chrome_trace("cpu_trace.json").is_ok)
+        {
+            std::cerr << "Unable to write cpu_trace.json" << std::endl;
+        }
+    }
 }
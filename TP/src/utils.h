@@ -17,6 +17,10 @@
 // Execute expr at scope exit
 #define DEFER(expr)                                                            \
     auto CREATE_UNIQUE_NAME_WITH_PREFIX(defer) = OnExit([&]() { expr; })
+// Record the rest of the scope as a CPU profiler zone (see CPUProfiler.h),
+// name must outlive the profiler (string literal)
+#define PROFILE_ZONE(name)                                                     \
+    ::OM3D::ProfileZone CREATE_UNIQUE_NAME_WITH_PREFIX(zone)(name)
 // Print message and terminate immediatly
 #define FATAL(msg) ::OM3D::fatal((msg), __FILE__, __LINE__)
 // Assert in debug and release
@@ -117,6 +121,33 @@ namespace OM3D
         T _ex;
     };
 
+    // Returned by begin_profile_zone while the CPU profiler is disabled
+    inline constexpr u64 no_profile_zone = ~u64(0);
+
+    u64 begin_profile_zone();
+    void end_profile_zone(const char *name, u64 begin);
+
+    class ProfileZone : NonMovable
+    {
+    public:
+        inline ProfileZone(const char *name)
+            : _name(name)
+            , _begin(begin_profile_zone())
+        {}
+
+        inline ~ProfileZone()
+        {
+            if (_begin != no_profile_zone)
+            {
+                end_profile_zone(_name, _begin);
+            }
+        }
+
+    private:
+        const char *_name;
+        u64 _begin;
+    };
+
     // Similar to std::span
     template <typename T>
     class Span
@@ -296,6 +327,20 @@ namespace OM3D
         return ~crc;
     }
 
+    // FNV-1a, pass the previous hash as seed to hash several buffers
+    inline u64 hash_bytes(const void *data, size_t size,
+                          u64 seed = 0xcbf29ce484222325)
+    {
+        const u8 *bytes = static_cast<const u8 *>(data);
+        u64 hash = seed;
+        for (size_t i = 0; i != size; ++i)
+        {
+            hash ^= u64(bytes[i]);
+            hash *= 0x100000001b3;
+        }
+        return hash;
+    }
+
     template <typename T>
     inline constexpr T to_rad(T deg)
     {
@@ -0,0 +1,93 @@
+#include <Camera.h>
+#include <OcclusionBuffer.h>
+
+#include <iostream>
+
+using namespace OM3D;
+
+static int failure_count = 0;
+
+#define CHECK(cond)                                                            \
+    do                                                                         \
+    {                                                                          \
+        if (!(cond))                                                           \
+        {                                                                      \
+            std::cerr << __FILE__ << ":" << __LINE__                           \
+                      << ": check failed: " << #cond << std::endl;             \
+            ++failure_count;                                                   \
+        }                                                                      \
+    } while (false)
+
+// Square of side 2 in the XY plane, facing +Z
+static OccluderMesh quad()
+{
+    OccluderMesh mesh;
+    mesh.positions = { glm::vec3(-1.0f, -1.0f, 0.0f),
+                       glm::vec3(1.0f, -1.0f, 0.0f),
+                       glm::vec3(1.0f, 1.0f, 0.0f),
+                       glm::vec3(-1.0f, 1.0f, 0.0f) };
+    mesh.indices = { 0, 1, 2, 0, 2, 3 };
+    return mesh;
+}
+
+static void check_quad(bool multithreaded)
+{
+    // Looking down -Z at the quad, which covers the middle of the screen
+    Camera camera;
+    camera.set_view(glm::lookAt(glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(0.0f),
+                                glm::vec3(0.0f, 1.0f, 0.0f)));
+
+    OcclusionBuffer buffer;
+    buffer.clear(camera.view_proj_matrix());
+    buffer.add_occluder(quad(), glm::mat4(1.0f));
+    CHECK(buffer.triangle_count() == 2);
+    buffer.rasterize(multithreaded);
+
+    const glm::uvec2 center = buffer.size() / 2u;
+    CHECK(buffer.depth(center.x, center.y) > 0.0f);
+    CHECK(buffer.depth(0, 0) == 0.0f);
+
+    // Entirely behind the quad
+    CHECK(!buffer.is_visible(
+        AABB{ glm::vec3(-0.5f, -0.5f, -3.0f), glm::vec3(0.5f, 0.5f, -2.0f) }));
+
+    // Behind, but sticking out of its right side
+    CHECK(buffer.is_visible(
+        AABB{ glm::vec3(0.5f, -0.25f, -3.0f), glm::vec3(2.5f, 0.25f, -2.0f) }));
+
+    // Between the quad and the camera
+    CHECK(buffer.is_visible(
+        AABB{ glm::vec3(-0.5f, -0.5f, 1.0f), glm::vec3(0.5f, 0.5f, 2.0f) }));
+
+    // Crossing the quad
+    CHECK(buffer.is_visible(
+        AABB{ glm::vec3(-0.5f, -0.5f, -1.0f), glm::vec3(0.5f, 0.5f, 1.0f) }));
+
+    // Next to the quad, nothing hides it
+    CHECK(buffer.is_visible(
+        AABB{ glm::vec3(3.0f, -0.5f, -3.0f), glm::vec3(4.0f, 0.5f, -2.0f) }));
+
+    // Seen from behind, the quad is back facing and hides nothing
+    camera.set_view(glm::lookAt(glm::vec3(0.0f, 0.0f, -5.0f), glm::vec3(0.0f),
+                                glm::vec3(0.0f, 1.0f, 0.0f)));
+    buffer.clear(camera.view_proj_matrix());
+    buffer.add_occluder(quad(), glm::mat4(1.0f));
+    CHECK(buffer.triangle_count() == 0);
+    buffer.rasterize(multithreaded);
+    CHECK(buffer.is_visible(
+        AABB{ glm::vec3(-0.5f, -0.5f, 2.0f), glm::vec3(0.5f, 0.5f, 3.0f) }));
+}
+
+int main()
+{
+    check_quad(false);
+    check_quad(true);
+
+    if (failure_count)
+    {
+        std::cerr << failure_count << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}